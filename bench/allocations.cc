@@ -0,0 +1,86 @@
+// Allocation benchmarks: the library's own heap allocations per call of
+// `map_concurrently()`, on the fast and generic paths and on each executor,
+// and the time cost of counting them with `allocation_accounting`.
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <type_traits>
+
+#include "lt/async/alloc-stats.h"
+#include "lt/async/async.h"
+#include "lt/async/executor.h"
+#include "lt/async/fiber.h"
+
+#include "bench.h"
+
+LT_ASYNC_DEFINE_ALLOCATION_HOOKS;
+
+namespace
+{
+
+using lt::async::attempt_result_t;
+
+template <typename output_type>
+output_type make_output(int i)
+{
+    if constexpr (std::is_same_v<output_type, std::string>) {
+        return std::to_string(i);
+    } else {
+        return output_type(i);
+    }
+}
+
+template <typename output_type, typename executor_type>
+void report_library_allocations(const std::string& name, executor_type& ex)
+{
+    auto tasks = lt::async::basic_async<int, output_type, std::string, executor_type, lt::async::in_order,
+                                        lt::async::run_to_completion, lt::async::allocation_accounting>(ex);
+
+    for (std::size_t elements : {10, 1000, 100000}) {
+        auto input = lt::async::bench::iota(elements);
+        auto f = [](const int& i) -> attempt_result_t<output_type> { return make_output<output_type>(i); };
+
+        // The first call of a size may grow the executor's pooled state.
+        tasks.map_concurrently(f, input);
+        tasks.map_concurrently(f, input);
+        auto s = tasks.instrumentation().last_batch();
+        std::printf("%-48s %10llu allocations %12llu bytes\n",
+                    (name + " n=" + std::to_string(elements)).c_str(),
+                    static_cast<unsigned long long>(s.library.allocations),
+                    static_cast<unsigned long long>(s.library.bytes));
+        tasks.instrumentation().reset();
+    }
+}
+
+template <typename instrumentation>
+void bench_counting_cost(const std::string& name, lt::async::thread_pool& pool)
+{
+    auto tasks = lt::async::basic_async<int, int, std::string, lt::async::thread_pool, lt::async::in_order,
+                                        lt::async::run_to_completion, instrumentation>(pool);
+    constexpr std::size_t elements = 100000;
+    auto input = lt::async::bench::iota(elements);
+
+    lt::async::bench::measure(name, elements, 20, [&] {
+        tasks.map_concurrently([](const int& i) -> attempt_result_t<int> { return i + 1; }, input);
+        if constexpr (std::is_same_v<instrumentation, lt::async::allocation_accounting>) {
+            tasks.instrumentation().reset();
+        }
+    });
+}
+
+} // namespace
+
+int main()
+{
+    auto pool = lt::async::thread_pool();
+    auto fibers = lt::async::fiber_pool();
+
+    report_library_allocations<int>("thread_pool trivial", pool);
+    report_library_allocations<std::string>("thread_pool generic", pool);
+    report_library_allocations<int>("fiber_pool trivial", fibers);
+    report_library_allocations<std::string>("fiber_pool generic", fibers);
+
+    bench_counting_cost<lt::async::no_instrumentation>("no_instrumentation", pool);
+    bench_counting_cost<lt::async::allocation_accounting>("allocation_accounting", pool);
+}
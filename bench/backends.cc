@@ -0,0 +1,74 @@
+// Backend benchmarks: `map_concurrently()` on each backend compiled into this
+// build, for cheap elements, where scheduling overhead dominates, and for
+// elements with some work of their own.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "lt/async/async.h"
+#include "lt/async/backends.h"
+
+#include "bench.h"
+
+namespace
+{
+
+using lt::async::attempt_result_t;
+
+const char* name(lt::async::backend b)
+{
+    switch (b) {
+    case lt::async::backend::native:
+        return "native";
+    case lt::async::backend::openmp:
+        return "openmp";
+    case lt::async::backend::tbb:
+        return "tbb";
+    case lt::async::backend::parallel_stl:
+        return "parallel_stl";
+    }
+    return "unknown";
+}
+
+// A few hundred nanoseconds of arithmetic the compiler cannot fold away.
+int work(int i)
+{
+    auto x = static_cast<std::uint32_t>(i) | 1u;
+    for (int k = 0; k < 256; ++k) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+    }
+    return static_cast<int>(x);
+}
+
+void bench_backend(lt::async::backend b)
+{
+    auto ex = lt::async::make_executor(b);
+    auto tasks = lt::async::async<int, int>(*ex);
+
+    for (std::size_t elements : {1000, 100000}) {
+        auto input = lt::async::bench::iota(elements);
+        auto suffix = std::string(" n=") + std::to_string(elements);
+
+        lt::async::bench::measure(std::string(name(b)) + " cheap" + suffix, elements, 20, [&] {
+            tasks.map_concurrently([](const int& i) -> attempt_result_t<int> { return i + 1; }, input);
+        });
+        lt::async::bench::measure(std::string(name(b)) + " work" + suffix, elements, 20, [&] {
+            tasks.map_concurrently([](const int& i) -> attempt_result_t<int> { return work(i); }, input);
+        });
+    }
+}
+
+} // namespace
+
+int main()
+{
+    for (auto b : {lt::async::backend::native, lt::async::backend::openmp, lt::async::backend::tbb,
+                   lt::async::backend::parallel_stl}) {
+        if (lt::async::backend_available(b)) {
+            bench_backend(b);
+        }
+    }
+}
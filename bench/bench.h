@@ -0,0 +1,47 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace lt::async::bench
+{
+
+// measure
+//
+// Run `f()` `repetitions` times after one warm-up run, and print the median
+// time per element for a batch of `elements`.
+template <typename F>
+void measure(const std::string& name, std::size_t elements, int repetitions, F&& f)
+{
+    f();
+
+    auto samples = std::vector<double>();
+    samples.reserve(repetitions);
+    for (int r = 0; r < repetitions; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+        samples.push_back(elapsed.count() / static_cast<double>(std::max<std::size_t>(1, elements)));
+    }
+
+    std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+    std::printf("%-48s %10.1f ns/element\n", name.c_str(), samples[samples.size() / 2]);
+}
+
+// iota
+//
+// The inputs 0 .. n-1.
+inline std::vector<int> iota(std::size_t n)
+{
+    auto v = std::vector<int>(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        v[i] = static_cast<int>(i);
+    }
+    return v;
+}
+
+} // namespace lt::async::bench
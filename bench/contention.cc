@@ -0,0 +1,78 @@
+// Contention benchmarks: the per-element cost of `map_concurrently()` as the
+// number of workers grows, and of the MPMC queue which feeds them, with one
+// element and with batches per operation.
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "lt/async/async.h"
+#include "lt/async/executor.h"
+#include "lt/async/mpmc-queue.h"
+
+#include "bench.h"
+
+namespace
+{
+
+using lt::async::attempt_result_t;
+
+void bench_map_concurrently(std::size_t threads, std::size_t elements)
+{
+    auto pool = lt::async::thread_pool(threads);
+    auto tasks = lt::async::basic_async<int, int, std::string, lt::async::thread_pool>(pool);
+    auto input = lt::async::bench::iota(elements);
+
+    lt::async::bench::measure(
+        "map_concurrently threads=" + std::to_string(threads) + " n=" + std::to_string(elements), elements, 20,
+        [&] { tasks.map_concurrently([](const int& i) -> attempt_result_t<int> { return i + 1; }, input); });
+}
+
+// Each of `threads` producers pushes `per_thread` elements, `batch` at a time,
+// while as many consumers pop them.
+void bench_queue(std::size_t threads, std::size_t batch)
+{
+    constexpr std::size_t per_thread = 1 << 18;
+    auto q = lt::async::mpmc_queue<std::size_t>(4096);
+
+    lt::async::bench::measure(
+        "mpmc_queue threads=" + std::to_string(threads) + " batch=" + std::to_string(batch),
+        2 * threads * per_thread, 5, [&] {
+            auto popped = std::atomic<std::size_t>(0);
+            auto workers = std::vector<std::jthread>();
+            for (std::size_t t = 0; t < threads; ++t) {
+                workers.emplace_back([&] {
+                    auto values = std::vector<std::size_t>(batch);
+                    for (std::size_t sent = 0; sent < per_thread;) {
+                        auto n = std::min(batch, per_thread - sent);
+                        sent += q.try_push_bulk(values.begin(), n);
+                    }
+                });
+                workers.emplace_back([&] {
+                    auto values = std::vector<std::size_t>(batch);
+                    while (popped.load(std::memory_order_relaxed) < threads * per_thread) {
+                        popped.fetch_add(q.try_pop_bulk(values.begin(), batch), std::memory_order_relaxed);
+                    }
+                });
+            }
+        });
+}
+
+} // namespace
+
+int main()
+{
+    auto hardware = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+    for (std::size_t threads = 1; threads <= hardware; threads *= 2) {
+        bench_map_concurrently(threads, 1000);
+        bench_map_concurrently(threads, 100000);
+    }
+
+    for (std::size_t threads = 1; threads <= hardware; threads *= 2) {
+        bench_queue(threads, 1);
+        bench_queue(threads, 32);
+    }
+}
@@ -0,0 +1,76 @@
+// Trivially copyable elements against the generic path: the same work on an
+// `int`, and on an `int` wrapped in a type with a user-provided copy
+// constructor, which `map_concurrently()` cannot treat as trivial.
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "lt/async/async.h"
+#include "lt/async/executor.h"
+#include "lt/async/policy.h"
+
+#include "bench.h"
+
+namespace
+{
+
+using lt::async::attempt_result_t;
+
+struct boxed
+{
+    boxed() = default;
+
+    boxed(int v)
+        : value(v)
+    {
+    }
+
+    boxed(const boxed& other)
+        : value(other.value)
+    {
+    }
+
+    boxed& operator=(const boxed& other)
+    {
+        value = other.value;
+        return *this;
+    }
+
+    int value = 0;
+};
+
+static_assert(lt::async::detail::is_trivial_element_v<int, int>);
+static_assert(!lt::async::detail::is_trivial_element_v<int, boxed>);
+
+template <typename output_type, typename ordering, typename error_mode>
+void bench_path(const std::string& name, lt::async::thread_pool& pool, std::size_t elements)
+{
+    auto tasks = lt::async::basic_async<int, output_type, std::string, lt::async::thread_pool, ordering,
+                                        error_mode>(pool);
+    auto input = lt::async::bench::iota(elements);
+
+    lt::async::bench::measure(name + " n=" + std::to_string(elements), elements, 20, [&] {
+        tasks.map_concurrently([](const int& i) -> attempt_result_t<output_type> { return output_type(i + 1); },
+                               input);
+    });
+}
+
+template <typename ordering, typename error_mode>
+void bench_policies(const std::string& policies, lt::async::thread_pool& pool)
+{
+    for (std::size_t elements : {100, 10000, 1000000}) {
+        bench_path<int, ordering, error_mode>("trivial " + policies, pool, elements);
+        bench_path<boxed, ordering, error_mode>("generic " + policies, pool, elements);
+    }
+}
+
+} // namespace
+
+int main()
+{
+    auto pool = lt::async::thread_pool();
+    bench_policies<lt::async::in_order, lt::async::run_to_completion>("in_order/run_to_completion", pool);
+    bench_policies<lt::async::in_order, lt::async::fail_fast>("in_order/fail_fast", pool);
+    bench_policies<lt::async::completion_order, lt::async::run_to_completion>("completion_order", pool);
+}
@@ -0,0 +1,132 @@
+// Reactor benchmarks: elements on a `fiber_pool` which echo a byte over their
+// own socketpair, each side waiting for readiness through the reactor, and
+// `lt::retry` delays timed on the carriers against on the reactor's timerfd.
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "lt/async/async-retry.h"
+#include "lt/async/async.h"
+#include "lt/async/fiber.h"
+#include "lt/async/reactor.h"
+
+#include "bench.h"
+
+LT_ASYNC_DEFINE_FIBER_WAITS;
+
+namespace
+{
+
+using lt::async::attempt_result_t;
+
+struct socket_pair
+{
+    socket_pair()
+    {
+        [[maybe_unused]] auto r = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds);
+    }
+
+    socket_pair(const socket_pair&) = delete;
+    socket_pair& operator=(const socket_pair&) = delete;
+
+    ~socket_pair()
+    {
+        ::close(fds[0]);
+        ::close(fds[1]);
+    }
+
+    int fds[2] = {-1, -1};
+};
+
+// Each element writes a byte to one end of its pair, waits for it on the
+// other end and writes it back, `rounds` times. The fibers spend most of their
+// time parked in `wait_ready()`.
+void bench_echo(lt::async::reactor& r, std::size_t carriers, std::size_t elements)
+{
+    constexpr int rounds = 10;
+    auto fibers = lt::async::fiber_pool(carriers);
+    auto tasks = lt::async::basic_async<int, int, std::string, lt::async::fiber_pool>(fibers);
+    auto sockets = std::vector<std::unique_ptr<socket_pair>>();
+    for (std::size_t i = 0; i < elements; ++i) {
+        sockets.push_back(std::make_unique<socket_pair>());
+    }
+    auto input = lt::async::bench::iota(elements);
+
+    auto echo = [&](const int& i) -> attempt_result_t<int> {
+        auto& s = *sockets[i];
+        auto c = char('x');
+        for (int round = 0; round < rounds; ++round) {
+            for (auto [from, to] : {std::pair(s.fds[0], s.fds[1]), std::pair(s.fds[1], s.fds[0])}) {
+                [[maybe_unused]] auto w = ::write(from, &c, 1);
+                auto ready = r.wait_ready(to, EPOLLIN);
+                if (!ready) {
+                    return tl::unexpected(ready.error().message());
+                }
+                [[maybe_unused]] auto n = ::read(to, &c, 1);
+            }
+        }
+        return i;
+    };
+
+    lt::async::bench::measure(
+        "echo carriers=" + std::to_string(carriers) + " n=" + std::to_string(elements), elements * 2 * rounds, 5,
+        [&] { tasks.map_concurrently(echo, input); });
+
+    for (auto && s : sockets) {
+        r.forget(s->fds[0]);
+        r.forget(s->fds[1]);
+    }
+}
+
+// Every element fails its first attempt and is retried after a 1ms delay.
+void bench_retry_delays(lt::async::reactor* r, std::size_t elements)
+{
+    auto fibers = lt::async::fiber_pool(2);
+    fibers.set_timer_source(r);
+    auto tasks = lt::async::async_retry<int, int>(lt::retry::constantDelay(std::chrono::milliseconds(1)), fibers);
+    auto input = lt::async::bench::iota(elements);
+    auto attempts = std::vector<std::atomic<int>>(elements);
+
+    lt::async::bench::measure(
+        std::string("retry delays timed on ") + (r != nullptr ? "reactor" : "carriers") + " n="
+            + std::to_string(elements),
+        elements, 5, [&] {
+            for (auto& a : attempts) {
+                a.store(0, std::memory_order_relaxed);
+            }
+            tasks.map_concurrently_retry(
+                [](lt::retry::RetryStatus, const int& o) { return o < 0; },
+                [&](const int& i) -> attempt_result_t<int> {
+                    return attempts[i].fetch_add(1, std::memory_order_relaxed) == 0 ? -1 : i;
+                },
+                input);
+        });
+}
+
+} // namespace
+
+int main()
+{
+    auto r = lt::async::reactor();
+    auto hardware = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+    for (std::size_t carriers = 1; carriers <= hardware; carriers *= 2) {
+        bench_echo(r, carriers, 100);
+        bench_echo(r, carriers, 400);
+    }
+
+    for (std::size_t elements : {1000, 10000}) {
+        bench_retry_delays(nullptr, elements);
+        bench_retry_delays(&r, elements);
+    }
+}
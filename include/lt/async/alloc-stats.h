@@ -0,0 +1,396 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace lt::async
+{
+
+// allocation_counts
+//
+// Number and total size of heap allocations made through `operator new`.
+struct allocation_counts
+{
+    std::uint64_t allocations = 0;
+    std::uint64_t bytes = 0;
+
+    allocation_counts& operator+=(const allocation_counts& o)
+    {
+        allocations += o.allocations;
+        bytes += o.bytes;
+        return *this;
+    }
+
+    friend allocation_counts operator-(allocation_counts a, const allocation_counts& b)
+    {
+        return allocation_counts{a.allocations - b.allocations, a.bytes - b.bytes};
+    }
+};
+
+// allocation_stats
+//
+// Allocations made during one call, such as `map_concurrently()`, split
+// between the library's bookkeeping on the calling thread and the element
+// functions on whichever threads ran them.
+struct allocation_stats
+{
+    std::size_t elements = 0;
+    allocation_counts library;
+    allocation_counts user;
+};
+
+// element_allocations
+//
+// Allocations made by the element function for one element.
+struct element_allocations
+{
+    std::size_t index = 0;
+    allocation_counts user;
+};
+
+namespace detail
+{
+
+inline std::atomic<bool> allocation_hooks_installed{false};
+
+// allocation_context
+//
+// Per-thread pointer to the counts of the innermost scope which is counting
+// on this thread, if any.
+struct allocation_context
+{
+    allocation_counts* sink = nullptr;
+};
+
+// Not inlined, for the same reason as `this_worker()`: an element on a fiber
+// may finish on a different thread than the one it started on.
+[[gnu::noinline]] inline allocation_context& this_thread_allocations()
+{
+    thread_local allocation_context c;
+    asm volatile("");
+    return c;
+}
+
+// Called by the replacement `operator new` for each allocation.
+inline void count_allocation(std::size_t bytes) noexcept
+{
+    if (auto* s = this_thread_allocations().sink) [[unlikely]] {
+        ++s->allocations;
+        s->bytes += bytes;
+    }
+}
+
+// allocation_scope
+//
+// Counts the allocations made on the current thread while it is alive. Each
+// scope sees only the allocations made directly within it, not those of a
+// scope nested inside it. The counts live in the scope itself, on the stack
+// of the element or call being counted, and a fiber carries its innermost
+// scope with it when it suspends, so an element which resumes on another
+// thread goes on counting into the same scope.
+class allocation_scope
+{
+   public:
+    allocation_scope()
+        : outer_(std::exchange(this_thread_allocations().sink, &counts_))
+    {
+    }
+
+    allocation_scope(const allocation_scope&) = delete;
+    allocation_scope& operator=(const allocation_scope&) = delete;
+
+    ~allocation_scope()
+    {
+        this_thread_allocations().sink = outer_;
+    }
+
+    const allocation_counts& counts() const
+    {
+        return counts_;
+    }
+
+   private:
+    allocation_counts counts_;
+    allocation_counts* outer_;
+};
+
+// Stops counting on the current thread while it is alive, so that the
+// accounting's own records are not counted.
+class allocation_pause
+{
+   public:
+    allocation_pause()
+        : c_(this_thread_allocations()),
+          sink_(std::exchange(c_.sink, nullptr))
+    {
+    }
+
+    allocation_pause(const allocation_pause&) = delete;
+    allocation_pause& operator=(const allocation_pause&) = delete;
+
+    ~allocation_pause()
+    {
+        c_.sink = sink_;
+    }
+
+   private:
+    allocation_context& c_;
+    allocation_counts* sink_;
+};
+
+} // namespace detail
+
+// allocation_accounting
+//
+// Instrumentation policy which counts heap allocations for each call, split
+// between the library's own bookkeeping, such as the result and output
+// vectors and the executor's task state, and the element functions. Use it to
+// see how much of the cost of a call is allocator traffic, and whose.
+//
+// Counting requires the replacement `operator new` defined by
+// `LT_ASYNC_DEFINE_ALLOCATION_HOOKS`, which must appear at namespace scope in
+// exactly one source file of the program; `hooks_installed()` reports
+// whether it did. Only allocations made while a call is counting are
+// counted: the library's on the calling thread, and the element functions'
+// on whichever thread runs them. Executor work on worker threads between
+// elements is not attributed. Elements may run on fibers, including ones
+// which resume on another thread. A call made from inside an element of
+// another call on the same instance is folded into the outer call, which
+// counts its bookkeeping as the element's; otherwise per-call figures assume
+// one call at a time on the same `basic_async`.
+//
+// LT_ASYNC_DEFINE_ALLOCATION_HOOKS;  // in one .cpp file
+//
+// auto tasks = basic_async<input_type, output_type, std::string, executor,
+//                          in_order, run_to_completion, allocation_accounting>(pool);
+// auto output = tasks.map_concurrently(f, input);
+// auto s = tasks.instrumentation().last_batch();  // s.library vs s.user
+class allocation_accounting
+{
+    struct running_total
+    {
+        std::size_t elements = 0;
+        allocation_counts user;
+    };
+
+   public:
+    static bool hooks_installed()
+    {
+        return detail::allocation_hooks_installed.load(std::memory_order_relaxed);
+    }
+
+    // State of one call, on the calling thread's stack. Only the outermost
+    // call on this instance counts the library's allocations and is recorded.
+    class batch_state
+    {
+       public:
+        explicit batch_state(allocation_accounting& a)
+            : a_(a),
+              outermost_(a.active_.fetch_add(1, std::memory_order_acq_rel) == 0)
+        {
+            if (outermost_) {
+                start_ = a.current();
+                library_.emplace();
+            }
+        }
+
+        batch_state(const batch_state&) = delete;
+        batch_state& operator=(const batch_state&) = delete;
+
+        ~batch_state()
+        {
+            library_.reset();
+            a_.active_.fetch_sub(1, std::memory_order_acq_rel);
+        }
+
+       private:
+        friend class allocation_accounting;
+
+        allocation_accounting& a_;
+        bool outermost_;
+        running_total start_;
+        std::optional<detail::allocation_scope> library_;
+    };
+
+    batch_state on_batch_start()
+    {
+        return batch_state(*this);
+    }
+
+    void on_batch_finish(batch_state& b)
+    {
+        if (!b.outermost_) {
+            return;
+        }
+
+        auto now = current();
+        auto stats = allocation_stats{
+            .elements = now.elements - b.start_.elements,
+            .library = b.library_->counts(),
+            .user = now.user - b.start_.user,
+        };
+
+        auto pause = detail::allocation_pause();
+        std::lock_guard<std::mutex> lock(mutex_);
+        batches_.push_back(stats);
+    }
+
+    detail::allocation_scope on_start(std::size_t)
+    {
+        return detail::allocation_scope();
+    }
+
+    void on_finish(std::size_t index, bool, std::chrono::nanoseconds, const detail::allocation_scope& scope)
+    {
+        auto user = scope.counts();
+
+        auto pause = detail::allocation_pause();
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++user_.elements;
+        user_.user += user;
+        elements_.push_back(element_allocations{index, user});
+    }
+
+    // Discard the calls and elements recorded so far.
+    void reset()
+    {
+        auto pause = detail::allocation_pause();
+        std::lock_guard<std::mutex> lock(mutex_);
+        batches_.clear();
+        elements_.clear();
+    }
+
+    std::vector<allocation_stats> batches() const
+    {
+        auto pause = detail::allocation_pause();
+        std::lock_guard<std::mutex> lock(mutex_);
+        return batches_;
+    }
+
+    // The most recent call, or zeros if there has been none.
+    allocation_stats last_batch() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return batches_.empty() ? allocation_stats{} : batches_.back();
+    }
+
+    // Sum over the calls recorded since `reset()`.
+    allocation_stats total() const
+    {
+        auto sum = allocation_stats{};
+        for (auto && b : batches()) {
+            sum.elements += b.elements;
+            sum.library += b.library;
+            sum.user += b.user;
+        }
+        return sum;
+    }
+
+    std::vector<element_allocations> elements() const
+    {
+        auto pause = detail::allocation_pause();
+        std::lock_guard<std::mutex> lock(mutex_);
+        return elements_;
+    }
+
+   private:
+
+    running_total current() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return user_;
+    }
+
+    mutable std::mutex mutex_;
+    std::atomic<std::size_t> active_{0};
+    running_total user_;
+    std::vector<allocation_stats> batches_;
+    std::vector<element_allocations> elements_;
+};
+
+} // namespace lt::async
+
+// LT_ASYNC_DEFINE_ALLOCATION_HOOKS
+//
+// Defines the replaceable global `operator new` and `operator delete`
+// functions, allocating with malloc and counting each allocation for
+// `allocation_accounting`. Use it at namespace scope in exactly one source
+// file, followed by a semicolon, and not in a program which already
+// replaces them.
+#define LT_ASYNC_DEFINE_ALLOCATION_HOOKS                                                                            \
+    static void* lt_async_counted_alloc(std::size_t n)                                                              \
+    {                                                                                                               \
+        ::lt::async::detail::count_allocation(n);                                                                   \
+        return std::malloc(n ? n : 1);                                                                              \
+    }                                                                                                               \
+    static void* lt_async_counted_alloc(std::size_t n, std::align_val_t a)                                          \
+    {                                                                                                               \
+        ::lt::async::detail::count_allocation(n);                                                                   \
+        void* p = nullptr;                                                                                          \
+        auto align = std::max(static_cast<std::size_t>(a), sizeof(void*));                                          \
+        return posix_memalign(&p, align, n ? n : 1) == 0 ? p : nullptr;                                             \
+    }                                                                                                               \
+    [[gnu::noinline]] static void lt_async_counted_free(void* p) noexcept                                           \
+    {                                                                                                               \
+        std::free(p);                                                                                               \
+    }                                                                                                               \
+    void* operator new(std::size_t n)                                                                               \
+    {                                                                                                               \
+        if (auto p = lt_async_counted_alloc(n)) {                                                                   \
+            return p;                                                                                               \
+        }                                                                                                           \
+        throw std::bad_alloc();                                                                                     \
+    }                                                                                                               \
+    void* operator new[](std::size_t n)                                                                             \
+    {                                                                                                               \
+        return operator new(n);                                                                                     \
+    }                                                                                                               \
+    void* operator new(std::size_t n, std::align_val_t a)                                                           \
+    {                                                                                                               \
+        if (auto p = lt_async_counted_alloc(n, a)) {                                                                \
+            return p;                                                                                               \
+        }                                                                                                           \
+        throw std::bad_alloc();                                                                                     \
+    }                                                                                                               \
+    void* operator new[](std::size_t n, std::align_val_t a)                                                         \
+    {                                                                                                               \
+        return operator new(n, a);                                                                                  \
+    }                                                                                                               \
+    void* operator new(std::size_t n, const std::nothrow_t&) noexcept                                               \
+    {                                                                                                               \
+        return lt_async_counted_alloc(n);                                                                           \
+    }                                                                                                               \
+    void* operator new[](std::size_t n, const std::nothrow_t&) noexcept                                             \
+    {                                                                                                               \
+        return lt_async_counted_alloc(n);                                                                           \
+    }                                                                                                               \
+    void* operator new(std::size_t n, std::align_val_t a, const std::nothrow_t&) noexcept                           \
+    {                                                                                                               \
+        return lt_async_counted_alloc(n, a);                                                                        \
+    }                                                                                                               \
+    void* operator new[](std::size_t n, std::align_val_t a, const std::nothrow_t&) noexcept                         \
+    {                                                                                                               \
+        return lt_async_counted_alloc(n, a);                                                                        \
+    }                                                                                                               \
+    void operator delete(void* p) noexcept { lt_async_counted_free(p); }                                            \
+    void operator delete[](void* p) noexcept { lt_async_counted_free(p); }                                          \
+    void operator delete(void* p, std::size_t) noexcept { lt_async_counted_free(p); }                               \
+    void operator delete[](void* p, std::size_t) noexcept { lt_async_counted_free(p); }                             \
+    void operator delete(void* p, std::align_val_t) noexcept { lt_async_counted_free(p); }                          \
+    void operator delete[](void* p, std::align_val_t) noexcept { lt_async_counted_free(p); }                        \
+    void operator delete(void* p, std::size_t, std::align_val_t) noexcept { lt_async_counted_free(p); }             \
+    void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { lt_async_counted_free(p); }           \
+    void operator delete(void* p, const std::nothrow_t&) noexcept { lt_async_counted_free(p); }                     \
+    void operator delete[](void* p, const std::nothrow_t&) noexcept { lt_async_counted_free(p); }                   \
+    void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { lt_async_counted_free(p); }   \
+    void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { lt_async_counted_free(p); } \
+    static const bool lt_async_allocation_hooks = (::lt::async::detail::allocation_hooks_installed = true)
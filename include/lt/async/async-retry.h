@@ -1,16 +1,137 @@
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
 #include "lt/async/async.h"
 #include "lt/retry/retry.h"
 
 namespace lt::async
 {
 
-// async_retry
+namespace detail
+{
+
+// micro_batcher
+//
+// Collects single-element calls made concurrently from several threads into
+// batches for a batch function. A batch is sent once it holds
+// `max_batch_size` inputs, or once its oldest input has waited `max_linger`.
+// There is no batching thread: whichever caller fills the batch, or first
+// notices that it has lingered long enough, sends it and hands the results
+// back to the other callers.
+//
+// Callers wait on a `std::condition_variable`, which blocks a thread pool
+// worker or a fiber's carrier thread. Under `LT_ASYNC_DEFINE_FIBER_WAITS`
+// the waits park the calling fiber instead, so fibers on one carrier can join
+// the same batch.
+template <typename input_type, typename output_type, typename error_type>
+class micro_batcher
+{
+   public:
+    micro_batcher(const batch_function_t<input_type, output_type, error_type>& f_batch, const batch_options& options)
+        : f_batch_(f_batch),
+          max_batch_size_(std::max<std::size_t>(1, options.max_batch_size)),
+          max_linger_(options.max_linger)
+    {
+    }
+
+    attempt_result_t<output_type, error_type> call(const input_type& input)
+    {
+        auto s = slot{&input, std::nullopt, nullptr};
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (pending_.empty()) {
+            oldest_ = std::chrono::steady_clock::now();
+        }
+        pending_.push_back(&s);
+
+        for (;;) {
+            if (s.error) {
+                std::rethrow_exception(s.error);
+            }
+            if (s.result) {
+                return std::move(*s.result);
+            }
+
+            if (pending_.empty()) {
+                cv_.wait(lock);
+            } else if (pending_.size() >= max_batch_size_
+                       || std::chrono::steady_clock::now() >= oldest_ + max_linger_) {
+                send(lock);
+            } else {
+                cv_.wait_until(lock, oldest_ + max_linger_);
+            }
+        }
+    }
+
+   private:
+    struct slot
+    {
+        const input_type* input;
+        std::optional<attempt_result_t<output_type, error_type>> result;
+        std::exception_ptr error;
+    };
+
+    // Send the pending batch. Called with `lock` held; releases it while the
+    // batch function runs.
+    void send(std::unique_lock<std::mutex>& lock)
+    {
+        auto batch = std::vector<slot*>();
+        batch.swap(pending_);
+        lock.unlock();
+
+        auto inputs = std::vector<input_type>();
+        inputs.reserve(batch.size());
+        for (auto && s : batch) {
+            inputs.push_back(*s->input);
+        }
+
+        auto results = std::vector<attempt_result_t<output_type, error_type>>();
+        auto error = std::exception_ptr();
+        try {
+            results = f_batch_(std::span<const input_type>(inputs));
+            if (results.size() != batch.size()) {
+                throw std::length_error("lt::async: batch function returned the wrong number of results");
+            }
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        lock.lock();
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            if (error) {
+                batch[i]->error = error;
+            } else {
+                batch[i]->result.emplace(std::move(results[i]));
+            }
+        }
+        cv_.notify_all();
+    }
+
+    const batch_function_t<input_type, output_type, error_type>& f_batch_;
+    const std::size_t max_batch_size_;
+    const std::chrono::microseconds max_linger_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<slot*> pending_;
+    std::chrono::steady_clock::time_point oldest_;
+};
+
+} // namespace detail
+
+// basic_async_retry
 //
 // Works with lt::retry to run an action concurrently on each element of
-// a vector of inputs, where each action is retried independently in its own
-// thread. Each thread maintains its own lt::retry::RetryStatus, and all actions
+// a vector of inputs, where each action is retried independently on the executor.
+// Each element maintains its own lt::retry::RetryStatus, and all actions
 // are retried according to the same lt::retry::RetryPolicy.
 //
 // The entire operation returns a vector of the outputs in order. If any action
@@ -18,6 +139,8 @@ namespace lt::async
 // the action encountered a non-recoverable error condition, such that there is
 // no point retrying.
 //
+// The policy parameters are as for `basic_async`.
+//
 // using std::chrono;
 // using lt::retry;
 // auto retry_policy = constantDelay(100ms) + limitRetries(10);
@@ -49,49 +172,188 @@ namespace lt::async
 //     // There was an error, which is stored in output.error().
 //     ... handle_error(output.error());
 // }
-template <typename input_type, typename output_type, typename error_type=std::string>
-class async_retry : public async<input_type, output_type, error_type>
+template <typename input_type, typename output_type, typename error_type=std::string,
+          typename executor_type=executor, typename ordering=in_order,
+          typename error_mode=run_to_completion, typename instrumentation_type=no_instrumentation>
+class basic_async_retry
+    : public basic_async<input_type, output_type, error_type, executor_type, ordering, error_mode, instrumentation_type>
 {
+    using base_type =
+        basic_async<input_type, output_type, error_type, executor_type, ordering, error_mode, instrumentation_type>;
+
    public:
-    async_retry(const lt::retry::RetryPolicy& retry_policy)
+    basic_async_retry(const lt::retry::RetryPolicy& retry_policy)
+        requires std::is_convertible_v<thread_pool*, executor_type*>
         : retry_policy_(retry_policy)
     {
     }
 
+    basic_async_retry(const lt::retry::RetryPolicy& retry_policy, executor_type& e)
+        : base_type(e),
+          retry_policy_(retry_policy)
+    {
+    }
+
     aggregate_result_t<output_type, error_type> map_concurrently_retry(
         std::function<bool(lt::retry::RetryStatus, const output_type&)> should_retry,
         std::function<attempt_result_t<output_type, error_type>(const input_type&)> f,
         const std::vector<input_type>& input)
     {
         auto inner_should_retry =
-            [&should_retry](lt::retry::RetryStatus retry_status, attempt_result_t<output_type, error_type> result) -> bool {
+            [&should_retry](lt::retry::RetryStatus retry_status,
+                            attempt_result_t<output_type, error_type> result) -> bool {
                 auto g = [&](output_type o) -> bool {
                     return should_retry(retry_status, o);
                 };
-                return result.map(g).value_or(false);
+                auto retry = result.map(g).value_or(false);
+                detail::trace_retry_decision(retry_status.iter_number, retry);
+                return retry;
             };
 
         auto retry_f =
             [&inner_should_retry, &f, this](const input_type& i) -> attempt_result_t<output_type, error_type> {
-                auto inner_action = [&i, &f](lt::retry::RetryStatus _) -> attempt_result_t<output_type, error_type> {
-                    return f(i);
+                auto first_attempt = true;
+                auto trace = detail::attempt_trace();
+                auto inner_action = [&](lt::retry::RetryStatus) -> attempt_result_t<output_type, error_type> {
+                    if (!std::exchange(first_attempt, false)) {
+                        this->acquire_retry_permit();
+                    }
+                    auto g = [&] { return f(i); };
+                    return trace(g);
                 };
 
                 return retry_policy_.retry<attempt_result_t<output_type, error_type>>(inner_should_retry, inner_action);
             };
 
-        return async<input_type, output_type, error_type>::map_concurrently(retry_f, input);
+        return base_type::map_concurrently(retry_f, input);
+    }
+
+    // Micro-batched evaluation with retries. First attempts are sent in full
+    // batches of at most `options.max_batch_size` elements, as by
+    // `map_batched()`. Each element is then retried independently according
+    // to the retry policy, and retry attempts are batched together with the
+    // attempts of other retrying elements which come due within
+    // `options.max_linger`.
+    //
+    // Retrying elements wait on the executor, both for the retry policy's delay
+    // and for their retry batch to fill. On a `thread_pool` each waiting
+    // element holds a worker thread, so retry batches hold at most as many
+    // elements as the pool has threads, and other work queues behind the
+    // delays. On a `fiber_pool` in a program which defines
+    // `LT_ASYNC_DEFINE_FIBER_WAITS`, both waits park only the element's fiber,
+    // so retry batches fill up to `options.max_batch_size` whatever the
+    // number of carriers. With a rate limiter set, each first-attempt batch
+    // and each retry attempt takes one permit.
+    aggregate_result_t<output_type, error_type> map_batched_retry(
+        std::function<bool(lt::retry::RetryStatus, const output_type&)> should_retry,
+        batch_function_t<input_type, output_type, error_type> f_batch,
+        const std::vector<input_type>& input,
+        const batch_options& options = {})
+    {
+        auto batch = this->observe_batch();
+        auto first =
+            std::vector<std::optional<attempt_result_t<output_type, error_type>>>(input.size());
+        this->run_batches(f_batch, input, options, first);
+
+        auto inner_should_retry =
+            [&should_retry](lt::retry::RetryStatus retry_status,
+                            attempt_result_t<output_type, error_type> result) -> bool {
+                auto g = [&](output_type o) -> bool {
+                    return should_retry(retry_status, o);
+                };
+                auto retry = result.map(g).value_or(false);
+                detail::trace_retry_decision(retry_status.iter_number, retry);
+                return retry;
+            };
+
+        auto batcher = detail::micro_batcher<input_type, output_type, error_type>(f_batch, options);
+        auto results =
+            std::vector<std::optional<attempt_result_t<output_type, error_type>>>(input.size());
+
+        auto retry_element = [&](std::size_t i) {
+            auto trace = detail::attempt_trace();
+            auto inner_action = [&](lt::retry::RetryStatus) -> attempt_result_t<output_type, error_type> {
+                auto g = [&]() -> attempt_result_t<output_type, error_type> {
+                    if (first[i]) {
+                        return *std::exchange(first[i], std::nullopt);
+                    }
+                    this->acquire_retry_permit();
+                    return batcher.call(input[i]);
+                };
+                return trace(g);
+            };
+
+            results[i].emplace(
+                retry_policy_.retry<attempt_result_t<output_type, error_type>>(inner_should_retry, inner_action));
+        };
+
+        detail::traced_batch(input.size(), retry_element, [&](const std::function<void(std::size_t)>& g) {
+            this->get_executor().bulk(input.size(), g);
+        });
+
+        return this->collect(results);
+    }
+
+    // Race the elements against each other as by `first_success()`, with each
+    // element retried independently according to the retry policy. The call
+    // returns as soon as one element succeeds. The others stop retrying after
+    // their current attempt, finishing in the background on copies of
+    // `should_retry`, `f` and `input`; a retry delay already under way is not
+    // interrupted.
+    race_result_t<output_type, error_type> first_success_retry(
+        std::function<bool(lt::retry::RetryStatus, const output_type&)> should_retry,
+        std::function<attempt_result_t<output_type, error_type>(const input_type&, std::stop_token)> f,
+        const std::vector<input_type>& input)
+    {
+        auto batch = this->observe_batch();
+        auto retry_f =
+            [should_retry = std::move(should_retry), f = std::move(f), input, policy = retry_policy_,
+             limiter = this->rate_limiter()](
+                std::size_t i, std::stop_token stop) mutable -> attempt_result_t<output_type, error_type> {
+                auto inner_should_retry =
+                    [&](lt::retry::RetryStatus retry_status, attempt_result_t<output_type, error_type> result) -> bool {
+                        if (stop.stop_requested()) {
+                            return false;
+                        }
+                        auto g = [&](output_type o) -> bool {
+                            return should_retry(retry_status, o);
+                        };
+                        auto retry = result.map(g).value_or(false);
+                        detail::trace_retry_decision(retry_status.iter_number, retry);
+                        return retry;
+                    };
+
+                auto first_attempt = true;
+                auto trace = detail::attempt_trace();
+                auto inner_action = [&](lt::retry::RetryStatus) -> attempt_result_t<output_type, error_type> {
+                    if (!std::exchange(first_attempt, false) && limiter) {
+                        limiter->acquire();
+                    }
+                    auto g = [&] { return f(input[i], stop); };
+                    return trace(g);
+                };
+
+                return policy.retry<attempt_result_t<output_type, error_type>>(inner_should_retry, inner_action);
+            };
+
+        return this->race(input.size(), retry_f);
     }
 
    private:
     lt::retry::RetryPolicy retry_policy_;
 };
 
-// async_preemptible_retry
+// async_retry
+//
+// `basic_async_retry` with the default policies.
+template <typename input_type, typename output_type, typename error_type=std::string>
+using async_retry = basic_async_retry<input_type, output_type, error_type>;
+
+// basic_async_preemptible_retry
 //
 // Works with lt::retry to run an action concurrently on each element of
-// a vector of inputs, where each action is retried independently in its own
-// thread. Each thread maintains its own lt::retry::PreemptibleRetryStatus, and
+// a vector of inputs, where each action is retried independently on the executor.
+// Each element maintains its own lt::retry::PreemptibleRetryStatus, and
 // all actions are retried according to the same lt::retry::PreemptibleRetry.
 //
 // The entire operation returns a vector of the outputs in order. If any action
@@ -99,6 +361,8 @@ class async_retry : public async<input_type, output_type, error_type>
 // the action encountered a non-recoverable error condition, such that there is
 // no point retrying.
 //
+// The policy parameters are as for `basic_async`.
+//
 // using std::chrono;
 // using lt::retry;
 // auto retry_policy_before = constantDelay(100ms) + limitRetries(100);
@@ -149,20 +413,42 @@ class async_retry : public async<input_type, output_type, error_type>
 //     ... handle_error(output.error());
 // }
 //
-template <typename input_type, typename output_type, typename error_type=std::string>
-class async_preemptible_retry : public async<input_type, output_type, error_type>
+template <typename input_type, typename output_type, typename error_type=std::string,
+          typename executor_type=executor, typename ordering=in_order,
+          typename error_mode=run_to_completion, typename instrumentation_type=no_instrumentation>
+class basic_async_preemptible_retry
+    : public basic_async<input_type, output_type, error_type, executor_type, ordering, error_mode, instrumentation_type>
 {
+    using base_type =
+        basic_async<input_type, output_type, error_type, executor_type, ordering, error_mode, instrumentation_type>;
+
    public:
-    explicit async_preemptible_retry(const lt::retry::RetryPolicy& policy_before, const lt::retry::RetryPolicy& policy_after)
+    explicit basic_async_preemptible_retry(const lt::retry::RetryPolicy& policy_before,
+                                           const lt::retry::RetryPolicy& policy_after)
+        requires std::is_convertible_v<thread_pool*, executor_type*>
         : policy_(policy_before, policy_after)
     {
     }
 
-    explicit async_preemptible_retry(const lt::retry::PreemptibleRetry& policy)
+    explicit basic_async_preemptible_retry(const lt::retry::PreemptibleRetry& policy)
+        requires std::is_convertible_v<thread_pool*, executor_type*>
         : policy_(policy)
     {
     }
 
+    basic_async_preemptible_retry(const lt::retry::RetryPolicy& policy_before,
+                                  const lt::retry::RetryPolicy& policy_after, executor_type& e)
+        : base_type(e),
+          policy_(policy_before, policy_after)
+    {
+    }
+
+    basic_async_preemptible_retry(const lt::retry::PreemptibleRetry& policy, executor_type& e)
+        : base_type(e),
+          policy_(policy)
+    {
+    }
+
     aggregate_result_t<output_type, error_type> map_concurrently_preemptible_retry(
         std::condition_variable& cv,
         std::mutex& cv_mutex,
@@ -172,28 +458,53 @@ class async_preemptible_retry : public async<input_type, output_type, error_type
         const std::vector<input_type>& input)
     {
         auto inner_should_retry =
-            [&should_retry](lt::retry::PreemptibleRetryStatus retry_status, attempt_result_t<output_type, error_type> result) -> bool {
+            [&should_retry](lt::retry::PreemptibleRetryStatus retry_status,
+                            attempt_result_t<output_type, error_type> result) -> bool {
                 auto g = [&](output_type o) -> bool {
                     return should_retry(retry_status, o);
                 };
-                return result.map(g).value_or(false);
+                auto retry = result.map(g).value_or(false);
+                detail::trace_retry_decision(retry_status.iter_number, retry);
+                return retry;
             };
 
+        // Record each time a waiting element is woken by the condition.
+        auto traced_cond = [&cond]() -> bool {
+            auto r = cond();
+            if (r) {
+                detail::trace_preempted();
+            }
+            return r;
+        };
+
         auto retry_f =
             [&](const input_type& i) -> attempt_result_t<output_type, error_type> {
-                auto inner_action = [&i, &f](lt::retry::PreemptibleRetryStatus _) -> attempt_result_t<output_type, error_type> {
-                    return f(i);
-                };
+                auto first_attempt = true;
+                auto trace = detail::attempt_trace();
+                auto inner_action =
+                    [&](lt::retry::PreemptibleRetryStatus) -> attempt_result_t<output_type, error_type> {
+                        if (!std::exchange(first_attempt, false)) {
+                            this->acquire_retry_permit();
+                        }
+                        auto g = [&] { return f(i); };
+                        return trace(g);
+                    };
 
                 return policy_.retry<attempt_result_t<output_type, error_type>>(
-                    cv, cv_mutex, cond, inner_should_retry, inner_action);
+                    cv, cv_mutex, traced_cond, inner_should_retry, inner_action);
             };
 
-        return async<input_type, output_type, error_type>::map_concurrently(retry_f, input);
+        return base_type::map_concurrently(retry_f, input);
     }
 
    private:
     lt::retry::PreemptibleRetry policy_;
 };
 
+// async_preemptible_retry
+//
+// `basic_async_preemptible_retry` with the default policies.
+template <typename input_type, typename output_type, typename error_type=std::string>
+using async_preemptible_retry = basic_async_preemptible_retry<input_type, output_type, error_type>;
+
 } // namespace lt::retry
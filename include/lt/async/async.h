@@ -1,10 +1,36 @@
 #pragma once
 
-#include <future>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <concepts>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <stop_token>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
 #include <vector>
 
 #include "tl/expected.hpp"
 
+#include "lt/async/executor.h"
+#include "lt/async/memory-budget.h"
+#include "lt/async/policy.h"
+#include "lt/async/rate-limit.h"
+#include "lt/async/soa.h"
+#include "lt/async/trace.h"
+
 namespace lt::async
 {
 
@@ -20,6 +46,63 @@ using attempt_result_t = tl::expected<output_type, error_type>;
 template <typename output_type, typename error_type=std::string>
 using aggregate_result_t = tl::expected<std::vector<output_type>, error_type>;
 
+// race_result_t
+//
+// Result of racing attempts on a vector of inputs: the first successful
+// output, or the errors of all attempts in input order
+template <typename output_type, typename error_type=std::string>
+using race_result_t = tl::expected<output_type, std::vector<error_type>>;
+
+// quorum_result_t
+//
+// Result of a quorum over a vector of inputs: the index and output of each
+// element which succeeded, in order of completion, or the index and error of
+// each element which failed, in input order
+template <typename output_type, typename error_type=std::string>
+using quorum_result_t = tl::expected<std::vector<std::pair<std::size_t, output_type>>,
+                                     std::vector<std::pair<std::size_t, error_type>>>;
+
+// remainder_policy
+//
+// What happens to the elements still running once a race or quorum has been
+// decided. With `cancel`, a stop is requested on their `std::stop_token`.
+// With `detach`, they run to completion without a stop request and their
+// results are discarded. In both cases the call returns as soon as it is
+// decided and elements which have not started are skipped. The elements
+// still running finish in the background on state they share with the call;
+// the `basic_async` object waits for them when it is destroyed.
+enum class remainder_policy
+{
+    cancel,
+    detach,
+};
+
+// soa_result_t
+//
+// Result of attempt on a vector of inputs, returned as a struct of arrays: one
+// vector per field of `output_type`
+template <typename output_type, typename error_type=std::string>
+using soa_result_t = tl::expected<soa_columns_t<output_type>, error_type>;
+
+// batch_function_t
+//
+// A batch-capable action: given a contiguous batch of inputs, returns one
+// result per input, in the same order.
+template <typename input_type, typename output_type, typename error_type=std::string>
+using batch_function_t =
+    std::function<std::vector<attempt_result_t<output_type, error_type>>(std::span<const input_type>)>;
+
+// batch_options
+//
+// Limits for micro-batching: at most `max_batch_size` inputs are passed to one
+// call of a batch function, and an input waiting for others to join its batch
+// waits at most `max_linger` before the batch is sent anyway.
+struct batch_options
+{
+    std::size_t max_batch_size = 256;
+    std::chrono::microseconds max_linger = std::chrono::milliseconds(1);
+};
+
 // async_base
 //
 // Base class for async operations. Contains a non-asynchronous method `seq()`
@@ -74,15 +157,149 @@ class async_base
     }
 };
 
-// async
+namespace detail
+{
+
+// True if elements can take the `map_concurrently()` fast path, which writes
+// outputs straight into the result vector.
+template <typename input_type, typename output_type>
+inline constexpr bool is_trivial_element_v =
+    std::is_trivially_copyable_v<input_type> && std::is_trivially_copyable_v<output_type>
+    && std::is_default_constructible_v<output_type>;
+
+// error_bitmap
+//
+// One bit per element, set if the element failed. Bits may be set
+// concurrently.
+class error_bitmap
+{
+   public:
+    explicit error_bitmap(std::size_t n)
+        : words_((n + 63) / 64)
+    {
+    }
+
+    void set(std::size_t i)
+    {
+        words_[i / 64].fetch_or(std::uint64_t(1) << (i % 64), std::memory_order_relaxed);
+        any_.store(true, std::memory_order_relaxed);
+    }
+
+    bool test(std::size_t i) const
+    {
+        return (words_[i / 64].load(std::memory_order_relaxed) >> (i % 64)) & 1;
+    }
+
+    bool any() const
+    {
+        return any_.load(std::memory_order_relaxed);
+    }
+
+    // Index of the first set bit, or the number of bits if none is set.
+    std::size_t first() const
+    {
+        for (std::size_t w = 0; w < words_.size(); ++w) {
+            if (auto bits = words_[w].load(std::memory_order_relaxed)) {
+                return w * 64 + static_cast<std::size_t>(std::countr_zero(bits));
+            }
+        }
+        return words_.size() * 64;
+    }
+
+   private:
+    std::vector<std::atomic<std::uint64_t>> words_;
+    std::atomic<bool> any_{false};
+};
+
+// detached_count
+//
+// Number of elements still running on behalf of an object after the call
+// which started them has returned. The destructor waits for them. A copy
+// starts with none.
+class detached_count
+{
+   public:
+    // Counts one element while it lives.
+    class scope
+    {
+       public:
+        explicit scope(detached_count& c)
+            : c_(c)
+        {
+            std::lock_guard<std::mutex> lock(c_.mutex_);
+            ++c_.count_;
+        }
+
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+
+        ~scope()
+        {
+            std::lock_guard<std::mutex> lock(c_.mutex_);
+            if (--c_.count_ == 0) {
+                c_.cv_.notify_all();
+            }
+        }
+
+       private:
+        detached_count& c_;
+    };
+
+    detached_count() = default;
+
+    detached_count(const detached_count&)
+    {
+    }
+
+    detached_count& operator=(const detached_count&)
+    {
+        return *this;
+    }
+
+    ~detached_count()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return count_ == 0; });
+    }
+
+   private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::size_t count_ = 0;
+};
+
+template <typename T, typename error_type>
+inline constexpr bool is_attempt_result_v = false;
+
+template <typename T, typename error_type>
+inline constexpr bool is_attempt_result_v<tl::expected<T, error_type>, error_type> = true;
+
+} // namespace detail
+
+// basic_async
 //
-// Concurrent, parallel evaluation of async operations. Uses `std::async` with a
-// launch policy of `std::launch::async` to ensure concurrent threads are used.
+// Concurrent, parallel evaluation of async operations. Elements are run on an
+// `executor`, by default the process-wide thread pool returned by
+// `default_executor()`, with the calling thread taking part.
 //
 // Run an action concurrently on each element of a vector of inputs, returning a
 // vector of the outputs in order. If any action failed then the whole operation
 // failed.
 //
+// The remaining template parameters are compile-time policies (see policy.h):
+//
+//   executor_type         the executor elements run on. Naming a concrete
+//                         executor such as `thread_pool` or `fiber_pool`
+//                         rather than the abstract `executor` lets its calls
+//                         be resolved statically.
+//   ordering              `in_order` or `completion_order`, for the order of
+//                         the outputs returned by `map_concurrently()`.
+//   error_mode            `run_to_completion` or `fail_fast`.
+//   instrumentation_type  observer of each element run by `map_concurrently()`,
+//                         or `no_instrumentation`.
+//
+// `async<input_type, output_type, error_type>` selects the defaults.
+//
 // auto input = std::vector<input_type>( ... );
 // auto tasks = async<input_type, output_type>();
 // auto f = [&](const input_type& i) {
@@ -103,37 +320,999 @@ class async_base
 //     // There was an error, which is stored in output.error().
 //     ... handle_error(output.error());
 // }
-template <typename input_type, typename output_type, typename error_type=std::string>
-class async : public async_base<input_type, output_type, error_type>
+template <typename input_type, typename output_type, typename error_type=std::string,
+          typename executor_type=executor, typename ordering=in_order,
+          typename error_mode=run_to_completion, typename instrumentation_type=no_instrumentation>
+class basic_async : public async_base<input_type, output_type, error_type>
 {
+    static_assert(std::is_base_of_v<executor, executor_type>, "executor_type must derive from lt::async::executor");
+    static_assert(is_ordering_policy_v<ordering>, "ordering must be in_order or completion_order");
+    static_assert(is_error_policy_v<error_mode>, "error_mode must be run_to_completion or fail_fast");
+
    public:
+    basic_async()
+        requires std::is_convertible_v<thread_pool*, executor_type*>
+        : executor_(&default_executor())
+    {
+    }
+
+    explicit basic_async(executor_type& e)
+        : executor_(&e)
+    {
+    }
+
+    template <typename F>
+        requires std::is_invocable_r_v<attempt_result_t<output_type, error_type>, F&, const input_type&>
     aggregate_result_t<output_type, error_type> map_concurrently(
-        std::function<attempt_result_t<output_type, error_type>(const input_type&)> f,
+        F&& f,
         const std::vector<input_type>& input)
     {
-        auto futures =
-            std::vector<std::future<attempt_result_t<output_type, error_type>>>();
+        auto batch = observe_batch();
 
-        for (auto && i : input) {
-            futures.push_back(std::async(std::launch::async, f, i));
+        if constexpr (detail::is_trivial_element_v<input_type, output_type>) {
+            return map_trivial(f, input);
+        } else {
+            constexpr auto no_failure = std::numeric_limits<std::size_t>::max();
+
+            auto results =
+                std::vector<std::optional<attempt_result_t<output_type, error_type>>>(input.size());
+            [[maybe_unused]] auto next_slot = std::atomic<std::size_t>(0);
+            [[maybe_unused]] auto failed_slot = std::atomic<std::size_t>(no_failure);
+
+            // Under completion_order the slots do not follow the inputs, so
+            // run_to_completion tracks the first failed input and its slot.
+            [[maybe_unused]] auto first_failure = std::pair<std::size_t, std::size_t>(no_failure, no_failure);
+            [[maybe_unused]] std::mutex first_failure_mutex;
+
+            dispatch(input.size(), [&](std::size_t i) {
+                if constexpr (std::is_same_v<error_mode, fail_fast>) {
+                    if (failed_slot.load(std::memory_order_relaxed) != no_failure) {
+                        return;
+                    }
+                }
+
+                auto r = run_element(i, f, input[i]);
+
+                auto slot = i;
+                if constexpr (std::is_same_v<ordering, completion_order>) {
+                    slot = next_slot.fetch_add(1, std::memory_order_relaxed);
+                }
+
+                [[maybe_unused]] auto ok = r.has_value();
+                results[slot].emplace(std::move(r));
+
+                if constexpr (std::is_same_v<error_mode, fail_fast>) {
+                    if (!ok) {
+                        auto expected = no_failure;
+                        failed_slot.compare_exchange_strong(expected, slot, std::memory_order_relaxed);
+                    }
+                } else if constexpr (std::is_same_v<ordering, completion_order>) {
+                    if (!ok) {
+                        std::lock_guard<std::mutex> lock(first_failure_mutex);
+                        if (i < first_failure.first) {
+                            first_failure = {i, slot};
+                        }
+                    }
+                }
+            });
+
+            if constexpr (std::is_same_v<error_mode, fail_fast>) {
+                if (auto slot = failed_slot.load(std::memory_order_relaxed); slot != no_failure) {
+                    return tl::unexpected(std::move(results[slot]->error()));
+                }
+            } else if constexpr (std::is_same_v<ordering, completion_order>) {
+                if (auto slot = first_failure.second; slot != no_failure) {
+                    return tl::unexpected(std::move(results[slot]->error()));
+                }
+            }
+
+            return collect(results);
+        }
+    }
+
+    // Struct-of-arrays evaluation, for outputs whose fields are processed one
+    // at a time downstream. Returns one contiguous vector per field of
+    // `output_type`, each written directly by the workers, so no transpose
+    // pass is needed. `output_type` must be tuple-like or have a
+    // `soa_members` specialisation (see soa.h), and its fields must be
+    // default constructible.
+    //
+    // auto columns = tasks.map_concurrently_soa(f, input);
+    // if (columns) {
+    //     auto& [t, x, y] = *columns;  // std::vector<double>, std::vector<float>, ...
+    //     ... process(x);
+    // }
+    template <typename F, typename soa_type = output_type>
+        requires soa_decomposable<soa_type>
+              && std::is_invocable_r_v<attempt_result_t<output_type, error_type>, F&, const input_type&>
+    soa_result_t<soa_type, error_type> map_concurrently_soa(
+        F&& f,
+        const std::vector<input_type>& input)
+    {
+        auto batch = observe_batch();
+
+        using columns_type = detail::soa_columns<soa_type>;
+
+        auto columns = columns_type::make(input.size());
+
+        auto error = run_into(f, input, [&](std::size_t slot, output_type&& o) {
+            columns_type::store(columns, slot, std::move(o));
+        });
+
+        if (error) {
+            return tl::unexpected(std::move(*error));
+        }
+        return columns;
+    }
+
+    instrumentation_type& instrumentation()
+    {
+        return instrumentation_;
+    }
+
+    // Fixed-size evaluation over a small number of inputs known at compile
+    // time, e.g. one request per shard. The elements run through the
+    // executor's `bulk()`, so the calling thread takes part, claiming elements
+    // alongside the workers, and nested calls make progress. All bookkeeping
+    // lives on the caller's stack and the action is not type-erased, so the
+    // only allocations are the executor's own for the batch: none on a
+    // `thread_pool` once it has served an earlier call, unless a rate limiter
+    // is set or tracing is enabled.
+    //
+    // auto shards = std::array<shard_id, 3>{a, b, c};
+    // auto output = tasks.map_concurrently(f, shards);  // std::array<output_type, 3>
+    template <typename F, std::size_t N>
+        requires std::is_invocable_r_v<attempt_result_t<output_type, error_type>, F&, const input_type&>
+    tl::expected<std::array<output_type, N>, error_type> map_concurrently(
+        F&& f,
+        const std::array<input_type, N>& input)
+    {
+        if constexpr (N == 0) {
+            return std::array<output_type, 0>();
+        } else {
+            struct state
+            {
+                basic_async* self;
+                std::remove_reference_t<F>* f;
+                const std::array<input_type, N>* input;
+                std::array<std::optional<attempt_result_t<output_type, error_type>>, N> results;
+                std::array<std::size_t, N> input_of;
+                std::atomic<std::size_t> next_slot{0};
+                std::atomic<bool> failed{false};
+
+                void run(std::size_t i)
+                {
+                    if constexpr (std::is_same_v<error_mode, fail_fast>) {
+                        if (failed.load(std::memory_order_relaxed)) {
+                            return;
+                        }
+                    }
+
+                    auto r = self->run_element(i, *f, (*input)[i]);
+
+                    auto slot = i;
+                    if constexpr (std::is_same_v<ordering, completion_order>) {
+                        slot = next_slot.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    if (!r) {
+                        failed.store(true, std::memory_order_relaxed);
+                    }
+                    input_of[slot] = i;
+                    results[slot].emplace(std::move(r));
+                }
+            };
+
+            auto batch = observe_batch();
+            state s;
+            s.self = this;
+            s.f = &f;
+            s.input = &input;
+
+            dispatch(N, [p = &s](std::size_t i) { p->run(i); });
+
+            // Under completion_order the slots do not follow the inputs, so
+            // run_to_completion looks for the slot of the first failed input.
+            auto failed_slot = N;
+            for (std::size_t slot = 0; slot < N; ++slot) {
+                auto& r = s.results[slot];
+                if (r && !*r && (failed_slot == N || s.input_of[slot] < s.input_of[failed_slot])) {
+                    failed_slot = slot;
+                    if constexpr (std::is_same_v<error_mode, fail_fast> || std::is_same_v<ordering, in_order>) {
+                        break;
+                    }
+                }
+            }
+            if (failed_slot != N) {
+                return tl::unexpected(std::move(s.results[failed_slot]->error()));
+            }
+            return [&]<std::size_t... I>(std::index_sequence<I...>) {
+                return std::array<output_type, N>{std::move(**s.results[I])...};
+            }(std::make_index_sequence<N>());
+        }
+    }
+
+    // Heterogeneous evaluation: run several different actions concurrently,
+    // e.g. fetching a user, a config and a quota, and return their outputs as
+    // a tuple. Each action takes no arguments and returns
+    // `tl::expected<T, error_type>` for its own `T`. If any action failed then
+    // the whole operation failed.
+    //
+    // As with the `std::array` overload of `map_concurrently()`, the actions
+    // run through the executor's `bulk()` with the calling thread taking part,
+    // the bookkeeping lives on the stack, and the actions are called directly
+    // rather than through a `std::function`. The error and
+    // instrumentation policies apply, with each action reported as the element
+    // at its argument position.
+    //
+    // auto r = tasks.concurrently(
+    //     [&] { return fetch_user(id); },
+    //     [&] { return fetch_config(id); },
+    //     [&] { return fetch_quota(id); });
+    // if (r) {
+    //     auto& [user, config, quota] = *r;
+    //     ...
+    // }
+    template <typename... Fs>
+        requires(sizeof...(Fs) > 0) && (detail::is_attempt_result_v<std::invoke_result_t<Fs&>, error_type> && ...)
+    tl::expected<std::tuple<typename std::invoke_result_t<Fs&>::value_type...>, error_type> concurrently(Fs&&... fs)
+    {
+        constexpr auto count = sizeof...(Fs);
+        constexpr auto no_failure = count;
+
+        auto batch = observe_batch();
+        auto s = concurrently_state<Fs...>(this, fs...);
+
+        dispatch(count, [p = &s](std::size_t i) { p->run(i); });
+
+        // The first failure in argument order, or with `fail_fast` the first
+        // observed.
+        auto failed = s.failed.load(std::memory_order_relaxed);
+        if (failed != no_failure) {
+            auto error = std::optional<error_type>();
+            [&]<std::size_t... I>(std::index_sequence<I...>) {
+                auto check = [&](auto& r, std::size_t i) {
+                    if (!error && r && !*r && (!std::is_same_v<error_mode, fail_fast> || i == failed)) {
+                        error.emplace(std::move(r->error()));
+                    }
+                };
+                (check(std::get<I>(s.results), I), ...);
+            }(std::make_index_sequence<count>());
+            return tl::unexpected(std::move(*error));
         }
 
-        // Collect all the results
-        auto results = std::vector<attempt_result_t<output_type, error_type>>();
-        for (auto && f : futures) {
-            results.push_back(f.get());
+        return [&]<std::size_t... I>(std::index_sequence<I...>) {
+            return std::tuple<typename std::invoke_result_t<Fs&>::value_type...>(
+                std::move(*std::get<I>(s.results).value())...);
+        }(std::make_index_sequence<count>());
+    }
+
+    // Micro-batched evaluation: the input is split into batches of at most
+    // `options.max_batch_size` elements, each batch is passed to one call of
+    // `f_batch`, and the batches run concurrently. The results are scattered
+    // back to the positions of their inputs.
+    //
+    // auto f_batch = [&](std::span<const key_type> keys) {
+    //     auto values = backend.multi_get(keys);
+    //     auto results = std::vector<attempt_result_t<value_type>>();
+    //     ...
+    //     return results;
+    // };
+    // auto output = tasks.map_batched(f_batch, input, {.max_batch_size = 256});
+    aggregate_result_t<output_type, error_type> map_batched(
+        batch_function_t<input_type, output_type, error_type> f_batch,
+        const std::vector<input_type>& input,
+        const batch_options& options = {})
+    {
+        auto batch = observe_batch();
+        auto results =
+            std::vector<std::optional<attempt_result_t<output_type, error_type>>>(input.size());
+
+        run_batches(f_batch, input, options, results);
+
+        return collect(results);
+    }
+
+    // Race the elements against each other, e.g. the same query sent to N
+    // replicas, returning the first successful output. If no element succeeds,
+    // the errors of all elements are returned in input order.
+    //
+    // The call returns as soon as one element succeeds. A stop is requested on
+    // the `std::stop_token` passed to the others, and elements which have not
+    // started are skipped, taking no rate limiter permit. The elements still
+    // running finish in the background on copies of `f` and `input`, so
+    // anything `f` refers to must outlive them: the `basic_async` object waits
+    // for them when it is destroyed.
+    //
+    // If no element succeeds and any element threw, the first exception is
+    // rethrown.
+    //
+    // auto f = [&](const replica& r, std::stop_token stop) -> attempt_result_t<row> {
+    //     return r.query(key, stop);
+    // };
+    // auto output = tasks.first_success(f, replicas);
+    race_result_t<output_type, error_type> first_success(
+        std::function<attempt_result_t<output_type, error_type>(const input_type&, std::stop_token)> f,
+        const std::vector<input_type>& input)
+    {
+        auto batch = observe_batch();
+        return race(input.size(), [f = std::move(f), input](std::size_t i, std::stop_token stop) {
+            return f(input[i], stop);
+        });
+    }
+
+    // Quorum evaluation, e.g. a write to n replicas which is durable once `k`
+    // have acknowledged it. Returns as soon as `k` elements have succeeded,
+    // with their indices and outputs in order of completion, or as soon as
+    // more than `n - k` have failed, with the index and error of each failure
+    // so far. Elements still running are then cancelled or detached according
+    // to `remainder`, and elements which have not started are skipped without
+    // taking a rate limiter permit.
+    //
+    // So that the running elements can finish after the call has returned,
+    // `f` and `input` are copied. Anything `f` refers to must outlive them:
+    // the `basic_async` object waits for them when it is destroyed.
+    //
+    // If the quorum fails and any element threw, the first exception is
+    // rethrown.
+    //
+    // auto f = [&](const replica& r, std::stop_token stop) -> attempt_result_t<ack> {
+    //     return r.write(record, stop);
+    // };
+    // auto acks = tasks.map_quorum(2, f, replicas, remainder_policy::detach);
+    quorum_result_t<output_type, error_type> map_quorum(
+        std::size_t k,
+        std::function<attempt_result_t<output_type, error_type>(const input_type&, std::stop_token)> f,
+        const std::vector<input_type>& input,
+        remainder_policy remainder = remainder_policy::cancel)
+    {
+        auto batch = observe_batch();
+        return quorum(input.size(), k, [f = std::move(f), input](std::size_t i, std::stop_token stop) {
+            return f(input[i], stop);
+        }, remainder);
+    }
+
+    // Memory-budgeted evaluation, for outputs too large to hold all at once.
+    // An element starts only once its estimated cost (see `memory_cost`) fits
+    // under `budget`. Outputs are passed to `consume` on the calling thread in
+    // input order, and each element's reservation is released once its output
+    // has been consumed and destroyed; `consume` may move the output out.
+    //
+    // Elements are admitted in input order, so the next output to be consumed
+    // has always started and the operation cannot wedge on its own budget.
+    //
+    // A `cost` with neither `estimate` nor `measure` must set a nonzero
+    // `initial`, or `std::invalid_argument` is thrown. With only `measure`,
+    // the first element runs alone until its output has been measured.
+    //
+    // If any element fails, no further elements are started, the outputs of
+    // elements after the failed one are discarded, and the error of the first
+    // failed element is returned.
+    //
+    // The calling thread blocks while it waits for outputs and for budget, and
+    // runs no other work meanwhile, so `map_budgeted()` is not reentrant: it
+    // must not be called from inside an element function running on a
+    // `thread_pool` or a fiber, where the blocked thread could be the one its
+    // elements, or the elements holding the budget, need. Such calls throw
+    // `std::logic_error`.
+    //
+    // auto budget = memory_budget(4ull << 30);
+    // auto cost = memory_cost<path_type, image_type>{
+    //     .estimate = [](const path_type& p) { return decoded_size(p); },
+    // };
+    // auto done = tasks.map_budgeted(decode, input, budget, cost,
+    //     [&](std::size_t i, image_type&& img) { write_thumbnail(i, img); });
+    tl::expected<void, error_type> map_budgeted(
+        std::function<attempt_result_t<output_type, error_type>(const input_type&)> f,
+        const std::vector<input_type>& input,
+        memory_budget& budget,
+        const memory_cost<input_type, output_type>& cost,
+        std::function<void(std::size_t, output_type&&)> consume)
+    {
+        if (detail::this_worker().scheduler != nullptr || this_fiber::on_fiber()) {
+            throw std::logic_error("lt::async: map_budgeted cannot be called from an element function");
+        }
+        if (!cost.estimate && !cost.measure && cost.initial == 0) {
+            throw std::invalid_argument("lt::async: memory_cost needs an estimate, a measure or an initial cost");
+        }
+
+        auto batch = observe_batch();
+        auto n = input.size();
+        auto results =
+            std::vector<std::optional<attempt_result_t<output_type, error_type>>>(n);
+        auto reserved = std::vector<std::size_t>(n);
+        auto done = std::vector<char>(n);
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::exception_ptr task_error;
+        auto measured_peak = std::size_t(0);
+        auto measured = false;
+
+        auto start = [&](std::size_t i) {
+            executor_->post([&, i] {
+                auto r = std::optional<attempt_result_t<output_type, error_type>>();
+                auto e = std::exception_ptr();
+                auto actual = std::optional<std::size_t>();
+                try {
+                    r.emplace(f(input[i]));
+                    if (cost.measure && *r) {
+                        actual = cost.measure(**r);
+                    }
+                } catch (...) {
+                    e = std::current_exception();
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (actual) {
+                    if (*actual > reserved[i]) {
+                        budget.force_acquire(*actual - reserved[i]);
+                    } else {
+                        budget.release(reserved[i] - *actual);
+                    }
+                    reserved[i] = *actual;
+                    measured_peak = std::max(measured_peak, *actual);
+                    measured = true;
+                }
+                if (e && !task_error) {
+                    task_error = e;
+                }
+                results[i] = std::move(r);
+                done[i] = 1;
+                cv.notify_all();
+            });
         };
 
+        auto admitted = std::size_t(0);
+        auto consumed = std::size_t(0);
+        auto failure = std::optional<error_type>();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        try {
+            while (consumed < admitted || (admitted < n && !failure && !task_error)) {
+                if (consumed < admitted && done[consumed]) {
+                    auto i = consumed++;
+                    auto r = std::move(results[i]);
+                    results[i].reset();
+                    auto bytes = reserved[i];
+                    lock.unlock();
+
+                    try {
+                        if (r && *r && !failure) {
+                            consume(i, std::move(**r));
+                        } else if (r && !*r && !failure) {
+                            failure.emplace(r->error());
+                        }
+                    } catch (...) {
+                        r.reset();
+                        budget.release(bytes);
+                        throw;
+                    }
+                    r.reset();
+                    budget.release(bytes);
+
+                    lock.lock();
+                    continue;
+                }
+
+                // With no estimate and no initial cost, nothing is known of an
+                // element's size until one has been measured, so the first
+                // element runs alone.
+                auto probing = !cost.estimate && cost.initial == 0 && !measured;
+                if (admitted < n && !failure && !task_error && !(probing && admitted > 0)) {
+                    auto i = admitted;
+                    auto bytes = cost.estimate ? cost.estimate(input[i]) : std::max(cost.initial, measured_peak);
+                    lock.unlock();
+
+                    auto ok = budget.try_acquire(bytes);
+                    if (!ok && consumed == admitted) {
+                        // Nothing of ours is held, so only other users of the
+                        // budget can make room.
+                        budget.acquire(bytes);
+                        ok = true;
+                    }
+                    if (ok) {
+                        if (rate_limiter_) {
+                            rate_limiter_->acquire();
+                        }
+                        reserved[i] = bytes;
+                        ++admitted;
+                        start(i);
+                    }
+
+                    lock.lock();
+                    if (ok) {
+                        continue;
+                    }
+                }
+
+                cv.wait(lock, [&] { return done[consumed] != 0; });
+            }
+        } catch (...) {
+            if (!lock.owns_lock()) {
+                lock.lock();
+            }
+            for (; consumed < admitted; ++consumed) {
+                cv.wait(lock, [&] { return done[consumed] != 0; });
+                results[consumed].reset();
+                budget.release(reserved[consumed]);
+            }
+            throw;
+        }
+
+        if (task_error) {
+            std::rethrow_exception(task_error);
+        }
+        if (failure) {
+            return tl::unexpected(*failure);
+        }
+        return {};
+    }
+
+    // Limit the rate at which elements start. With a limiter set, each element
+    // (or batch, for `map_batched()`) takes a permit just before it runs, and
+    // each retry takes a permit before its attempt. The
+    // bucket may be shared between several `async` objects to enforce one
+    // combined rate.
+    //
+    // auto bucket = token_bucket(50.0, 5);
+    // tasks.set_rate_limiter(bucket);
+    // auto output = tasks.map_concurrently(f, input);
+    // auto s = bucket.stats();  // s.achieved_rate vs s.configured_rate
+    void set_rate_limiter(token_bucket& bucket)
+    {
+        rate_limiter_ = &bucket;
+    }
+
+    void clear_rate_limiter()
+    {
+        rate_limiter_ = nullptr;
+    }
+
+    token_bucket* rate_limiter() const
+    {
+        return rate_limiter_;
+    }
+
+   protected:
+    executor_type& get_executor() const
+    {
+        return *executor_;
+    }
+
+    // `map_concurrently()` for trivially copyable inputs and outputs. Outputs
+    // are written straight into the result vector.
+    template <typename F>
+    aggregate_result_t<output_type, error_type> map_trivial(F& f, const std::vector<input_type>& input)
+    {
+        auto output = std::vector<output_type>(input.size());
+
+        auto error = run_into(f, input, [&](std::size_t slot, output_type&& o) {
+            output[slot] = o;
+        });
+
+        if (error) {
+            return tl::unexpected(std::move(*error));
+        }
+        return output;
+    }
+
+    // Run `f` on each element, passing each output to `store(slot, output)`,
+    // where `slot` follows the ordering policy. Failures are recorded in an
+    // `error_bitmap`, with error values kept only for the elements which
+    // failed, so the only per-element storage is whatever `store` writes to.
+    // Returns the error to report, if any element failed.
+    template <typename F, typename Store>
+    std::optional<error_type> run_into(F& f, const std::vector<input_type>& input, Store&& store)
+    {
+        auto failures = detail::error_bitmap(input.size());
+        auto errors = std::vector<std::pair<std::size_t, error_type>>();
+        std::mutex errors_mutex;
+        [[maybe_unused]] auto next_slot = std::atomic<std::size_t>(0);
+
+        dispatch(input.size(), [&](std::size_t i) {
+            if constexpr (std::is_same_v<error_mode, fail_fast>) {
+                if (failures.any()) {
+                    return;
+                }
+            }
+
+            auto r = run_element(i, f, input[i]);
+
+            auto slot = i;
+            if constexpr (std::is_same_v<ordering, completion_order>) {
+                slot = next_slot.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            // Failures are recorded by input index, so that run_to_completion
+            // reports the first failed input under either ordering.
+            if (r) {
+                store(slot, std::move(*r));
+            } else {
+                std::lock_guard<std::mutex> lock(errors_mutex);
+                failures.set(i);
+                errors.emplace_back(i, std::move(r.error()));
+            }
+        });
+
+        if (!failures.any()) {
+            return std::nullopt;
+        }
+
+        if constexpr (std::is_same_v<error_mode, fail_fast>) {
+            return std::move(errors.front().second);
+        } else {
+            auto first = failures.first();
+            auto it = std::find_if(errors.begin(), errors.end(), [&](auto && e) { return e.first == first; });
+            return std::move(it->second);
+        }
+    }
+
+    // Run one element, reporting it to the instrumentation policy.
+    template <typename F>
+    attempt_result_t<output_type, error_type> run_element(std::size_t i, F& f, const input_type& input)
+    {
+        auto g = [&]() -> attempt_result_t<output_type, error_type> { return f(input); };
+        return observe(i, g);
+    }
+
+    // Report a call to the instrumentation policy, if it observes calls, until
+    // the returned guard is destroyed.
+    detail::batch_observer<instrumentation_type> observe_batch()
+    {
+        return detail::batch_observer<instrumentation_type>(instrumentation_);
+    }
+
+    // Call `g()`, which returns a `tl::expected`, reporting it to the
+    // instrumentation policy as element `i`.
+    template <typename G>
+    std::invoke_result_t<G&> observe(std::size_t i, G& g)
+    {
+        if constexpr (has_element_state_v<instrumentation_type>) {
+            auto state = instrumentation_.on_start(i);
+            auto start = std::chrono::steady_clock::now();
+            auto r = g();
+            instrumentation_.on_finish(i, r.has_value(),
+                                       std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                           std::chrono::steady_clock::now() - start),
+                                       state);
+            return r;
+        } else if constexpr (is_instrumented_v<instrumentation_type>) {
+            instrumentation_.on_start(i);
+            auto start = std::chrono::steady_clock::now();
+            auto r = g();
+            instrumentation_.on_finish(i, r.has_value(), std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                             std::chrono::steady_clock::now() - start));
+            return r;
+        } else {
+            return g();
+        }
+    }
+
+    // Run fn(0) ... fn(n - 1) on the executor, paced by the rate limiter if
+    // one is set.
+    void dispatch(std::size_t n, const std::function<void(std::size_t)>& fn)
+    {
+        detail::traced_batch(n, fn, [&](const std::function<void(std::size_t)>& g) {
+            if (rate_limiter_) {
+                detail::rate_limited_bulk(*executor_, *rate_limiter_, n, g);
+            } else {
+                executor_->bulk(n, g);
+            }
+        });
+    }
+
+    // Run attempt(0, stop) ... attempt(n - 1, stop) on the executor and return
+    // the first successful result as soon as there is one, requesting a stop
+    // on the others, which finish as for `quorum()`.
+    race_result_t<output_type, error_type> race(
+        std::size_t n,
+        std::function<attempt_result_t<output_type, error_type>(std::size_t, std::stop_token)> attempt)
+    {
+        auto r = quorum(n, std::min<std::size_t>(n, 1), std::move(attempt), remainder_policy::cancel);
+        if (r && !r->empty()) {
+            return std::move(r->front().second);
+        }
+
+        auto errors = std::vector<error_type>();
+        if (!r) {
+            errors.reserve(r.error().size());
+            for (auto && e : r.error()) {
+                errors.push_back(std::move(e.second));
+            }
+        }
+        return tl::unexpected(std::move(errors));
+    }
+
+    // Run attempt(0, stop) ... attempt(n - 1, stop) on the executor until `k`
+    // have succeeded or more than `n - k` have failed, and return as soon as
+    // that is decided. Elements which have not started by then are skipped
+    // without taking a rate limiter permit; elements still running finish on
+    // the shared state, which owns `attempt`, and this object waits for them
+    // when it is destroyed.
+    quorum_result_t<output_type, error_type> quorum(
+        std::size_t n,
+        std::size_t k,
+        std::function<attempt_result_t<output_type, error_type>(std::size_t, std::stop_token)> attempt,
+        remainder_policy remainder)
+    {
+        if (k > n) {
+            throw std::invalid_argument("lt::async: quorum larger than the number of elements");
+        }
+        if (k == 0) {
+            return std::vector<std::pair<std::size_t, output_type>>();
+        }
+
+        auto state = std::make_shared<quorum_state>(this, n, k, std::move(attempt), remainder);
+
+        // Runners claim elements from a shared counter. A caller which is
+        // itself running on a worker or a fiber claims elements too, so the
+        // call makes progress even if no runner is picked up, as when every
+        // worker is busy in an outer element. Any other caller only waits, so
+        // that it never holds up the decision by running a slow element.
+        auto nested = detail::this_worker().scheduler != nullptr || this_fiber::on_fiber();
+        auto runners = std::min(nested ? n - 1 : n, executor_->concurrency());
+        for (std::size_t r = 0; r < runners; ++r) {
+            executor_->post([state] { state->run(); });
+        }
+        if (nested) {
+            state->run();
+        }
+        state->decision.wait();
+
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->trace.finish();
+        if (state->successes.size() == k) {
+            return std::move(state->successes);
+        }
+        if (state->error) {
+            std::rethrow_exception(state->error);
+        }
+
+        auto errors = std::move(state->errors);
+        std::sort(errors.begin(), errors.end(),
+                  [](auto && a, auto && b) { return a.first < b.first; });
+        return tl::unexpected(std::move(errors));
+    }
+
+    // Wait for a permit before a retry attempt. Does nothing without a rate
+    // limiter.
+    void acquire_retry_permit()
+    {
+        if (rate_limiter_) {
+            rate_limiter_->acquire();
+        }
+    }
+
+    // Run `f_batch` over consecutive batches of `input` concurrently, storing
+    // each result at the index of its input.
+    void run_batches(
+        const batch_function_t<input_type, output_type, error_type>& f_batch,
+        const std::vector<input_type>& input,
+        const batch_options& options,
+        std::vector<std::optional<attempt_result_t<output_type, error_type>>>& results)
+    {
+        auto size = std::max<std::size_t>(1, options.max_batch_size);
+        auto batches = (input.size() + size - 1) / size;
+
+        dispatch(batches, [&](std::size_t b) {
+            auto begin = b * size;
+            auto count = std::min(size, input.size() - begin);
+
+            auto r = f_batch(std::span<const input_type>(input.data() + begin, count));
+            if (r.size() != count) {
+                throw std::length_error("lt::async: batch function returned the wrong number of results");
+            }
+            for (std::size_t i = 0; i < count; ++i) {
+                results[begin + i].emplace(std::move(r[i]));
+            }
+        });
+    }
+
+    // Gather per-element results into the aggregate result. If any element
+    // failed, the error of the first failed element is returned.
+    static aggregate_result_t<output_type, error_type> collect(
+        std::vector<std::optional<attempt_result_t<output_type, error_type>>>& results)
+    {
         auto output = std::vector<output_type>();
+        output.reserve(results.size());
         for (auto && r : results) {
-            if (!r) {
-                return tl::unexpected(r.error());
+            if (!*r) {
+                return tl::unexpected(r->error());
             }
-            output.push_back(*r);
+            output.push_back(std::move(**r));
         }
 
         return output;
     }
+
+   private:
+    // State of one call to `quorum()`, shared between the calling thread and
+    // the runners, and kept alive by elements still running after the call
+    // has returned.
+    struct quorum_state
+    {
+        quorum_state(basic_async* self,
+                     std::size_t n,
+                     std::size_t k,
+                     std::function<attempt_result_t<output_type, error_type>(std::size_t, std::stop_token)> attempt,
+                     remainder_policy remainder)
+            : running(self->detached_),
+              self(self),
+              n(n),
+              k(k),
+              attempt(std::move(attempt)),
+              remainder(remainder),
+              trace(n)
+        {
+            successes.reserve(k);
+        }
+
+        // Claim and run elements until none remain or the quorum is decided.
+        void run()
+        {
+            for (;;) {
+                if (decided.load(std::memory_order_acquire)) {
+                    return;
+                }
+                auto i = next.fetch_add(1, std::memory_order_relaxed);
+                if (i >= n) {
+                    return;
+                }
+                if (auto* limiter = self->rate_limiter_) {
+                    limiter->acquire();
+                    if (decided.load(std::memory_order_acquire)) {
+                        return;
+                    }
+                }
+                trace.element(i, [&] { run_one(i); });
+            }
+        }
+
+        void run_one(std::size_t i)
+        {
+            auto r = std::optional<attempt_result_t<output_type, error_type>>();
+            auto e = std::exception_ptr();
+            try {
+                auto g = [&] { return attempt(i, stop.get_token()); };
+                r.emplace(self->observe(i, g));
+            } catch (...) {
+                e = std::current_exception();
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (decided.load(std::memory_order_relaxed)) {
+                return;
+            }
+            if (r && *r) {
+                successes.emplace_back(i, std::move(**r));
+            } else {
+                ++failures;
+                if (r) {
+                    errors.emplace_back(i, std::move(r->error()));
+                } else if (e && !error) {
+                    error = e;
+                }
+            }
+            if (successes.size() == k || failures > n - k) {
+                decided.store(true, std::memory_order_release);
+                if (remainder == remainder_policy::cancel) {
+                    stop.request_stop();
+                }
+                decision.set();
+            }
+        }
+
+        // Declared first, so that it is destroyed last.
+        detail::detached_count::scope running;
+
+        basic_async* const self;
+        const std::size_t n;
+        const std::size_t k;
+        const std::function<attempt_result_t<output_type, error_type>(std::size_t, std::stop_token)> attempt;
+        const remainder_policy remainder;
+        const detail::batch_trace trace;
+
+        std::stop_source stop;
+        alignas(cache_line_size) std::atomic<std::size_t> next{0};
+        std::atomic<bool> decided{false};
+        detail::event decision;
+
+        std::mutex mutex;
+        std::vector<std::pair<std::size_t, output_type>> successes;
+        std::vector<std::pair<std::size_t, error_type>> errors;
+        std::size_t failures = 0;
+        std::exception_ptr error;
+    };
+
+    // State of one call to `concurrently()`, which lives on the caller's
+    // stack.
+    template <typename... Fs>
+    struct concurrently_state
+    {
+        static constexpr auto count = sizeof...(Fs);
+        static constexpr auto no_failure = count;
+
+        concurrently_state(basic_async* self, Fs&... fs)
+            : self(self),
+              fs(fs...)
+        {
+        }
+
+        template <std::size_t I>
+        void run()
+        {
+            if constexpr (std::is_same_v<error_mode, fail_fast>) {
+                if (failed.load(std::memory_order_relaxed) != no_failure) {
+                    return;
+                }
+            }
+
+            auto r = self->observe(I, std::get<I>(fs));
+            if (!r) {
+                auto expected = no_failure;
+                failed.compare_exchange_strong(expected, I, std::memory_order_relaxed);
+            }
+            std::get<I>(results).emplace(std::move(r));
+        }
+
+        // Run the action at runtime index `i`.
+        void run(std::size_t i)
+        {
+            static constexpr auto actions = []<std::size_t... I>(std::index_sequence<I...>) {
+                return std::array<void (concurrently_state::*)(), count>{&concurrently_state::template run<I>...};
+            }(std::make_index_sequence<count>());
+            (this->*actions[i])();
+        }
+
+        basic_async* self;
+        std::tuple<Fs&...> fs;
+        std::tuple<std::optional<std::invoke_result_t<Fs&>>...> results;
+        std::atomic<std::size_t> failed{no_failure};
+    };
+
+    executor_type* executor_;
+    token_bucket* rate_limiter_ = nullptr;
+    [[no_unique_address]] instrumentation_type instrumentation_;
+
+    // Elements of races and quorums still running after their call returned.
+    // Declared last, so that the destructor waits for them before anything
+    // they use is destroyed.
+    detail::detached_count detached_;
 };
 
+// async
+//
+// `basic_async` with the default policies: elements run on an `executor`,
+// outputs are returned in input order, every element runs to completion, and
+// nothing is instrumented.
+template <typename input_type, typename output_type, typename error_type=std::string>
+using async = basic_async<input_type, output_type, error_type>;
+
+// concurrently
+//
+// Run several different actions concurrently on the default executor, or on
+// `e`, returning their outputs as a tuple. The error type is that of the first
+// action. See `basic_async::concurrently()`.
+//
+// auto r = concurrently(
+//     [&] { return fetch_user(id); },
+//     [&] { return fetch_config(id); });
+template <typename F, typename... Fs>
+    requires std::is_invocable_v<F&>
+auto concurrently(F&& f, Fs&&... fs)
+{
+    using error_type = typename std::invoke_result_t<F&>::error_type;
+    return async<std::monostate, std::monostate, error_type>().concurrently(
+        std::forward<F>(f), std::forward<Fs>(fs)...);
+}
+
+template <typename executor_type, typename F, typename... Fs>
+    requires std::derived_from<executor_type, executor> && std::is_invocable_v<F&>
+auto concurrently(executor_type& e, F&& f, Fs&&... fs)
+{
+    using error_type = typename std::invoke_result_t<F&>::error_type;
+    return basic_async<std::monostate, std::monostate, error_type, executor_type>(e).concurrently(
+        std::forward<F>(f), std::forward<Fs>(fs)...);
+}
+
 } // namespace lt::async
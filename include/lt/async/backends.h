@@ -0,0 +1,463 @@
+#pragma once
+
+// Executors which run `async` work on a parallel runtime the application has
+// already initialised, instead of on the library's own threads. Each backend
+// is only compiled when its runtime is available:
+//
+//   openmp_executor        when compiled with OpenMP enabled (`_OPENMP`)
+//   tbb_executor           when oneTBB is on the include path; link with -ltbb
+//   parallel_stl_executor  when the standard library has parallel algorithms
+//
+// `make_executor()` selects one at run time.
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+#include "lt/async/executor.h"
+
+#if defined(_OPENMP)
+#include <omp.h>
+#define LT_ASYNC_HAS_OPENMP 1
+#endif
+
+#if __has_include(<oneapi/tbb/task_arena.h>)
+#include <oneapi/tbb/parallel_for.h>
+#include <oneapi/tbb/task_arena.h>
+#define LT_ASYNC_HAS_TBB 1
+#endif
+
+#if __has_include(<execution>)
+#include <execution>
+#if defined(__cpp_lib_parallel_algorithm)
+#define LT_ASYNC_HAS_PARALLEL_STL 1
+#endif
+#endif
+
+namespace lt::async
+{
+
+namespace detail
+{
+
+// error_slot
+//
+// Keeps the first exception thrown by any element, so that a backend whose
+// runtime would otherwise cancel the remaining elements, or terminate, can
+// run them all and rethrow afterwards as `executor::bulk()` requires.
+class error_slot
+{
+   public:
+    void capture()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!error_) {
+            error_ = std::current_exception();
+        }
+    }
+
+    void rethrow()
+    {
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+   private:
+    std::mutex mutex_;
+    std::exception_ptr error_;
+};
+
+// index_iterator
+//
+// Random access iterator over the indices 0 .. n-1, for running `bulk()`
+// through a standard algorithm without materialising the indices. The index
+// is stored in the iterator, so that dereferencing yields a `const
+// std::size_t&` as the parallel algorithms require of a forward iterator.
+// The reference is valid only while the iterator is unchanged, so do not wrap
+// it in `std::reverse_iterator`, which returns a reference into a temporary.
+class index_iterator
+{
+   public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const std::size_t*;
+    using reference = const std::size_t&;
+
+    index_iterator() = default;
+
+    explicit index_iterator(std::size_t i)
+        : i_(i)
+    {
+    }
+
+    reference operator*() const
+    {
+        return i_;
+    }
+
+    pointer operator->() const
+    {
+        return &i_;
+    }
+
+    value_type operator[](difference_type d) const
+    {
+        return i_ + d;
+    }
+
+    index_iterator& operator++()
+    {
+        ++i_;
+        return *this;
+    }
+
+    index_iterator& operator--()
+    {
+        --i_;
+        return *this;
+    }
+
+    index_iterator operator++(int)
+    {
+        auto r = *this;
+        ++i_;
+        return r;
+    }
+
+    index_iterator operator--(int)
+    {
+        auto r = *this;
+        --i_;
+        return r;
+    }
+
+    index_iterator& operator+=(difference_type d)
+    {
+        i_ += d;
+        return *this;
+    }
+
+    index_iterator& operator-=(difference_type d)
+    {
+        i_ -= d;
+        return *this;
+    }
+
+    friend index_iterator operator+(index_iterator a, difference_type d)
+    {
+        return a += d;
+    }
+
+    friend index_iterator operator+(difference_type d, index_iterator a)
+    {
+        return a += d;
+    }
+
+    friend index_iterator operator-(index_iterator a, difference_type d)
+    {
+        return a -= d;
+    }
+
+    friend difference_type operator-(index_iterator a, index_iterator b)
+    {
+        return static_cast<difference_type>(a.i_) - static_cast<difference_type>(b.i_);
+    }
+
+    friend auto operator<=>(index_iterator, index_iterator) = default;
+
+   private:
+    std::size_t i_ = 0;
+};
+
+} // namespace detail
+
+#if defined(LT_ASYNC_HAS_OPENMP)
+
+// openmp_executor
+//
+// Runs each `bulk()` as an OpenMP taskloop. Called outside a parallel region,
+// it opens one with `threads` threads; called from inside one (from a
+// `single` construct or a task), it spreads the elements over the enclosing
+// team instead of starting another. OpenMP cannot queue work outside a
+// parallel region, so `post()` queues the task on a side `thread_pool` of
+// `threads` workers, which are only started by the first `post()`.
+class openmp_executor final : public executor
+{
+   public:
+    explicit openmp_executor(int threads = omp_get_max_threads())
+        : threads_(threads),
+          side_(static_cast<std::size_t>(std::max(threads, 1)), 4096, worker_start::lazy)
+    {
+    }
+
+    int threads() const
+    {
+        return threads_;
+    }
+
+    void bulk(std::size_t n, const std::function<void(std::size_t)>& fn) override
+    {
+        if (n == 0) {
+            return;
+        }
+
+        auto error = detail::error_slot();
+        auto run = [&](std::size_t i) {
+            try {
+                fn(i);
+            } catch (...) {
+                error.capture();
+            }
+        };
+
+        if (omp_in_parallel()) {
+#pragma omp taskloop
+            for (std::size_t i = 0; i < n; ++i) {
+                run(i);
+            }
+        } else {
+#pragma omp parallel num_threads(threads_)
+#pragma omp single
+#pragma omp taskloop
+            for (std::size_t i = 0; i < n; ++i) {
+                run(i);
+            }
+        }
+
+        error.rethrow();
+    }
+
+    void post(task t) override
+    {
+        side_.post(std::move(t));
+    }
+
+    std::size_t concurrency() const override
+    {
+        return side_.size();
+    }
+
+   private:
+    int threads_;
+    thread_pool side_;
+};
+
+#endif
+
+#if defined(LT_ASYNC_HAS_TBB)
+
+// tbb_executor
+//
+// Runs `bulk()` as a `parallel_for` inside a oneTBB task arena, and `post()`
+// as a task enqueued in it. By default the executor attaches to the arena of
+// the constructing thread, or to the default arena if that thread is not in
+// one; pass an arena to share a specific one, which must outlive the
+// executor. Unlike a plain `parallel_for`, an exception does not cancel the
+// remaining elements.
+class tbb_executor final : public executor
+{
+   public:
+    tbb_executor()
+        : owned_(std::make_unique<tbb::task_arena>(tbb::task_arena::attach())),
+          arena_(owned_.get())
+    {
+    }
+
+    explicit tbb_executor(int threads)
+        : owned_(std::make_unique<tbb::task_arena>(threads)),
+          arena_(owned_.get())
+    {
+    }
+
+    explicit tbb_executor(tbb::task_arena& arena)
+        : arena_(&arena)
+    {
+    }
+
+    tbb::task_arena& arena()
+    {
+        return *arena_;
+    }
+
+    void bulk(std::size_t n, const std::function<void(std::size_t)>& fn) override
+    {
+        if (n == 0) {
+            return;
+        }
+
+        auto error = detail::error_slot();
+        arena_->execute([&] {
+            tbb::parallel_for(std::size_t(0), n, [&](std::size_t i) {
+                try {
+                    fn(i);
+                } catch (...) {
+                    error.capture();
+                }
+            });
+        });
+
+        error.rethrow();
+    }
+
+    void post(task t) override
+    {
+        arena_->enqueue(std::move(t));
+    }
+
+    std::size_t concurrency() const override
+    {
+        return static_cast<std::size_t>(std::max(arena_->max_concurrency(), 1));
+    }
+
+   private:
+    std::unique_ptr<tbb::task_arena> owned_;
+    tbb::task_arena* arena_;
+};
+
+#endif
+
+#if defined(LT_ASYNC_HAS_PARALLEL_STL)
+
+// parallel_stl_executor
+//
+// Runs `bulk()` through `std::for_each` with a standard execution policy, so
+// that work goes wherever the standard library's parallel backend runs it.
+// The default is `std::execution::par`. `std::execution::par_unseq` may
+// interleave elements on one thread, so only choose it when element functions
+// neither take locks nor wait, which rules out `basic_async` with a rate
+// limiter or a memory budget. The standard algorithms cannot queue a single
+// task, so `post()` queues it on a side `thread_pool`, whose workers are only
+// started by the first `post()`.
+//
+// auto ex = parallel_stl_executor(std::execution::par_unseq);
+template <typename policy_type = std::execution::parallel_policy>
+    requires std::is_execution_policy_v<policy_type>
+class parallel_stl_executor final : public executor
+{
+   public:
+    parallel_stl_executor()
+        : side_(thread_pool::default_concurrency(), 4096, worker_start::lazy)
+    {
+    }
+
+    explicit parallel_stl_executor(policy_type policy)
+        : policy_(policy),
+          side_(thread_pool::default_concurrency(), 4096, worker_start::lazy)
+    {
+    }
+
+    void bulk(std::size_t n, const std::function<void(std::size_t)>& fn) override
+    {
+        auto error = detail::error_slot();
+        std::for_each(policy_, detail::index_iterator(0), detail::index_iterator(n), [&](std::size_t i) {
+            try {
+                fn(i);
+            } catch (...) {
+                error.capture();
+            }
+        });
+
+        error.rethrow();
+    }
+
+    void post(task t) override
+    {
+        side_.post(std::move(t));
+    }
+
+    std::size_t concurrency() const override
+    {
+        return side_.size();
+    }
+
+   private:
+    policy_type policy_;
+    thread_pool side_;
+};
+
+#endif
+
+// backend
+//
+// Parallel runtimes which `make_executor()` can select.
+enum class backend
+{
+    native,
+    openmp,
+    tbb,
+    parallel_stl,
+};
+
+// backend_available
+//
+// True if `b` was compiled in.
+inline constexpr bool backend_available(backend b)
+{
+    switch (b) {
+        case backend::native:
+            return true;
+        case backend::openmp:
+#if defined(LT_ASYNC_HAS_OPENMP)
+            return true;
+#else
+            return false;
+#endif
+        case backend::tbb:
+#if defined(LT_ASYNC_HAS_TBB)
+            return true;
+#else
+            return false;
+#endif
+        case backend::parallel_stl:
+#if defined(LT_ASYNC_HAS_PARALLEL_STL)
+            return true;
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+// make_executor
+//
+// Create an executor for backend `b`, for example from deployment
+// configuration. `threads` sizes the native pool, the OpenMP team and a new
+// TBB arena; zero leaves each runtime's default, which for TBB means
+// attaching to the current arena. The parallel STL backend ignores it.
+// Throws `std::invalid_argument` if `b` was not compiled in.
+//
+// auto ex = make_executor(config.use_tbb ? backend::tbb : backend::native);
+// auto tasks = async<input_type, output_type>(*ex);
+inline std::unique_ptr<executor> make_executor(backend b, std::size_t threads = 0)
+{
+    switch (b) {
+        case backend::native:
+            return std::make_unique<thread_pool>(threads > 0 ? threads : thread_pool::default_concurrency());
+#if defined(LT_ASYNC_HAS_OPENMP)
+        case backend::openmp:
+            return threads > 0 ? std::make_unique<openmp_executor>(static_cast<int>(threads))
+                               : std::make_unique<openmp_executor>();
+#endif
+#if defined(LT_ASYNC_HAS_TBB)
+        case backend::tbb:
+            return threads > 0 ? std::make_unique<tbb_executor>(static_cast<int>(threads))
+                               : std::make_unique<tbb_executor>();
+#endif
+#if defined(LT_ASYNC_HAS_PARALLEL_STL)
+        case backend::parallel_stl:
+            return std::make_unique<parallel_stl_executor<>>();
+#endif
+        default:
+            throw std::invalid_argument("lt::async: backend not available in this build");
+    }
+}
+
+} // namespace lt::async
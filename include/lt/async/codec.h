@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace lt::async
+{
+
+// codec
+//
+// Converts values of type `T` to and from bytes, so that they can be passed
+// to and from worker processes. `encode` appends the bytes of a value to a
+// string; `decode` rebuilds the value from exactly those bytes.
+//
+// auto point_codec = codec<point>{
+//     .encode = [](const point& p, std::string& out) { out += to_json(p); },
+//     .decode = [](std::string_view s) { return point_from_json(s); },
+// };
+template <typename T>
+struct codec
+{
+    std::function<void(const T&, std::string&)> encode;
+    std::function<T(std::string_view)> decode;
+};
+
+// bytes_codec
+//
+// Codec for trivially copyable types, which copies their object
+// representation, and for `std::string`, which copies its characters.
+// Decoding anything but exactly `sizeof(T)` bytes into a trivially copyable
+// `T` throws `std::length_error`.
+template <typename T>
+codec<T> bytes_codec()
+{
+    if constexpr (std::is_same_v<T, std::string>) {
+        return codec<T>{
+            .encode = [](const T& v, std::string& out) { out += v; },
+            .decode = [](std::string_view s) { return T(s); },
+        };
+    } else {
+        static_assert(std::is_trivially_copyable_v<T>,
+                      "lt::async: bytes_codec needs a trivially copyable type; supply a codec");
+        return codec<T>{
+            .encode = [](const T& v, std::string& out) {
+                out.append(reinterpret_cast<const char*>(&v), sizeof(T));
+            },
+            .decode = [](std::string_view s) {
+                if (s.size() != sizeof(T)) {
+                    throw std::length_error("lt::async: bytes_codec expected " + std::to_string(sizeof(T)) +
+                                            " bytes, got " + std::to_string(s.size()));
+                }
+                auto v = T();
+                std::memcpy(&v, s.data(), sizeof(T));
+                return v;
+            },
+        };
+    }
+}
+
+} // namespace lt::async
@@ -0,0 +1,828 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "tl/expected.hpp"
+
+#include "lt/async/async.h"
+#include "lt/async/codec.h"
+
+namespace lt::async
+{
+
+// endpoint
+//
+// Address of a worker node.
+struct endpoint
+{
+    std::string host;
+    std::uint16_t port = 0;
+};
+
+// distributed_options
+//
+// The input is cut into shards of `shard_size` elements, and each node has at
+// most `window` shards in flight. A node which does not answer a shard within
+// `shard_timeout`, or which cannot be reached within `connect_timeout`, is
+// treated as failed for the rest of the call.
+struct distributed_options
+{
+    std::size_t shard_size = 64;
+    std::size_t window = 2;
+    std::chrono::milliseconds connect_timeout = std::chrono::seconds(1);
+    std::chrono::milliseconds shard_timeout = std::chrono::seconds(30);
+};
+
+namespace detail
+{
+
+// Wire format, in host byte order, so all nodes must share one architecture.
+// Every frame is a 32-bit body length followed by the body:
+//
+//   request:  u64 shard, u32 count, count x (u32 length, bytes)
+//   response: u64 shard, u32 count, count x (u32 tag, u32 length, bytes)
+//
+// A frame whose body is longer than `max_frame_bytes` is rejected before
+// anything is allocated for it, and the connection is dropped.
+
+inline constexpr std::uint32_t max_frame_bytes = std::uint32_t(1) << 28;
+
+enum wire_tag : std::uint32_t
+{
+    wire_output,
+    wire_error,
+    wire_exception,
+};
+
+inline void put_u32(std::string& out, std::uint32_t v)
+{
+    out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+inline void put_u64(std::string& out, std::uint64_t v)
+{
+    out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+// Write the length of the frame started at `start` into its first four bytes.
+inline void seal_frame(std::string& out, std::size_t start)
+{
+    auto body = static_cast<std::uint32_t>(out.size() - start - sizeof(std::uint32_t));
+    std::memcpy(out.data() + start, &body, sizeof(body));
+}
+
+// frame_reader
+//
+// Bounds-checked reader over the body of one frame.
+class frame_reader
+{
+   public:
+    explicit frame_reader(std::string_view body)
+        : body_(body)
+    {
+    }
+
+    std::uint32_t u32()
+    {
+        std::uint32_t v;
+        std::memcpy(&v, take(sizeof(v)).data(), sizeof(v));
+        return v;
+    }
+
+    std::uint64_t u64()
+    {
+        std::uint64_t v;
+        std::memcpy(&v, take(sizeof(v)).data(), sizeof(v));
+        return v;
+    }
+
+    std::string_view bytes()
+    {
+        return take(u32());
+    }
+
+   private:
+    std::string_view take(std::size_t n)
+    {
+        if (body_.size() - pos_ < n) {
+            throw std::runtime_error("lt::async: malformed frame");
+        }
+        auto s = body_.substr(pos_, n);
+        pos_ += n;
+        return s;
+    }
+
+    std::string_view body_;
+    std::size_t pos_ = 0;
+};
+
+// Take one complete frame body off the front of `buffer`, if there is one.
+inline std::optional<std::string> next_frame(std::string& buffer)
+{
+    if (buffer.size() < sizeof(std::uint32_t)) {
+        return std::nullopt;
+    }
+    std::uint32_t body;
+    std::memcpy(&body, buffer.data(), sizeof(body));
+    if (body > max_frame_bytes) {
+        throw std::runtime_error("lt::async: frame too large");
+    }
+    if (buffer.size() - sizeof(body) < body) {
+        return std::nullopt;
+    }
+    auto frame = buffer.substr(sizeof(body), body);
+    buffer.erase(0, sizeof(body) + body);
+    return frame;
+}
+
+inline bool send_all(int fd, std::string_view data)
+{
+    while (!data.empty()) {
+        auto r = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data.remove_prefix(static_cast<std::size_t>(r));
+    }
+    return true;
+}
+
+inline bool recv_all(int fd, char* data, std::size_t n)
+{
+    while (n > 0) {
+        auto r = ::recv(fd, data, n, 0);
+        if (r == 0) {
+            return false;
+        }
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += r;
+        n -= static_cast<std::size_t>(r);
+    }
+    return true;
+}
+
+inline void set_nodelay(int fd)
+{
+    auto one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+// Connect to `e` without blocking for longer than `timeout`. Returns a
+// non-blocking socket, or -1.
+inline int connect_tcp(const endpoint& e, std::chrono::milliseconds timeout)
+{
+    auto hints = addrinfo{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addrs = nullptr;
+    if (getaddrinfo(e.host.c_str(), std::to_string(e.port).c_str(), &hints, &addrs) != 0) {
+        return -1;
+    }
+
+    auto fd = -1;
+    for (auto a = addrs; a != nullptr && fd < 0; a = a->ai_next) {
+        fd = ::socket(a->ai_family, a->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, a->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (::connect(fd, a->ai_addr, a->ai_addrlen) < 0 && errno != EINPROGRESS) {
+            ::close(fd);
+            fd = -1;
+            continue;
+        }
+
+        auto p = pollfd{fd, POLLOUT, 0};
+        auto err = 0;
+        auto len = socklen_t(sizeof(err));
+        if (::poll(&p, 1, static_cast<int>(timeout.count())) != 1 ||
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addrs);
+
+    if (fd >= 0) {
+        set_nodelay(fd);
+    }
+    return fd;
+}
+
+} // namespace detail
+
+// worker_server
+//
+// Worker node for `distributed_async`: accepts connections from coordinators
+// and runs `f` on the shards they send, spreading the elements of each shard
+// over a local executor. The codecs must match the coordinator's.
+//
+// auto server = worker_server<std::string, int>(f);
+// server.listen(7000);
+// server.serve();  // until stop()
+template <typename input_type, typename output_type, typename error_type=std::string>
+class worker_server
+{
+   public:
+    using function_type = std::function<attempt_result_t<output_type, error_type>(const input_type&)>;
+
+    explicit worker_server(function_type f,
+                           codec<input_type> input_codec = bytes_codec<input_type>(),
+                           codec<output_type> output_codec = bytes_codec<output_type>(),
+                           codec<error_type> error_codec = bytes_codec<error_type>(),
+                           executor& e = default_executor())
+        : f_(std::move(f)),
+          input_codec_(std::move(input_codec)),
+          output_codec_(std::move(output_codec)),
+          error_codec_(std::move(error_codec)),
+          executor_(&e)
+    {
+    }
+
+    worker_server(const worker_server&) = delete;
+    worker_server& operator=(const worker_server&) = delete;
+
+    ~worker_server()
+    {
+        stop();
+        if (listen_fd_ >= 0) {
+            ::close(listen_fd_);
+        }
+    }
+
+    // Listen on `port` of `host`, or on an ephemeral port if `port` is zero.
+    // Returns the port.
+    std::uint16_t listen(std::uint16_t port = 0, const std::string& host = "0.0.0.0")
+    {
+        auto addr = sockaddr_in{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+            throw std::invalid_argument("lt::async: listen address must be IPv4: " + host);
+        }
+
+        listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd_ < 0) {
+            throw std::system_error(errno, std::generic_category(), "lt::async: socket");
+        }
+        auto one = 1;
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+            ::listen(listen_fd_, SOMAXCONN) < 0) {
+            throw std::system_error(errno, std::generic_category(), "lt::async: listen");
+        }
+
+        auto len = socklen_t(sizeof(addr));
+        getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&addr), &len);
+        return ntohs(addr.sin_port);
+    }
+
+    // Accept and serve connections until `stop()` is called.
+    void serve()
+    {
+        while (!stopping_.load(std::memory_order_acquire)) {
+            auto fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                break;
+            }
+            detail::set_nodelay(fd);
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_.load(std::memory_order_relaxed)) {
+                ::close(fd);
+                break;
+            }
+            connections_.emplace_back(fd, std::thread([this, fd] {
+                serve_connection(fd);
+                // Let the coordinator see the connection end at once; the
+                // descriptor itself is closed by stop().
+                ::shutdown(fd, SHUT_RDWR);
+            }));
+        }
+    }
+
+    // Stop accepting, close every connection, and wait for their threads.
+    void stop()
+    {
+        auto connections = std::vector<std::pair<int, std::thread>>();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_.store(true, std::memory_order_release);
+            if (listen_fd_ >= 0) {
+                ::shutdown(listen_fd_, SHUT_RDWR);
+            }
+            connections.swap(connections_);
+        }
+        for (auto && [fd, t] : connections) {
+            ::shutdown(fd, SHUT_RDWR);
+            t.join();
+            ::close(fd);
+        }
+    }
+
+   private:
+    void serve_connection(int fd)
+    {
+        auto body = std::string();
+        auto reply = std::string();
+        auto inputs = std::vector<std::optional<input_type>>();
+        auto outputs = std::vector<std::pair<std::uint32_t, std::string>>();
+
+        for (;;) {
+            std::uint32_t size;
+            if (!detail::recv_all(fd, reinterpret_cast<char*>(&size), sizeof(size)) ||
+                size > detail::max_frame_bytes) {
+                return;
+            }
+            body.resize(size);
+            if (!detail::recv_all(fd, body.data(), size)) {
+                return;
+            }
+
+            try {
+                auto in = detail::frame_reader(body);
+                auto shard = in.u64();
+                auto count = in.u32();
+                // Each element takes at least its length, so a larger count
+                // cannot be genuine.
+                if (count > body.size() / sizeof(std::uint32_t)) {
+                    return;
+                }
+
+                inputs.assign(count, std::nullopt);
+                outputs.assign(count, {detail::wire_output, std::string()});
+                for (std::uint32_t i = 0; i < count; ++i) {
+                    auto bytes = in.bytes();
+                    try {
+                        inputs[i].emplace(input_codec_.decode(bytes));
+                    } catch (const std::exception& e) {
+                        outputs[i] = {detail::wire_exception, e.what()};
+                    }
+                }
+
+                executor_->bulk(count, [&](std::size_t i) {
+                    if (!inputs[i]) {
+                        return;
+                    }
+                    auto& [tag, bytes] = outputs[i];
+                    try {
+                        auto r = f_(*inputs[i]);
+                        if (r) {
+                            output_codec_.encode(*r, bytes);
+                        } else {
+                            tag = detail::wire_error;
+                            error_codec_.encode(r.error(), bytes);
+                        }
+                    } catch (const std::exception& e) {
+                        tag = detail::wire_exception;
+                        bytes = e.what();
+                    } catch (...) {
+                        tag = detail::wire_exception;
+                        bytes = "lt::async: unknown exception on worker node";
+                    }
+                });
+
+                reply.clear();
+                detail::put_u32(reply, 0);
+                detail::put_u64(reply, shard);
+                detail::put_u32(reply, count);
+                for (auto && [tag, bytes] : outputs) {
+                    detail::put_u32(reply, tag);
+                    detail::put_u32(reply, static_cast<std::uint32_t>(bytes.size()));
+                    reply += bytes;
+                }
+                detail::seal_frame(reply, 0);
+            } catch (const std::exception&) {
+                return;
+            }
+
+            if (!detail::send_all(fd, reply)) {
+                return;
+            }
+        }
+    }
+
+    function_type f_;
+    codec<input_type> input_codec_;
+    codec<output_type> output_codec_;
+    codec<error_type> error_codec_;
+    executor* executor_;
+
+    int listen_fd_ = -1;
+    std::atomic<bool> stopping_{false};
+    std::mutex mutex_;
+    std::vector<std::pair<int, std::thread>> connections_;
+};
+
+// distributed_async
+//
+// Coordinator which runs `map_concurrently()` across `worker_server` nodes
+// over TCP. The input is cut into shards which are dealt to the nodes in turn;
+// a node which has finished its own shards steals the last unsent shards of
+// the node with the most remaining, so faster nodes take more of the work
+// wherever they are. Outputs are gathered back into input order.
+//
+// A node which disconnects, fails to connect or times out is dropped for the
+// rest of the call, and the shards it held are sent to the others. The call
+// fails only if no node is left, or if a node breaks the protocol by answering
+// a shard it was not sent or with the wrong number of results. Connections are
+// kept between calls, and a dropped node is tried again on the next call.
+// Calls on one coordinator run one at a time.
+//
+// auto tasks = distributed_async<std::string, int>({{"10.0.0.1", 7000}, {"10.0.0.2", 7000}});
+// auto output = tasks.map_concurrently(paths);
+template <typename input_type, typename output_type, typename error_type=std::string>
+class distributed_async
+{
+    static_assert(std::is_constructible_v<error_type, std::string> || std::is_default_constructible_v<error_type>,
+                  "lt::async: distributed_async needs an error_type constructible from a message");
+
+    using clock = std::chrono::steady_clock;
+
+    struct node
+    {
+        endpoint address;
+        int fd = -1;
+        std::string in;
+        std::string out;
+        std::deque<std::size_t> queue;
+        std::vector<std::pair<std::size_t, clock::time_point>> in_flight;
+    };
+
+   public:
+    explicit distributed_async(std::vector<endpoint> nodes,
+                               distributed_options options = {},
+                               codec<input_type> input_codec = bytes_codec<input_type>(),
+                               codec<output_type> output_codec = bytes_codec<output_type>(),
+                               codec<error_type> error_codec = bytes_codec<error_type>())
+        : options_(options),
+          input_codec_(std::move(input_codec)),
+          output_codec_(std::move(output_codec)),
+          error_codec_(std::move(error_codec))
+    {
+        options_.shard_size = std::max<std::size_t>(1, options_.shard_size);
+        options_.window = std::max<std::size_t>(1, options_.window);
+        nodes_.resize(nodes.size());
+        for (std::size_t i = 0; i < nodes.size(); ++i) {
+            nodes_[i].address = std::move(nodes[i]);
+        }
+    }
+
+    distributed_async(const distributed_async&) = delete;
+    distributed_async& operator=(const distributed_async&) = delete;
+
+    ~distributed_async()
+    {
+        for (auto && n : nodes_) {
+            disconnect(n);
+        }
+    }
+
+    // Number of nodes connected at the end of the last call.
+    std::size_t live_nodes() const
+    {
+        return std::count_if(nodes_.begin(), nodes_.end(), [](const node& n) { return n.fd >= 0; });
+    }
+
+    // Run `f` on each element of `input` on the worker nodes. As for
+    // `async::map_concurrently()`, the outputs are returned in input order,
+    // or the error of the first failed element.
+    aggregate_result_t<output_type, error_type> map_concurrently(const std::vector<input_type>& input)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        try {
+            return run(input);
+        } catch (...) {
+            for (auto && n : nodes_) {
+                disconnect(n);
+            }
+            throw;
+        }
+    }
+
+   private:
+    static error_type make_error(const std::string& message)
+    {
+        if constexpr (std::is_constructible_v<error_type, std::string>) {
+            return error_type(message);
+        } else {
+            return error_type();
+        }
+    }
+
+    aggregate_result_t<output_type, error_type> run(const std::vector<input_type>& input)
+    {
+        auto n = input.size();
+        auto shards = (n + options_.shard_size - 1) / options_.shard_size;
+        auto results = std::vector<std::optional<attempt_result_t<output_type, error_type>>>(n);
+        auto done = std::vector<bool>(shards, false);
+        auto remaining = shards;
+
+        for (auto && nd : nodes_) {
+            if (nd.fd < 0) {
+                nd.fd = detail::connect_tcp(nd.address, options_.connect_timeout);
+            }
+            nd.in.clear();
+            nd.out.clear();
+            nd.queue.clear();
+            nd.in_flight.clear();
+        }
+
+        auto alive = [&] {
+            auto live = std::vector<node*>();
+            for (auto && nd : nodes_) {
+                if (nd.fd >= 0) {
+                    live.push_back(&nd);
+                }
+            }
+            return live;
+        };
+
+        auto deal = [&](auto first, auto last) {
+            auto live = alive();
+            auto k = std::size_t(0);
+            for (auto s = first; s != last; ++s) {
+                live[k++ % live.size()]->queue.push_back(*s);
+            }
+        };
+
+        auto fail = [&](node& nd) {
+            auto orphaned = std::vector<std::size_t>(nd.queue.begin(), nd.queue.end());
+            for (auto && [s, _] : nd.in_flight) {
+                orphaned.push_back(s);
+            }
+            disconnect(nd);
+            if (!alive().empty()) {
+                std::sort(orphaned.begin(), orphaned.end());
+                deal(orphaned.begin(), orphaned.end());
+            }
+        };
+
+        if (alive().empty() && shards > 0) {
+            return tl::unexpected(make_error("lt::async: no worker nodes available"));
+        }
+        auto all = std::vector<std::size_t>(shards);
+        for (std::size_t s = 0; s < shards; ++s) {
+            all[s] = s;
+        }
+        deal(all.begin(), all.end());
+
+        auto pfds = std::vector<pollfd>();
+        auto polled = std::vector<node*>();
+        auto violation = std::string();
+
+        while (remaining > 0) {
+            auto live = alive();
+            if (live.empty()) {
+                return tl::unexpected(make_error("lt::async: all worker nodes failed"));
+            }
+
+            for (auto nd : live) {
+                while (nd->in_flight.size() < options_.window) {
+                    auto s = std::optional<std::size_t>();
+                    if (!nd->queue.empty()) {
+                        s = nd->queue.front();
+                        nd->queue.pop_front();
+                    } else {
+                        auto victim = *std::max_element(live.begin(), live.end(), [](node* a, node* b) {
+                            return a->queue.size() < b->queue.size();
+                        });
+                        if (victim->queue.empty()) {
+                            break;
+                        }
+                        s = victim->queue.back();
+                        victim->queue.pop_back();
+                    }
+                    encode_shard(nd->out, *s, input);
+                    nd->in_flight.emplace_back(*s, clock::now());
+                }
+            }
+
+            pfds.clear();
+            polled.clear();
+            auto now = clock::now();
+            auto deadline = now + std::chrono::milliseconds(100);
+            for (auto nd : live) {
+                auto events = short(POLLIN);
+                if (!nd->out.empty()) {
+                    events |= POLLOUT;
+                }
+                pfds.push_back(pollfd{nd->fd, events, 0});
+                polled.push_back(nd);
+                for (auto && [_, sent] : nd->in_flight) {
+                    deadline = std::min(deadline, sent + options_.shard_timeout);
+                }
+            }
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count();
+            if (::poll(pfds.data(), pfds.size(), static_cast<int>(std::max<long long>(0, wait))) < 0 &&
+                errno != EINTR) {
+                throw std::system_error(errno, std::generic_category(), "lt::async: poll");
+            }
+
+            for (std::size_t p = 0; p < pfds.size(); ++p) {
+                auto& nd = *polled[p];
+                auto ok = (pfds[p].revents & (POLLERR | POLLNVAL)) == 0;
+                if (ok && (pfds[p].revents & POLLOUT)) {
+                    ok = flush(nd);
+                }
+                if (ok && (pfds[p].revents & (POLLIN | POLLHUP))) {
+                    ok = receive(nd, n, results, done, remaining, violation);
+                }
+                if (!violation.empty()) {
+                    for (auto && other : nodes_) {
+                        disconnect(other);
+                    }
+                    return tl::unexpected(make_error(violation));
+                }
+
+                now = clock::now();
+                for (auto && [_, sent] : nd.in_flight) {
+                    if (now - sent >= options_.shard_timeout) {
+                        ok = false;
+                    }
+                }
+                if (!ok) {
+                    fail(nd);
+                }
+            }
+        }
+
+        auto output = std::vector<output_type>();
+        output.reserve(n);
+        for (auto && r : results) {
+            if (!*r) {
+                return tl::unexpected(std::move(r->error()));
+            }
+            output.push_back(std::move(**r));
+        }
+        return output;
+    }
+
+    void encode_shard(std::string& out, std::size_t shard, const std::vector<input_type>& input)
+    {
+        auto begin = shard * options_.shard_size;
+        auto end = std::min(input.size(), begin + options_.shard_size);
+        auto start = out.size();
+
+        detail::put_u32(out, 0);
+        detail::put_u64(out, shard);
+        detail::put_u32(out, static_cast<std::uint32_t>(end - begin));
+        for (auto i = begin; i < end; ++i) {
+            auto at = out.size();
+            detail::put_u32(out, 0);
+            input_codec_.encode(input[i], out);
+            auto len = static_cast<std::uint32_t>(out.size() - at - sizeof(std::uint32_t));
+            std::memcpy(out.data() + at, &len, sizeof(len));
+        }
+        detail::seal_frame(out, start);
+    }
+
+    bool flush(node& nd)
+    {
+        while (!nd.out.empty()) {
+            auto r = ::send(nd.fd, nd.out.data(), nd.out.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (r < 0) {
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            }
+            nd.out.erase(0, static_cast<std::size_t>(r));
+        }
+        return true;
+    }
+
+    // Read the responses waiting from `nd`. Returns false if the node should
+    // be dropped. A response which does not match a shard sent to this node,
+    // in index or element count, sets `violation`, which fails the call.
+    bool receive(node& nd,
+                 std::size_t n,
+                 std::vector<std::optional<attempt_result_t<output_type, error_type>>>& results,
+                 std::vector<bool>& done,
+                 std::size_t& remaining,
+                 std::string& violation)
+    {
+        char buffer[65536];
+        for (;;) {
+            auto r = ::recv(nd.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (r == 0) {
+                return false;
+            }
+            if (r < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            nd.in.append(buffer, static_cast<std::size_t>(r));
+        }
+
+        // A malformed frame drops the node like a lost connection.
+        try {
+            while (auto body = detail::next_frame(nd.in)) {
+                auto in = detail::frame_reader(*body);
+                auto shard = in.u64();
+                auto count = in.u32();
+                auto sent = std::find_if(nd.in_flight.begin(), nd.in_flight.end(),
+                                         [&](const auto& f) { return f.first == shard; });
+                if (sent == nd.in_flight.end()) {
+                    violation = "lt::async: worker node answered shard " + std::to_string(shard) +
+                                ", which was not sent to it";
+                    return false;
+                }
+                auto begin = shard * options_.shard_size;
+                auto expected = std::min(options_.shard_size, n - begin);
+                if (count != expected) {
+                    violation = "lt::async: worker node returned " + std::to_string(count) + " results for shard " +
+                                std::to_string(shard) + " of " + std::to_string(expected) + " elements";
+                    return false;
+                }
+
+                nd.in_flight.erase(sent);
+                if (done[shard]) {
+                    continue;
+                }
+
+                for (std::uint32_t i = 0; i < count; ++i) {
+                    auto tag = in.u32();
+                    auto bytes = in.bytes();
+                    auto& slot = results[begin + i];
+                    try {
+                        if (tag == detail::wire_output) {
+                            slot.emplace(output_codec_.decode(bytes));
+                        } else if (tag == detail::wire_error) {
+                            slot.emplace(tl::unexpected(error_codec_.decode(bytes)));
+                        } else {
+                            slot.emplace(tl::unexpected(make_error(std::string(bytes))));
+                        }
+                    } catch (const std::exception& e) {
+                        slot.emplace(tl::unexpected(make_error(e.what())));
+                    }
+                }
+                done[shard] = true;
+                --remaining;
+            }
+        } catch (const std::runtime_error&) {
+            return false;
+        }
+        return true;
+    }
+
+    static void disconnect(node& nd)
+    {
+        if (nd.fd >= 0) {
+            ::close(nd.fd);
+            nd.fd = -1;
+        }
+        nd.in.clear();
+        nd.out.clear();
+        nd.queue.clear();
+        nd.in_flight.clear();
+    }
+
+    distributed_options options_;
+    codec<input_type> input_codec_;
+    codec<output_type> output_codec_;
+    codec<error_type> error_codec_;
+
+    std::vector<node> nodes_;
+    std::mutex mutex_;
+};
+
+} // namespace lt::async
@@ -0,0 +1,801 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "lt/async/mpmc-queue.h"
+
+namespace lt::async
+{
+
+// task
+//
+// A unit of work queued on an executor.
+using task = std::function<void()>;
+
+// executor
+//
+// Interface to the execution resource used by `async` and its derived
+// classes. An executor only has to provide a bulk operation, which runs an
+// indexed function once for every index and returns when all have completed.
+//
+// If any call throws, the first exception caught is rethrown from `bulk()`
+// once all calls have finished.
+//
+// Executors which can queue a single task override `post()`, which returns
+// without waiting for the task to run. The default runs it in the calling
+// thread.
+//
+// `concurrency()` is the number of elements the executor can usefully run at
+// once besides the calling thread, which bounds the number of runners a batch
+// is spread over when it is driven through `post()`.
+class executor
+{
+   public:
+    virtual ~executor() = default;
+
+    virtual void bulk(std::size_t n, const std::function<void(std::size_t)>& fn) = 0;
+
+    virtual void post(task t)
+    {
+        bulk(1, [&](std::size_t) { t(); });
+    }
+
+    virtual std::size_t concurrency() const
+    {
+        return std::max<std::size_t>(1, std::thread::hardware_concurrency());
+    }
+};
+
+class thread_pool;
+
+// max_yield_depth
+//
+// Limit on how deeply `yield_point()` calls may nest on one thread.
+inline constexpr int max_yield_depth = 8;
+
+namespace detail
+{
+
+// cooperative_scheduler
+//
+// What `should_yield()` and `yield_point()` need from the executor running the
+// current thread.
+class cooperative_scheduler
+{
+   public:
+    virtual ~cooperative_scheduler() = default;
+
+    // True if there is queued work which no worker has picked up yet.
+    virtual bool has_waiting_work() const = 0;
+
+    virtual std::chrono::nanoseconds time_slice() const = 0;
+
+    // Let waiting work run, then return to the yielding element.
+    virtual void yield_current() = 0;
+};
+
+// worker_context
+//
+// Per-thread state behind `should_yield()` and `yield_point()`.
+struct worker_context
+{
+    // Scheduler whose work this thread is running, if any.
+    cooperative_scheduler* scheduler = nullptr;
+
+    // Time slice of the element currently running on this thread, which
+    // starts at the element's first call to `should_yield()`.
+    bool slice_started = false;
+    std::chrono::steady_clock::time_point slice_start;
+
+    // Number of active `yield_point()` calls on this thread, and the time at
+    // which the innermost one wants control back.
+    int depth = 0;
+    std::chrono::steady_clock::time_point yield_deadline;
+};
+
+// Not inlined, so that the address of the thread-local state is looked up
+// afresh after a call which may have switched a fiber to another thread.
+[[gnu::noinline]] inline worker_context& this_worker()
+{
+    thread_local worker_context w;
+    asm volatile("");
+    return w;
+}
+
+// bulk_state
+//
+// Shared state of one call to `bulk()`. Runners claim chunks of indices until
+// the range is exhausted, so the number of queued tasks is bounded by the
+// number of workers rather than the number of elements.
+//
+// A runner may be dequeued after the call it was submitted for has returned,
+// and by then the pool may have handed the state to a later call. Each call
+// therefore takes a new generation, kept in the top bits of `ticket` next to
+// the next unclaimed index, and a runner claims only through a ticket of its
+// own generation. A stale runner finds the generation moved on and exits
+// without touching the later call. The pool owns its states until it is
+// destroyed, so a `bulk()` call does not allocate once the pool has a spare
+// state.
+struct bulk_state
+{
+    static constexpr int index_bits = 40;
+    static constexpr std::uint64_t index_mask = (std::uint64_t(1) << index_bits) - 1;
+    static constexpr std::uint64_t generation_mask = (std::uint64_t(1) << (64 - index_bits)) - 1;
+
+    explicit bulk_state(thread_pool* pool)
+        : pool(pool)
+    {
+    }
+
+    // Start a new generation for a call over `count` indices, returning it.
+    // The previous call must have completed. The ticket is closed before the
+    // parameters change, so that a stale runner which read the new ones
+    // cannot claim through its old ticket.
+    std::uint64_t reset(std::size_t count, std::size_t chunk, const std::function<void(std::size_t)>& f)
+    {
+        if (count > index_mask / 2) {
+            throw std::invalid_argument("lt::async: too many elements for one bulk() call");
+        }
+
+        auto generation = ((ticket.load(std::memory_order_relaxed) >> index_bits) + 1) & generation_mask;
+        ticket.store((generation << index_bits) | index_mask);
+        n.store(count);
+        grain.store(chunk);
+        fn.store(&f);
+        done.store(0, std::memory_order_relaxed);
+        error = nullptr;
+        ticket.store(generation << index_bits);
+        return generation;
+    }
+
+    // Claim and run chunks of `generation` until none remain. If `may_yield`
+    // is set and this runner was picked up by a `yield_point()` whose slice
+    // has expired, return true early so that the yielding element can resume.
+    bool run(std::uint64_t generation, bool may_yield)
+    {
+        auto& w = this_worker();
+
+        for (;;) {
+            auto t = ticket.load();
+            std::size_t begin = 0;
+            std::size_t count = 0;
+            std::size_t step = 0;
+            const std::function<void(std::size_t)>* f = nullptr;
+            do {
+                if ((t >> index_bits) != generation) {
+                    return false;
+                }
+                begin = static_cast<std::size_t>(t & index_mask);
+                count = n.load();
+                step = grain.load();
+                f = fn.load();
+                if (begin >= count) {
+                    return false;
+                }
+            } while (!ticket.compare_exchange_weak(t, t + step));
+            auto end = std::min(count, begin + step);
+
+            for (auto i = begin; i < end; ++i) {
+                w.slice_started = false;
+                try {
+                    (*f)(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                }
+            }
+
+            if (done.fetch_add(end - begin, std::memory_order_acq_rel) + (end - begin) == count) {
+                done.notify_all();
+            }
+
+            if (may_yield && w.depth > 0 && std::chrono::steady_clock::now() >= w.yield_deadline) {
+                return true;
+            }
+        }
+    }
+
+    // Run as a queued task, requeueing the runner if it yielded early.
+    static void run_queued(bulk_state* self, std::uint64_t generation);
+
+    // Block until every index has completed, then rethrow any exception.
+    void wait()
+    {
+        auto count = n.load(std::memory_order_relaxed);
+        auto d = done.load(std::memory_order_acquire);
+        while (d != count) {
+            done.wait(d, std::memory_order_acquire);
+            d = done.load(std::memory_order_acquire);
+        }
+
+        if (error) {
+            std::rethrow_exception(std::exchange(error, nullptr));
+        }
+    }
+
+    thread_pool* const pool;
+
+    // Generation and next unclaimed index, and the parameters of the current
+    // call. These are sequentially consistent, which is what stops a stale
+    // runner from pairing its ticket with a later call's parameters.
+    alignas(cache_line_size) std::atomic<std::uint64_t> ticket{0};
+    std::atomic<std::size_t> n{0};
+    std::atomic<std::size_t> grain{1};
+    std::atomic<const std::function<void(std::size_t)>*> fn{nullptr};
+
+    alignas(cache_line_size) std::atomic<std::size_t> done{0};
+
+    std::mutex error_mutex;
+    std::exception_ptr error;
+};
+
+// runner_iterator
+//
+// Yields the runner tasks of one `bulk()` call as they are enqueued, so that
+// no vector of them is built first.
+struct runner_iterator
+{
+    task operator*() const
+    {
+        return [s = state, g = generation] { bulk_state::run_queued(s, g); };
+    }
+
+    runner_iterator& operator++()
+    {
+        return *this;
+    }
+
+    bulk_state* state;
+    std::uint64_t generation;
+};
+
+// cpu_quota
+//
+// CPU limit of this process's cgroup, in CPUs, or nothing if it is
+// unlimited. Under cgroup v2 the limit is the smallest `cpu.max` from the
+// process's own cgroup up to the root; under cgroup v1 it is
+// `cpu.cfs_quota_us / cpu.cfs_period_us`.
+inline std::optional<double> cpu_quota(const std::string& root = "/sys/fs/cgroup")
+{
+    auto group = std::string();
+    {
+        auto in = std::ifstream("/proc/self/cgroup");
+        for (std::string line; std::getline(in, line);) {
+            if (line.rfind("0::", 0) == 0) {
+                group = line.substr(3);
+                break;
+            }
+        }
+    }
+
+    auto quota = std::optional<double>();
+    for (;;) {
+        auto in = std::ifstream(root + group + "/cpu.max");
+        auto max = std::string();
+        auto period = 0.0;
+        if (in >> max >> period && max != "max" && period > 0) {
+            auto cpus = std::strtod(max.c_str(), nullptr) / period;
+            if (cpus > 0) {
+                quota = std::min(quota.value_or(cpus), cpus);
+            }
+        }
+
+        auto slash = group.rfind('/');
+        if (group.empty() || slash == std::string::npos) {
+            break;
+        }
+        group.resize(slash);
+    }
+    if (quota) {
+        return quota;
+    }
+
+    auto cfs_quota = std::ifstream(root + "/cpu/cpu.cfs_quota_us");
+    auto cfs_period = std::ifstream(root + "/cpu/cpu.cfs_period_us");
+    auto q = 0.0;
+    auto p = 0.0;
+    if (cfs_quota >> q && cfs_period >> p && q > 0 && p > 0) {
+        return q / p;
+    }
+    return std::nullopt;
+}
+
+} // namespace detail
+
+// worker_start
+//
+// When a `thread_pool` starts its workers: in its constructor, or on first
+// use, which costs nothing for a pool that is never used.
+enum class worker_start
+{
+    eager,
+    lazy,
+};
+
+// thread_pool
+//
+// Fixed-size pool of worker threads fed from a single global injection queue.
+// The injection queue is a bounded lock-free `mpmc_queue`, so submitting and
+// dequeueing work never takes a lock; idle workers spin briefly and then park
+// on an event counter, which submitters only touch when a worker is asleep.
+//
+// `bulk()` enqueues at most one runner task per worker in a single batch
+// enqueue. The calling thread runs the batch alongside the workers, so nested
+// calls from inside an element function always make progress. Batch states
+// are reused by later calls, so once the pool has a spare one `bulk()` does
+// not allocate.
+//
+// If the injection queue is full, `submit()` runs the task in the calling
+// thread.
+//
+// Long-running element functions can share the pool fairly by calling
+// `yield_point()`, which serves waiting work once the element has used up
+// the pool's `time_slice()`.
+//
+// The number of workers can be changed at run time with `resize()`. A pool
+// created with `worker_start::lazy` starts its workers on first use, or when
+// `warm_up()` is called.
+//
+// auto pool = thread_pool(4);
+// pool.bulk(input.size(), [&](std::size_t i) {
+//     output[i] = g(input[i]);
+// });
+class thread_pool final : public executor, private detail::cooperative_scheduler
+{
+   public:
+    explicit thread_pool(std::size_t threads = default_concurrency(),
+                         std::size_t queue_capacity = 4096,
+                         worker_start start = worker_start::eager)
+        : queue_(queue_capacity),
+          size_(threads)
+    {
+        if (start == worker_start::eager) {
+            start_workers();
+        }
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    ~thread_pool() override
+    {
+        stop_.store(true, std::memory_order_seq_cst);
+        epoch_.fetch_add(1, std::memory_order_release);
+        epoch_.notify_all();
+
+        std::lock_guard<std::mutex> lock(resize_mutex_);
+        for (auto && w : workers_) {
+            w.join();
+        }
+
+    }
+
+    // Number of hardware threads, limited by the CPU quota of the process's
+    // cgroup if it has one.
+    static std::size_t default_concurrency()
+    {
+        auto n = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+        if (auto quota = detail::cpu_quota()) {
+            n = std::min(n, std::max<std::size_t>(1, static_cast<std::size_t>(std::ceil(*quota))));
+        }
+        return n;
+    }
+
+    std::size_t size() const
+    {
+        return size_.load(std::memory_order_relaxed);
+    }
+
+    std::size_t concurrency() const override
+    {
+        return size();
+    }
+
+    // Change the number of workers. Added workers start at once, unless the
+    // pool is lazy and has not started yet. Removed workers finish the task
+    // they are running and exit, and `resize()` returns once they have; so it
+    // cannot be called from an element running on a worker being removed.
+    void resize(std::size_t threads)
+    {
+        if (threads == 0) {
+            throw std::invalid_argument("lt::async: a thread_pool needs at least one worker");
+        }
+
+        std::lock_guard<std::mutex> lock(resize_mutex_);
+        if (!started_.load(std::memory_order_relaxed)) {
+            size_.store(threads, std::memory_order_relaxed);
+            return;
+        }
+
+        if (threads >= workers_.size()) {
+            size_.store(threads, std::memory_order_relaxed);
+            add_workers(threads);
+            return;
+        }
+
+        for (auto i = threads; i < workers_.size(); ++i) {
+            if (workers_[i].get_id() == std::this_thread::get_id()) {
+                throw std::logic_error("lt::async: a thread_pool worker cannot remove itself");
+            }
+        }
+
+        size_.store(threads, std::memory_order_seq_cst);
+        epoch_.fetch_add(1, std::memory_order_release);
+        epoch_.notify_all();
+
+        for (auto i = threads; i < workers_.size(); ++i) {
+            workers_[i].join();
+        }
+        workers_.resize(threads);
+    }
+
+    // Start the workers if the pool is lazy, and return once every worker is
+    // running, so that the first call does not pay for thread creation.
+    void warm_up()
+    {
+        ensure_started();
+
+        auto r = running_.load(std::memory_order_acquire);
+        while (r < size()) {
+            running_.wait(r, std::memory_order_acquire);
+            r = running_.load(std::memory_order_acquire);
+        }
+    }
+
+    std::chrono::nanoseconds time_slice() const override
+    {
+        return std::chrono::nanoseconds(time_slice_ns_.load(std::memory_order_relaxed));
+    }
+
+    void set_time_slice(std::chrono::nanoseconds slice)
+    {
+        time_slice_ns_.store(slice.count(), std::memory_order_relaxed);
+    }
+
+    bool has_waiting_work() const override
+    {
+        return !queue_.empty_approx();
+    }
+
+    void submit(task t)
+    {
+        ensure_started();
+        if (!queue_.try_push(std::move(t))) {
+            t();
+            return;
+        }
+        wake(1);
+    }
+
+    void post(task t) override
+    {
+        submit(std::move(t));
+    }
+
+    // Run one queued task on the calling thread, if there is one.
+    bool try_run_one()
+    {
+        task t;
+        if (!queue_.try_pop(t)) {
+            return false;
+        }
+        t();
+        return true;
+    }
+
+    void bulk(std::size_t n, const std::function<void(std::size_t)>& fn) override
+    {
+        if (n == 0) {
+            return;
+        }
+
+        ensure_started();
+        auto runners = std::min(n - 1, size());
+
+        // Chunk the index range so that each runner claims several chunks,
+        // which balances uneven element costs without contending on `next`
+        // for every element.
+        auto grain = std::max<std::size_t>(1, n / ((runners + 1) * 4));
+        auto* state = acquire_state();
+        auto generation = std::uint64_t(0);
+        try {
+            generation = state->reset(n, grain, fn);
+        } catch (...) {
+            recycle(state);
+            throw;
+        }
+
+        if (runners > 0) {
+            wake(queue_.try_push_bulk(detail::runner_iterator{state, generation}, runners));
+        }
+
+        auto& w = detail::this_worker();
+        auto outer = w.scheduler;
+        w.scheduler = this;
+        try {
+            state->run(generation, false);
+            state->wait();
+        } catch (...) {
+            w.scheduler = outer;
+            recycle(state);
+            throw;
+        }
+        w.scheduler = outer;
+        recycle(state);
+    }
+
+   private:
+    // A spare batch state, or a new one owned by the pool until it is
+    // destroyed, since runners of earlier calls may still refer to it.
+    detail::bulk_state* acquire_state()
+    {
+        detail::bulk_state* state = nullptr;
+        if (spare_states_.try_pop(state)) {
+            return state;
+        }
+
+        std::lock_guard<std::mutex> lock(states_mutex_);
+        states_.push_back(std::make_unique<detail::bulk_state>(this));
+        return states_.back().get();
+    }
+
+    // Make a finished call's state available to later calls. If the spare
+    // queue is full the state is simply not reused.
+    void recycle(detail::bulk_state* state)
+    {
+        spare_states_.try_push(state);
+    }
+
+    // Serve queued tasks on this thread for up to one time slice. The
+    // yielding element's frame stays on the stack underneath them, along
+    // with any locks it holds.
+    void yield_current() override
+    {
+        auto& w = detail::this_worker();
+        if (w.depth >= max_yield_depth) {
+            return;
+        }
+
+        auto outer_deadline = w.yield_deadline;
+        auto restore = [&] {
+            --w.depth;
+            w.scheduler = this;
+            w.yield_deadline = outer_deadline;
+            w.slice_started = true;
+            w.slice_start = std::chrono::steady_clock::now();
+        };
+
+        ++w.depth;
+        w.yield_deadline = std::chrono::steady_clock::now() + time_slice();
+        try {
+            while (std::chrono::steady_clock::now() < w.yield_deadline && try_run_one()) {
+            }
+        } catch (...) {
+            restore();
+            throw;
+        }
+        restore();
+    }
+
+    void ensure_started()
+    {
+        if (!started_.load(std::memory_order_acquire)) {
+            start_workers();
+        }
+    }
+
+    void start_workers()
+    {
+        std::lock_guard<std::mutex> lock(resize_mutex_);
+        if (started_.load(std::memory_order_relaxed)) {
+            return;
+        }
+        add_workers(size_.load(std::memory_order_relaxed));
+        started_.store(true, std::memory_order_release);
+    }
+
+    // Called with `resize_mutex_` held.
+    void add_workers(std::size_t threads)
+    {
+        workers_.reserve(threads);
+        for (auto i = workers_.size(); i < threads; ++i) {
+            workers_.emplace_back([this, i] { worker_loop(i); });
+        }
+    }
+
+    // True if worker `index` has been removed by `resize()`.
+    bool retired(std::size_t index) const
+    {
+        return index >= size_.load(std::memory_order_relaxed);
+    }
+
+    void worker_loop(std::size_t index)
+    {
+        constexpr int spin_limit = 64;
+        task t;
+
+        detail::this_worker().scheduler = this;
+        running_.fetch_add(1, std::memory_order_release);
+        running_.notify_all();
+
+        for (;;) {
+            if (retired(index)) {
+                break;
+            }
+
+            if (queue_.try_pop(t)) {
+                t();
+                t = nullptr;
+                continue;
+            }
+
+            auto spins = 0;
+            while (spins < spin_limit && queue_.empty_approx() && !stop_.load(std::memory_order_relaxed)) {
+                std::this_thread::yield();
+                ++spins;
+            }
+            if (spins < spin_limit) {
+                if (stop_.load(std::memory_order_relaxed) && queue_.empty_approx()) {
+                    break;
+                }
+                continue;
+            }
+
+            auto e = epoch_.load(std::memory_order_acquire);
+            sleepers_.fetch_add(1, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            if (queue_.empty_approx() && !stop_.load(std::memory_order_relaxed) && !retired(index)) {
+                epoch_.wait(e, std::memory_order_acquire);
+            }
+            sleepers_.fetch_sub(1, std::memory_order_relaxed);
+
+            if (stop_.load(std::memory_order_relaxed) && queue_.empty_approx()) {
+                break;
+            }
+        }
+
+        running_.fetch_sub(1, std::memory_order_relaxed);
+
+        // A wakeup meant for the remaining workers may have been consumed by
+        // this one as it retired.
+        if (!queue_.empty_approx()) {
+            wake(1);
+        }
+    }
+
+    void wake(std::size_t n)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (n == 0 || sleepers_.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+
+        epoch_.fetch_add(1, std::memory_order_release);
+        if (n == 1) {
+            epoch_.notify_one();
+        } else {
+            epoch_.notify_all();
+        }
+    }
+
+    mpmc_queue<task> queue_;
+
+    // Every batch state made by `bulk()`, and those not in use by a call.
+    std::mutex states_mutex_;
+    std::vector<std::unique_ptr<detail::bulk_state>> states_;
+    mpmc_queue<detail::bulk_state*> spare_states_{256};
+
+    std::mutex resize_mutex_;
+    std::vector<std::thread> workers_;
+    std::atomic<std::size_t> size_;
+    std::atomic<bool> started_{false};
+    std::atomic<std::size_t> running_{0};
+
+    std::atomic<bool> stop_{false};
+    std::atomic<std::int64_t> time_slice_ns_{std::chrono::nanoseconds(std::chrono::milliseconds(10)).count()};
+    alignas(cache_line_size) std::atomic<std::uint32_t> epoch_{0};
+    alignas(cache_line_size) std::atomic<std::uint32_t> sleepers_{0};
+};
+
+inline void detail::bulk_state::run_queued(bulk_state* self, std::uint64_t generation)
+{
+    if (self->run(generation, true)) {
+        self->pool->submit([self, generation] { run_queued(self, generation); });
+    }
+}
+
+// should_yield
+//
+// For use by long-running element functions. Returns true if the calling
+// thread is running pool work, other work is waiting in the pool's queue, and
+// the current element has used up its time slice. The slice starts at the
+// element's first call to `should_yield()`, so call it regularly.
+inline bool should_yield()
+{
+    auto& w = detail::this_worker();
+    if (w.scheduler == nullptr || !w.scheduler->has_waiting_work()) {
+        return false;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (!w.slice_started) {
+        w.slice_started = true;
+        w.slice_start = now;
+        return false;
+    }
+
+    return now - w.slice_start >= w.scheduler->time_slice();
+}
+
+// yield_point
+//
+// Cooperative yield for long-running element functions. If `should_yield()`,
+// the executor lets waiting work run before the element continues with a
+// fresh slice. On a `thread_pool` the waiting work runs on this thread for up
+// to one time slice, with the element's frame left on the stack underneath
+// it, so yields nest at most `max_yield_depth` deep; beyond that
+// `yield_point()` returns immediately.
+//
+// Because the waiting work runs on the yielding element's own thread and
+// stack, `yield_point()` must not be called while holding a lock: a task
+// which takes the same lock would deadlock, or with a recursive lock enter
+// the critical section a second time.
+//
+// auto f = [&](const input_type& i) {
+//     for (auto && chunk : split(i)) {
+//         ... process(chunk);
+//         lt::async::yield_point();
+//     }
+//     return o;
+// };
+inline void yield_point()
+{
+    if (should_yield()) {
+        detail::this_worker().scheduler->yield_current();
+    }
+}
+
+// default_executor
+//
+// Process-wide thread pool shared by every `async` which is not given an
+// executor, so that components using the library do not each start their own
+// threads. It is sized by `default_concurrency()` and starts its workers on
+// first use; call `warm_up()` on it at startup to move that cost out of the
+// first call.
+inline thread_pool& default_executor()
+{
+    static thread_pool pool(thread_pool::default_concurrency(), 4096, worker_start::lazy);
+    return pool;
+}
+
+// resize_default_executor
+//
+// Re-read the cgroup CPU quota and resize `default_executor()` to match,
+// returning its new size. Call it when the quota may have changed.
+inline std::size_t resize_default_executor()
+{
+    auto n = thread_pool::default_concurrency();
+    default_executor().resize(n);
+    return n;
+}
+
+} // namespace lt::async
@@ -0,0 +1,1115 @@
+#pragma once
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "lt/async/alloc-stats.h"
+#include "lt/async/executor.h"
+#include "lt/async/mpmc-queue.h"
+#include "lt/async/trace.h"
+
+namespace lt::async
+{
+
+// timer_source
+//
+// Calls a function at a deadline on the steady clock, from a thread of its
+// own. A `fiber_pool` given one by `set_timer_source()` times there the sleeps
+// and condition variable waits of `LT_ASYNC_DEFINE_FIBER_WAITS`, such as the
+// delays between `lt::retry` attempts, instead of on its carrier threads. A
+// `reactor` is one, timed by its timerfd.
+class timer_source
+{
+   public:
+    // Call `done` at `deadline`. Returns an id which can be passed to
+    // `cancel_timer()`.
+    virtual std::uint64_t async_sleep_until(std::chrono::steady_clock::time_point deadline,
+                                            std::function<void()> done) = 0;
+
+    // Cancel a timer without calling its callback. Returns false if it has
+    // already fired, in which case its callback may still be running.
+    virtual bool cancel_timer(std::uint64_t id) = 0;
+
+   protected:
+    ~timer_source() = default;
+};
+
+namespace detail
+{
+
+struct fiber;
+
+// fiber_host
+//
+// Scheduler which owns fibers and resumes them once they are ready, and
+// whose clock `this_fiber::sleep_for()` measures against.
+class fiber_host
+{
+   public:
+    // Queue a suspended fiber to be resumed.
+    virtual void make_ready(fiber* f) = 0;
+
+    virtual std::chrono::steady_clock::time_point now() const
+    {
+        return std::chrono::steady_clock::now();
+    }
+
+    // Wait on `cond` as by `pthread_cond_clockwait()`, releasing `mutex`
+    // while the calling fiber is suspended, until `notify_waiter()` ends the
+    // wait or `deadline` passes on this host's clock. Returns 0 or ETIMEDOUT.
+    // Used by `LT_ASYNC_DEFINE_FIBER_WAITS`.
+    virtual int wait_on(pthread_cond_t* cond, pthread_mutex_t* mutex,
+                        std::chrono::steady_clock::time_point deadline) = 0;
+
+    // Wake the fiber waiting as `id` on a condition variable, if it still is.
+    // Returns false if the wait had already ended.
+    virtual bool notify_waiter(fiber* f, std::uint64_t id) = 0;
+
+    // Where `LT_ASYNC_DEFINE_FIBER_WAITS` times sleeps and waits, or null to
+    // time them on this host.
+    virtual timer_source* timers() const
+    {
+        return nullptr;
+    }
+
+   protected:
+    ~fiber_host() = default;
+};
+
+// fiber_stack
+//
+// Stack memory for one fiber, mapped with an inaccessible guard page below it
+// so that a stack overflow faults instead of corrupting a neighbour. Pages are
+// only committed as the fiber touches them.
+class fiber_stack
+{
+   public:
+    explicit fiber_stack(std::size_t size)
+    {
+        guard_ = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        size_ = (size + guard_ - 1) / guard_ * guard_;
+
+        base_ = mmap(nullptr, size_ + guard_, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (base_ == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+
+        if (mprotect(base_, guard_, PROT_NONE) != 0) {
+            munmap(base_, size_ + guard_);
+            throw std::bad_alloc();
+        }
+    }
+
+    fiber_stack(const fiber_stack&) = delete;
+    fiber_stack& operator=(const fiber_stack&) = delete;
+
+    ~fiber_stack()
+    {
+        munmap(base_, size_ + guard_);
+    }
+
+    void* bottom() const
+    {
+        return static_cast<char*>(base_) + guard_;
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+   private:
+    void* base_;
+    std::size_t size_;
+    std::size_t guard_;
+};
+
+// fiber
+//
+// A user-mode thread of execution. Fibers are pooled: once a fiber's job has
+// finished it returns to its pool's free list, keeping its stack, and is
+// reused for a later job.
+struct fiber
+{
+    // Wake-up handshake between `park()` and `unpark()`, which ensures a
+    // parked fiber is made ready exactly once however many wakers race.
+    enum wake_state : int
+    {
+        running,
+        parked,
+        notified,
+    };
+
+    fiber(fiber_host* pool, std::size_t stack_size);
+
+    ucontext_t context;
+    fiber_stack stack;
+    fiber_host* const pool;
+
+    task job;
+    std::atomic<int> state{running};
+
+    // Id of the condition variable wait this fiber is in on a `fiber_pool`,
+    // or 0. Whoever changes it back to 0 ends the wait.
+    std::atomic<std::uint64_t> cond_wait{0};
+};
+
+// What a fiber asked its carrier thread to do with it after switching out.
+enum class switch_action
+{
+    none,
+    yield,
+    sleep,
+    park,
+    finish,
+};
+
+// carrier_context
+//
+// Per-thread state of a thread which runs fibers.
+struct carrier_context
+{
+    ucontext_t context;
+    fiber* current = nullptr;
+
+    switch_action action = switch_action::none;
+    std::chrono::steady_clock::time_point wake_at;
+};
+
+// Not inlined, for the same reason as `this_worker()`: a fiber may resume on a
+// different thread than the one it suspended on.
+[[gnu::noinline]] inline carrier_context& this_carrier()
+{
+    thread_local carrier_context c;
+    asm volatile("");
+    return c;
+}
+
+// Switch from the current fiber back to its carrier thread, which carries out
+// `action` once the fiber's context has been saved. The fiber's trace context
+// and allocation counting scope are taken off the carrier while it is
+// suspended and put back on whichever thread resumes it.
+inline void suspend(switch_action action, std::chrono::steady_clock::time_point wake_at = {})
+{
+    auto trace = std::exchange(current_trace(), trace_context{});
+    auto allocations = std::exchange(this_thread_allocations().sink, nullptr);
+    auto& c = this_carrier();
+    auto* f = c.current;
+    c.action = action;
+    c.wake_at = wake_at;
+    swapcontext(&f->context, &c.context);
+    this_thread_allocations().sink = allocations;
+    current_trace() = trace;
+}
+
+// Suspend the current fiber until another thread calls `unpark()` on it.
+// Wake-ups may be spurious, so callers park in a loop around their condition.
+inline void park()
+{
+    auto* f = this_carrier().current;
+    suspend(switch_action::park, std::chrono::steady_clock::time_point::max());
+    f->state.store(fiber::running, std::memory_order_release);
+}
+
+inline void unpark(fiber* f);
+
+inline void fiber_entry(std::uint32_t hi, std::uint32_t lo)
+{
+    auto* f = reinterpret_cast<fiber*>((static_cast<std::uintptr_t>(hi) << 32) | lo);
+
+    for (;;) {
+        try {
+            f->job();
+        } catch (...) {
+            std::terminate();
+        }
+        f->job = nullptr;
+        suspend(switch_action::finish);
+    }
+}
+
+inline fiber::fiber(fiber_host* pool, std::size_t stack_size)
+    : stack(stack_size), pool(pool)
+{
+    getcontext(&context);
+    context.uc_stack.ss_sp = stack.bottom();
+    context.uc_stack.ss_size = stack.size();
+    context.uc_link = nullptr;
+
+    auto p = reinterpret_cast<std::uintptr_t>(this);
+    makecontext(&context, reinterpret_cast<void (*)()>(&fiber_entry), 2,
+                static_cast<std::uint32_t>(p >> 32), static_cast<std::uint32_t>(p));
+}
+
+// fiber_batch
+//
+// Shared state of one call to `fiber_pool::bulk()`. Each runner fiber claims
+// one index at a time, so a suspended element holds up only itself.
+struct fiber_batch
+{
+    fiber_batch(std::size_t n, const std::function<void(std::size_t)>& fn)
+        : n(n), fn(&fn)
+    {
+    }
+
+    void run()
+    {
+        for (;;) {
+            auto i = next.fetch_add(1, std::memory_order_relaxed);
+            if (i >= n) {
+                return;
+            }
+
+            this_worker().slice_started = false;
+            try {
+                (*fn)(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+
+            if (done.fetch_add(1, std::memory_order_seq_cst) + 1 == n) {
+                done.notify_all();
+                if (auto* w = waiter.load(std::memory_order_seq_cst)) {
+                    unpark(w);
+                }
+            }
+        }
+    }
+
+    // Wait for every index to complete, then rethrow any exception. A waiting
+    // fiber parks rather than blocking its carrier thread.
+    void wait()
+    {
+        if (auto* self = this_carrier().current) {
+            waiter.store(self, std::memory_order_seq_cst);
+            while (done.load(std::memory_order_seq_cst) != n) {
+                park();
+            }
+        } else {
+            auto d = done.load(std::memory_order_acquire);
+            while (d != n) {
+                done.wait(d, std::memory_order_acquire);
+                d = done.load(std::memory_order_acquire);
+            }
+        }
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    const std::size_t n;
+    const std::function<void(std::size_t)>* fn;
+
+    alignas(cache_line_size) std::atomic<std::size_t> next{0};
+    alignas(cache_line_size) std::atomic<std::size_t> done{0};
+    std::atomic<fiber*> waiter{nullptr};
+
+    std::mutex error_mutex;
+    std::exception_ptr error;
+};
+
+// fiber_cond_waits
+//
+// Fibers waiting on a condition variable through `LT_ASYNC_DEFINE_FIBER_WAITS`,
+// by condition variable, in the order they started waiting. A fiber whose
+// wait times out removes its own entry.
+struct fiber_cond_waits
+{
+    struct waiter
+    {
+        fiber_host* host;
+        fiber* f;
+        std::uint64_t id;
+    };
+
+    std::mutex mutex;
+    std::unordered_map<const void*, std::deque<waiter>> waiters;
+    std::atomic<std::size_t> count{0};
+
+    static fiber_cond_waits& instance()
+    {
+        static fiber_cond_waits w;
+        return w;
+    }
+
+    void add(const void* cond, fiber_host* host, fiber* f, std::uint64_t id)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        waiters[cond].push_back({host, f, id});
+        count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Remove the entry of the wait `id` by `f` on `cond`, if a notification
+    // has not already taken it.
+    void remove(const void* cond, fiber* f, std::uint64_t id)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = waiters.find(cond);
+        if (it == waiters.end()) {
+            return;
+        }
+        auto& queue = it->second;
+        auto w = std::find_if(queue.begin(), queue.end(), [&](const waiter& e) { return e.f == f && e.id == id; });
+        if (w == queue.end()) {
+            return;
+        }
+        queue.erase(w);
+        count.fetch_sub(1, std::memory_order_relaxed);
+        if (queue.empty()) {
+            waiters.erase(it);
+        }
+    }
+};
+
+// Wake fibers waiting on `cond`: one, or all if `all` is set.
+inline void notify_fibers(const void* cond, bool all)
+{
+    auto& waits = fiber_cond_waits::instance();
+    if (waits.count.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+
+    // Waking a fiber notifies its host's idle carriers, which comes back
+    // here with nothing to do.
+    thread_local bool notifying = false;
+    if (notifying) {
+        return;
+    }
+    notifying = true;
+
+    {
+        std::lock_guard<std::mutex> lock(waits.mutex);
+        if (auto it = waits.waiters.find(cond); it != waits.waiters.end()) {
+            auto& queue = it->second;
+            while (!queue.empty()) {
+                auto w = queue.front();
+                queue.pop_front();
+                waits.count.fetch_sub(1, std::memory_order_relaxed);
+                if (w.host->notify_waiter(w.f, w.id) && !all) {
+                    break;
+                }
+            }
+            if (queue.empty()) {
+                waits.waiters.erase(it);
+            }
+        }
+    }
+
+    notifying = false;
+}
+
+inline std::chrono::nanoseconds to_duration(const timespec& ts)
+{
+    return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+}
+
+// Convert a deadline on `clock` to the clock of the calling fiber's host.
+// `CLOCK_MONOTONIC` is taken to be the host's clock already, as it is read
+// through `clock_gettime()`.
+inline std::chrono::steady_clock::time_point fiber_deadline(clockid_t clock, const timespec& abstime)
+{
+    if (clock == CLOCK_MONOTONIC) {
+        return std::chrono::steady_clock::time_point(
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(to_duration(abstime)));
+    }
+
+    auto now = timespec();
+    syscall(SYS_clock_gettime, clock, &now);
+    return this_carrier().current->pool->now()
+        + std::chrono::duration_cast<std::chrono::steady_clock::duration>(to_duration(abstime) - to_duration(now));
+}
+
+inline void fiber_sleep_until(std::chrono::steady_clock::time_point deadline);
+
+template <typename F>
+F next_symbol(const char* name)
+{
+    return reinterpret_cast<F>(dlsym(RTLD_NEXT, name));
+}
+
+} // namespace detail
+
+// fiber_pool
+//
+// Executor which runs each element on a stackful fiber, multiplexed over a
+// few carrier threads. Blocking points that know about fibers, namely
+// `this_fiber::sleep_for()`, `this_fiber::yield()`, `yield_point()` and
+// waiting for a nested `bulk()`, switch to another fiber instead of blocking
+// the carrier thread, so a large batch of mostly-waiting elements can run on a
+// handful of threads.
+//
+// Fibers and their stacks are pooled and reused. Each stack is
+// `stack_size` bytes with a guard page below it; element functions which need
+// deep stacks should use a larger size. Each batch runs on at most
+// `max_batch_fibers` fibers, which bounds the number of stacks it can hold at
+// once.
+//
+// Blocking system calls and blocking waits inside other libraries block the
+// carrier thread, unless the program defines `LT_ASYNC_DEFINE_FIBER_WAITS`:
+// then sleeps such as `std::this_thread::sleep_for()` and waits on a
+// `std::condition_variable` suspend only the calling fiber. That covers the
+// delays between retries inside `lt::retry`, including the condition variable
+// wait of a preemptible retry, so retrying elements need no changes to run
+// many to a carrier. Mutexes and I/O still block the carrier.
+//
+// auto fibers = fiber_pool(4);
+// auto tasks = async<input_type, output_type>(fibers);
+// auto f = [&](const input_type& i) {
+//     ...
+//     lt::async::this_fiber::sleep_for(10ms);
+//     ...
+//     return o;
+// };
+// auto output = tasks.map_concurrently(f, input);
+class fiber_pool final : public executor, public detail::fiber_host, private detail::cooperative_scheduler
+{
+   public:
+    explicit fiber_pool(std::size_t threads = thread_pool::default_concurrency(),
+                        std::size_t stack_size = 64 * 1024,
+                        std::size_t max_batch_fibers = 10000)
+        : stack_size_(stack_size),
+          max_batch_fibers_(std::max<std::size_t>(1, max_batch_fibers)),
+          ready_(std::max<std::size_t>(4096, 2 * max_batch_fibers))
+    {
+        carriers_.reserve(threads);
+        for (std::size_t i = 0; i < std::max<std::size_t>(1, threads); ++i) {
+            carriers_.emplace_back([this] { carrier_loop(); });
+        }
+    }
+
+    fiber_pool(const fiber_pool&) = delete;
+    fiber_pool& operator=(const fiber_pool&) = delete;
+
+    ~fiber_pool() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_.store(true, std::memory_order_seq_cst);
+        }
+        cv_.notify_all();
+
+        for (auto && c : carriers_) {
+            c.join();
+        }
+    }
+
+    std::size_t size() const
+    {
+        return carriers_.size();
+    }
+
+    std::size_t stack_size() const
+    {
+        return stack_size_;
+    }
+
+    // Elements run on fibers, so a batch may spread over as many as it is
+    // allowed.
+    std::size_t concurrency() const override
+    {
+        return max_batch_fibers_;
+    }
+
+    std::chrono::nanoseconds time_slice() const override
+    {
+        return std::chrono::nanoseconds(time_slice_ns_.load(std::memory_order_relaxed));
+    }
+
+    void set_time_slice(std::chrono::nanoseconds slice)
+    {
+        time_slice_ns_.store(slice.count(), std::memory_order_relaxed);
+    }
+
+    bool has_waiting_work() const override
+    {
+        return !ready_empty();
+    }
+
+    // Run `t` on a fiber of this pool. `t` must not throw.
+    void spawn(task t)
+    {
+        auto* f = acquire_fiber();
+        f->job = std::move(t);
+        make_ready(f);
+    }
+
+    void post(task t) override
+    {
+        spawn(std::move(t));
+    }
+
+    void bulk(std::size_t n, const std::function<void(std::size_t)>& fn) override
+    {
+        if (n == 0) {
+            return;
+        }
+
+        auto batch = std::make_shared<detail::fiber_batch>(n, fn);
+        auto runners = std::min(n, max_batch_fibers_);
+        for (std::size_t i = 0; i < runners; ++i) {
+            spawn([batch] { batch->run(); });
+        }
+
+        batch->wait();
+    }
+
+    // Queue a suspended fiber to be resumed by a carrier thread. If the ready
+    // queue is full, the fiber goes on the overflow list instead, which
+    // carriers drain first.
+    void make_ready(detail::fiber* f) override
+    {
+        if (!ready_.try_push(f)) {
+            std::lock_guard<std::mutex> lock(overflow_mutex_);
+            overflow_.push_back(f);
+            overflow_count_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Notified after unlocking, so that a condition variable notify never
+        // runs under `mutex_`; see `notify_fibers()`. Taking the lock is
+        // enough to order this with a carrier about to wait.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers_.load(std::memory_order_relaxed) > 0) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+            }
+            cv_.notify_one();
+        }
+    }
+
+    int wait_on(pthread_cond_t* cond, pthread_mutex_t* mutex, std::chrono::steady_clock::time_point deadline) override
+    {
+        auto* self = detail::this_carrier().current;
+        auto id = next_wait_.fetch_add(1, std::memory_order_relaxed) + 1;
+        self->cond_wait.store(id, std::memory_order_release);
+        detail::fiber_cond_waits::instance().add(cond, this, self, id);
+
+        pthread_mutex_unlock(mutex);
+
+        // With a timer source, the timeout unparks the fiber from there and
+        // the fiber parks untimed.
+        auto* source = deadline != std::chrono::steady_clock::time_point::max() ? timers() : nullptr;
+        auto alarm = std::shared_ptr<std::atomic<bool>>();
+        auto alarm_id = std::uint64_t(0);
+        if (source != nullptr) {
+            alarm = std::make_shared<std::atomic<bool>>(false);
+            alarm_id = source->async_sleep_until(deadline, [self, id, alarm] {
+                if (self->cond_wait.load(std::memory_order_acquire) == id) {
+                    detail::unpark(self);
+                }
+                alarm->store(true, std::memory_order_release);
+            });
+        }
+        auto park_until = source != nullptr ? std::chrono::steady_clock::time_point::max() : deadline;
+
+        while (self->cond_wait.load(std::memory_order_acquire) == id && std::chrono::steady_clock::now() < deadline) {
+            detail::suspend(detail::switch_action::park, park_until);
+            self->state.store(detail::fiber::running, std::memory_order_release);
+        }
+        auto expected = id;
+        auto timed_out = self->cond_wait.compare_exchange_strong(expected, 0, std::memory_order_acq_rel);
+        detail::fiber_cond_waits::instance().remove(cond, self, id);
+
+        // A timeout which has already fired still refers to this fiber, so
+        // wait for it to finish before the fiber can be reused or destroyed.
+        if (source != nullptr && !source->cancel_timer(alarm_id)) {
+            while (!alarm->load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+        }
+        pthread_mutex_lock(mutex);
+
+        return timed_out ? ETIMEDOUT : 0;
+    }
+
+    bool notify_waiter(detail::fiber* f, std::uint64_t id) override
+    {
+        if (!f->cond_wait.compare_exchange_strong(id, 0, std::memory_order_acq_rel)) {
+            return false;
+        }
+        detail::unpark(f);
+        return true;
+    }
+
+    timer_source* timers() const override
+    {
+        return timer_source_.load(std::memory_order_acquire);
+    }
+
+    // Time the sleeps and condition variable waits of
+    // `LT_ASYNC_DEFINE_FIBER_WAITS` on `source`, or on the carrier threads if
+    // it is null. `source` must outlive the pool's use of it.
+    //
+    // fibers.set_timer_source(&lt::async::default_reactor());
+    void set_timer_source(timer_source* source)
+    {
+        timer_source_.store(source, std::memory_order_release);
+    }
+
+   private:
+    // A sleeping fiber, with `wait` 0, is made ready when its timer expires.
+    // A fiber in condition variable wait `wait` is unparked, if it is still
+    // in that wait, since a notify may have woken it first.
+    struct timer
+    {
+        std::chrono::steady_clock::time_point deadline;
+        detail::fiber* f;
+        std::uint64_t wait;
+
+        // True once the wait which set the timer has ended.
+        bool stale() const
+        {
+            return wait != 0 && f->cond_wait.load(std::memory_order_acquire) != wait;
+        }
+
+        bool operator>(const timer& other) const
+        {
+            return deadline > other.deadline;
+        }
+    };
+
+    bool ready_empty() const
+    {
+        return ready_.empty_approx() && overflow_count_.load(std::memory_order_relaxed) == 0;
+    }
+
+    // Take the next fiber to run, oldest first: fibers which overflowed the
+    // ready queue have waited longest.
+    bool pop_ready(detail::fiber*& f)
+    {
+        if (overflow_count_.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard<std::mutex> lock(overflow_mutex_);
+            if (!overflow_.empty()) {
+                f = overflow_.front();
+                overflow_.pop_front();
+                overflow_count_.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return ready_.try_pop(f);
+    }
+
+    void yield_current() override
+    {
+        if (detail::this_carrier().current != nullptr) {
+            detail::suspend(detail::switch_action::yield);
+        }
+    }
+
+    detail::fiber* acquire_fiber()
+    {
+        std::lock_guard<std::mutex> lock(free_mutex_);
+        if (!free_.empty()) {
+            auto* f = free_.back();
+            free_.pop_back();
+            return f;
+        }
+
+        fibers_.push_back(std::make_unique<detail::fiber>(this, stack_size_));
+        return fibers_.back().get();
+    }
+
+    void release_fiber(detail::fiber* f)
+    {
+        std::lock_guard<std::mutex> lock(free_mutex_);
+        free_.push_back(f);
+    }
+
+    void add_timer(std::chrono::steady_clock::time_point deadline, detail::fiber* f, std::uint64_t wait)
+    {
+        auto earliest = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            earliest = timers_.empty() || deadline < timers_.top().deadline;
+            timers_.push({deadline, f, wait});
+            timer_count_.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (earliest) {
+            cv_.notify_one();
+        }
+    }
+
+    void fire_timers()
+    {
+        auto expired = std::vector<timer>();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto now = std::chrono::steady_clock::now();
+            while (!timers_.empty() && timers_.top().deadline <= now) {
+                expired.push_back(timers_.top());
+                timers_.pop();
+            }
+            timer_count_.fetch_sub(expired.size(), std::memory_order_relaxed);
+        }
+
+        for (auto && t : expired) {
+            if (t.wait == 0) {
+                make_ready(t.f);
+            } else if (!t.stale()) {
+                detail::unpark(t.f);
+            }
+        }
+    }
+
+    // Drop the timers of condition variable waits which have already ended,
+    // so that stopping does not wait for their deadlines. Called with
+    // `mutex_` held.
+    void drop_stale_timers()
+    {
+        auto live = std::vector<timer>();
+        while (!timers_.empty()) {
+            if (!timers_.top().stale()) {
+                live.push_back(timers_.top());
+            }
+            timers_.pop();
+        }
+        timer_count_.store(live.size(), std::memory_order_relaxed);
+        for (auto && t : live) {
+            timers_.push(t);
+        }
+    }
+
+    // Switch into `f` and, once it switches back, do what it asked.
+    void run_fiber(detail::fiber* f)
+    {
+        auto& c = detail::this_carrier();
+        c.current = f;
+        c.action = detail::switch_action::none;
+        detail::this_worker().slice_started = false;
+
+        swapcontext(&c.context, &f->context);
+        c.current = nullptr;
+
+        switch (c.action) {
+            case detail::switch_action::yield:
+                make_ready(f);
+                break;
+            case detail::switch_action::sleep:
+                add_timer(c.wake_at, f, 0);
+                break;
+            case detail::switch_action::park: {
+                // A timed park is a condition variable wait, unless a notify
+                // has already ended it.
+                if (c.wake_at != std::chrono::steady_clock::time_point::max()) {
+                    if (auto wait = f->cond_wait.load(std::memory_order_acquire)) {
+                        add_timer(c.wake_at, f, wait);
+                    }
+                }
+                auto expected = int(detail::fiber::running);
+                if (!f->state.compare_exchange_strong(expected, detail::fiber::parked, std::memory_order_acq_rel)) {
+                    // Woken between deciding to park and switching out.
+                    f->state.store(detail::fiber::running, std::memory_order_relaxed);
+                    make_ready(f);
+                }
+                break;
+            }
+            case detail::switch_action::finish:
+                release_fiber(f);
+                break;
+            case detail::switch_action::none:
+                break;
+        }
+    }
+
+    void carrier_loop()
+    {
+        detail::this_worker().scheduler = this;
+        detail::fiber* f = nullptr;
+
+        for (;;) {
+            if (timer_count_.load(std::memory_order_relaxed) > 0) {
+                fire_timers();
+            }
+
+            if (pop_ready(f)) {
+                run_fiber(f);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            sleepers_.fetch_add(1, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            if (ready_empty()) {
+                if (stop_.load(std::memory_order_relaxed)) {
+                    drop_stale_timers();
+                }
+                if (stop_.load(std::memory_order_relaxed) && timers_.empty()) {
+                    sleepers_.fetch_sub(1, std::memory_order_relaxed);
+                    return;
+                }
+
+                if (timers_.empty()) {
+                    cv_.wait(lock);
+                } else {
+                    // Copy the deadline: `wait_until` reads it again after
+                    // relocking, by which time another thread may have grown
+                    // the heap and moved its elements.
+                    auto deadline = timers_.top().deadline;
+                    cv_.wait_until(lock, deadline);
+                }
+            }
+            sleepers_.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    const std::size_t stack_size_;
+    const std::size_t max_batch_fibers_;
+
+    mpmc_queue<detail::fiber*> ready_;
+    std::vector<std::thread> carriers_;
+
+    // Fibers made ready while `ready_` was full.
+    std::mutex overflow_mutex_;
+    std::deque<detail::fiber*> overflow_;
+    std::atomic<std::size_t> overflow_count_{0};
+
+    std::mutex free_mutex_;
+    std::vector<std::unique_ptr<detail::fiber>> fibers_;
+    std::vector<detail::fiber*> free_;
+
+    // Guards the timers and parks idle carriers.
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::priority_queue<timer, std::vector<timer>, std::greater<timer>> timers_;
+    std::atomic<std::size_t> timer_count_{0};
+
+    std::atomic<std::uint64_t> next_wait_{0};
+    std::atomic<timer_source*> timer_source_{nullptr};
+    std::atomic<bool> stop_{false};
+    std::atomic<std::int64_t> time_slice_ns_{std::chrono::nanoseconds(std::chrono::milliseconds(10)).count()};
+    alignas(cache_line_size) std::atomic<std::uint32_t> sleepers_{0};
+};
+
+inline void detail::unpark(fiber* f)
+{
+    if (f->state.exchange(fiber::notified, std::memory_order_acq_rel) == fiber::parked) {
+        f->pool->make_ready(f);
+    }
+}
+
+namespace detail
+{
+
+// event
+//
+// One-shot event with a single waiter, which may be a thread or a fiber. A
+// waiting fiber parks instead of blocking its carrier thread. Share it through
+// a `std::shared_ptr` when `set()` may run after the waiter has returned.
+class event
+{
+   public:
+    void set()
+    {
+        done_.store(true, std::memory_order_seq_cst);
+        if (auto* f = waiter_.load(std::memory_order_seq_cst)) {
+            unpark(f);
+        } else {
+            done_.notify_all();
+        }
+    }
+
+    bool is_set() const
+    {
+        return done_.load(std::memory_order_acquire);
+    }
+
+    void wait()
+    {
+        if (auto* self = this_carrier().current) {
+            waiter_.store(self, std::memory_order_seq_cst);
+            while (!done_.load(std::memory_order_seq_cst)) {
+                park();
+            }
+        } else {
+            while (!done_.load(std::memory_order_acquire)) {
+                done_.wait(false, std::memory_order_acquire);
+            }
+        }
+    }
+
+   private:
+    std::atomic<bool> done_{false};
+    std::atomic<fiber*> waiter_{nullptr};
+};
+
+// Suspend the calling fiber until `deadline` on its host's clock, timed by
+// the host's `timer_source` if it has one.
+inline void fiber_sleep_until(std::chrono::steady_clock::time_point deadline)
+{
+    if (auto* timers = this_carrier().current->pool->timers()) {
+        auto ready = std::make_shared<event>();
+        timers->async_sleep_until(deadline, [ready] { ready->set(); });
+        ready->wait();
+        return;
+    }
+    suspend(switch_action::sleep, deadline);
+}
+
+} // namespace detail
+
+namespace this_fiber
+{
+
+// True if the calling code is running on a fiber.
+inline bool on_fiber()
+{
+    return detail::this_carrier().current != nullptr;
+}
+
+// Let other ready fibers run. Outside a fiber, yields the thread.
+inline void yield()
+{
+    if (on_fiber()) {
+        detail::suspend(detail::switch_action::yield);
+    } else {
+        std::this_thread::yield();
+    }
+}
+
+// Suspend the current fiber until `deadline`, leaving its carrier thread free
+// to run other fibers. Outside a fiber, sleeps the thread.
+template <typename Clock, typename Duration>
+void sleep_until(const std::chrono::time_point<Clock, Duration>& deadline)
+{
+    if (!on_fiber()) {
+        std::this_thread::sleep_until(deadline);
+        return;
+    }
+
+    auto wake_at = detail::this_carrier().current->pool->now()
+        + std::chrono::duration_cast<std::chrono::steady_clock::duration>(deadline - Clock::now());
+    detail::suspend(detail::switch_action::sleep, wake_at);
+}
+
+template <typename Rep, typename Period>
+void sleep_for(const std::chrono::duration<Rep, Period>& d)
+{
+    if (!on_fiber()) {
+        std::this_thread::sleep_for(d);
+        return;
+    }
+
+    auto wake_at = detail::this_carrier().current->pool->now()
+        + std::chrono::duration_cast<std::chrono::steady_clock::duration>(d);
+    detail::suspend(detail::switch_action::sleep, wake_at);
+}
+
+} // namespace this_fiber
+
+} // namespace lt::async
+
+// LT_ASYNC_DEFINE_FIBER_WAITS
+//
+// Defines replacements for `nanosleep()`, `clock_nanosleep()` and the
+// `pthread_cond_*` wait and notify functions which, called on a fiber, suspend
+// the fiber instead of its carrier thread, and otherwise call the C library's
+// own. With it, `std::this_thread` sleeps and `std::condition_variable` waits,
+// such as those inside `lt::retry`, let other fibers run without any change to
+// the code which makes them. Use it at namespace scope in exactly one source
+// file, followed by a semicolon, and not together with
+// `LT_ASYNC_DEFINE_SIMULATED_TIME`, which includes it. Linux and glibc only;
+// link with -ldl on glibc older than 2.34.
+//
+// LT_ASYNC_DEFINE_FIBER_WAITS;  // in one .cpp file
+#define LT_ASYNC_DEFINE_FIBER_WAITS                                                                  \
+    extern "C" int clock_nanosleep(clockid_t clock, int flags, const struct timespec* req,          \
+                                   struct timespec* rem)                                            \
+    {                                                                                               \
+        static auto next = ::lt::async::detail::next_symbol<                                        \
+            int (*)(clockid_t, int, const struct timespec*, struct timespec*)>("clock_nanosleep");  \
+        if (::lt::async::this_fiber::on_fiber()) {                                                  \
+            auto* host = ::lt::async::detail::this_carrier().current->pool;                         \
+            ::lt::async::detail::fiber_sleep_until((flags & TIMER_ABSTIME)                          \
+                ? ::lt::async::detail::fiber_deadline(clock, *req)                                  \
+                : host->now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(    \
+                      ::lt::async::detail::to_duration(*req)));                                     \
+            return 0;                                                                               \
+        }                                                                                           \
+        return next(clock, flags, req, rem);                                                        \
+    }                                                                                               \
+    extern "C" int nanosleep(const struct timespec* req, struct timespec* rem)                      \
+    {                                                                                               \
+        static auto next = ::lt::async::detail::next_symbol<                                        \
+            int (*)(const struct timespec*, struct timespec*)>("nanosleep");                        \
+        if (::lt::async::this_fiber::on_fiber()) {                                                  \
+            return clock_nanosleep(CLOCK_MONOTONIC, 0, req, rem);                                   \
+        }                                                                                           \
+        return next(req, rem);                                                                      \
+    }                                                                                               \
+    extern "C" int pthread_cond_clockwait(pthread_cond_t* cond, pthread_mutex_t* mutex,            \
+                                          clockid_t clock, const struct timespec* abstime)          \
+    {                                                                                               \
+        static auto next = ::lt::async::detail::next_symbol<                                        \
+            int (*)(pthread_cond_t*, pthread_mutex_t*, clockid_t, const struct timespec*)>(         \
+            "pthread_cond_clockwait");                                                              \
+        if (::lt::async::this_fiber::on_fiber()) {                                                  \
+            return ::lt::async::detail::this_carrier().current->pool->wait_on(                      \
+                cond, mutex, ::lt::async::detail::fiber_deadline(clock, *abstime));                 \
+        }                                                                                           \
+        return next(cond, mutex, clock, abstime);                                                   \
+    }                                                                                               \
+    extern "C" int pthread_cond_timedwait(pthread_cond_t* cond, pthread_mutex_t* mutex,            \
+                                          const struct timespec* abstime)                           \
+    {                                                                                               \
+        static auto next = ::lt::async::detail::next_symbol<                                        \
+            int (*)(pthread_cond_t*, pthread_mutex_t*, const struct timespec*)>(                    \
+            "pthread_cond_timedwait");                                                              \
+        if (::lt::async::this_fiber::on_fiber()) {                                                  \
+            return ::lt::async::detail::this_carrier().current->pool->wait_on(                      \
+                cond, mutex, ::lt::async::detail::fiber_deadline(CLOCK_REALTIME, *abstime));        \
+        }                                                                                           \
+        return next(cond, mutex, abstime);                                                          \
+    }                                                                                               \
+    extern "C" int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex)                 \
+    {                                                                                               \
+        static auto next = ::lt::async::detail::next_symbol<                                        \
+            int (*)(pthread_cond_t*, pthread_mutex_t*)>("pthread_cond_wait");                       \
+        if (::lt::async::this_fiber::on_fiber()) {                                                  \
+            return ::lt::async::detail::this_carrier().current->pool->wait_on(                      \
+                cond, mutex, std::chrono::steady_clock::time_point::max());                         \
+        }                                                                                           \
+        return next(cond, mutex);                                                                   \
+    }                                                                                               \
+    extern "C" int pthread_cond_signal(pthread_cond_t* cond) noexcept                               \
+    {                                                                                               \
+        static auto next = ::lt::async::detail::next_symbol<int (*)(pthread_cond_t*)>(              \
+            "pthread_cond_signal");                                                                 \
+        ::lt::async::detail::notify_fibers(cond, false);                                            \
+        return next(cond);                                                                          \
+    }                                                                                               \
+    extern "C" int pthread_cond_broadcast(pthread_cond_t* cond) noexcept                            \
+    {                                                                                               \
+        static auto next = ::lt::async::detail::next_symbol<int (*)(pthread_cond_t*)>(              \
+            "pthread_cond_broadcast");                                                              \
+        ::lt::async::detail::notify_fibers(cond, true);                                             \
+        return next(cond);                                                                          \
+    }                                                                                               \
+    static_assert(true)
@@ -0,0 +1,755 @@
+#pragma once
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "tl/expected.hpp"
+
+#include "lt/async/async.h"
+#include "lt/async/executor.h"
+#include "lt/async/fiber.h"
+
+namespace lt::async
+{
+
+// io_result
+//
+// Result of a single read or write: the number of bytes transferred.
+using io_result = tl::expected<std::size_t, std::error_code>;
+
+// file_result
+//
+// Result of reading a whole file.
+using file_result = tl::expected<std::string, std::error_code>;
+
+namespace detail
+{
+
+// Completion callback of an operation in flight, passed to the kernel as the
+// submission's user data. `res` is a byte count, or a negated errno.
+struct io_op
+{
+    std::function<void(int res)> done;
+};
+
+inline io_result to_io_result(int res)
+{
+    if (res < 0) {
+        return tl::unexpected(std::error_code(-res, std::system_category()));
+    }
+    return static_cast<std::size_t>(res);
+}
+
+// Thread-local record of the completion currently being delivered, so that
+// an operation submitted from inside a completion callback can take over the
+// finished operation's queue slot instead of waiting for a free one.
+struct io_completion_scope
+{
+    const void* context = nullptr;
+    bool slot_taken = false;
+};
+
+inline io_completion_scope& this_io_completion()
+{
+    thread_local io_completion_scope s;
+    return s;
+}
+
+} // namespace detail
+
+// io_context
+//
+// Asynchronous file and socket I/O for element functions. Operations are
+// submitted to an io_uring instance and completed by a reaper thread; if the
+// kernel does not provide io_uring, or its io_uring lacks the read and write
+// operations, a small thread pool performing blocking `pread()`/`pwrite()` is
+// used instead. If the kernel refuses a submission, the operation completes
+// with the error.
+//
+// At most `queue_depth()` operations are in flight at once; submitting beyond
+// that waits for a free slot. Completion callbacks run on the reaper thread
+// and should be short. They may submit follow-on operations, but must not
+// wait for one.
+//
+// The blocking-style `read()`, `write()` and `read_file()` wait for their
+// completion, parking the calling fiber when called on a `fiber_pool`.
+//
+// auto io = io_context(64);
+// auto f = [&](const std::string& path) {
+//     auto contents = io.read_file(path);
+//     if (!contents) {
+//         return tl::unexpected(contents.error().message());
+//     }
+//     return parse(*contents);
+// };
+class io_context
+{
+   public:
+    explicit io_context(unsigned queue_depth = 64)
+        : depth_(std::max(1u, queue_depth))
+    {
+        if (!setup_ring() || !supports_read_write()) {
+            close_ring();
+            fallback_ = std::make_unique<thread_pool>(std::min(depth_, 8u), depth_);
+            return;
+        }
+        reaper_ = std::thread([this] { reap(); });
+    }
+
+    io_context(const io_context&) = delete;
+    io_context& operator=(const io_context&) = delete;
+
+    ~io_context()
+    {
+        if (fallback_) {
+            return;
+        }
+
+        // A no-op with null user data tells the reaper to exit. If it cannot
+        // be submitted, the reaper sees `stopping_` once its wait fails.
+        stopping_.store(true, std::memory_order_relaxed);
+        submit_sqe(IORING_OP_NOP, -1, nullptr, 0, 0, nullptr);
+        reaper_.join();
+
+        close_ring();
+    }
+
+    bool uses_io_uring() const
+    {
+        return !fallback_;
+    }
+
+    unsigned queue_depth() const
+    {
+        return depth_;
+    }
+
+    void async_read(int fd, void* buf, std::size_t len, std::uint64_t offset,
+                    std::function<void(io_result)> done)
+    {
+        submit(IORING_OP_READ, fd, buf, len, offset, std::move(done));
+    }
+
+    void async_write(int fd, const void* buf, std::size_t len, std::uint64_t offset,
+                     std::function<void(io_result)> done)
+    {
+        submit(IORING_OP_WRITE, fd, const_cast<void*>(buf), len, offset, std::move(done));
+    }
+
+    io_result read(int fd, void* buf, std::size_t len, std::uint64_t offset)
+    {
+        return await<io_result>([&](auto done) { async_read(fd, buf, len, offset, std::move(done)); });
+    }
+
+    io_result write(int fd, const void* buf, std::size_t len, std::uint64_t offset)
+    {
+        return await<io_result>([&](auto done) { async_write(fd, buf, len, offset, std::move(done)); });
+    }
+
+    // Read the whole of the file at `path`, chaining reads until the end of
+    // the file.
+    void async_read_file(const std::string& path, std::function<void(file_result)> done)
+    {
+        auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            done(tl::unexpected(std::error_code(errno, std::system_category())));
+            return;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            auto ec = std::error_code(errno, std::system_category());
+            ::close(fd);
+            done(tl::unexpected(ec));
+            return;
+        }
+
+        auto state = std::make_shared<file_read>();
+        state->fd = fd;
+        state->data.resize(static_cast<std::size_t>(st.st_size));
+        state->done = std::move(done);
+
+        if (state->data.empty()) {
+            finish_file(state, {});
+            return;
+        }
+        read_next(state);
+    }
+
+    file_result read_file(const std::string& path)
+    {
+        return await<file_result>([&](auto done) { async_read_file(path, std::move(done)); });
+    }
+
+   private:
+    struct file_read
+    {
+        int fd = -1;
+        std::string data;
+        std::size_t offset = 0;
+        std::function<void(file_result)> done;
+    };
+
+    // Largest single transfer; the kernel's length field is 32 bits.
+    static constexpr std::size_t max_transfer = std::size_t(1) << 30;
+
+    template <typename result_type, typename Start>
+    result_type await(Start start)
+    {
+        auto ready = std::make_shared<detail::event>();
+        auto result = std::optional<result_type>();
+
+        start([ready, &result](result_type r) {
+            result.emplace(std::move(r));
+            ready->set();
+        });
+
+        ready->wait();
+        return std::move(*result);
+    }
+
+    void read_next(const std::shared_ptr<file_read>& state)
+    {
+        auto remaining = std::min(state->data.size() - state->offset, max_transfer);
+
+        async_read(state->fd, state->data.data() + state->offset, remaining, state->offset,
+                   [this, state](io_result r) {
+                       if (!r) {
+                           finish_file(state, r.error());
+                       } else if (*r == 0) {
+                           // The file shrank since fstat().
+                           state->data.resize(state->offset);
+                           finish_file(state, {});
+                       } else if ((state->offset += *r) == state->data.size()) {
+                           finish_file(state, {});
+                       } else {
+                           read_next(state);
+                       }
+                   });
+    }
+
+    static void finish_file(const std::shared_ptr<file_read>& state, std::error_code ec)
+    {
+        ::close(state->fd);
+        if (ec) {
+            state->done(tl::unexpected(ec));
+        } else {
+            state->done(std::move(state->data));
+        }
+    }
+
+    void submit(int opcode, int fd, void* buf, std::size_t len, std::uint64_t offset,
+                std::function<void(io_result)> done)
+    {
+        acquire_slot();
+        len = std::min(len, max_transfer);
+
+        auto* op = new detail::io_op{[done = std::move(done)](int res) { done(detail::to_io_result(res)); }};
+
+        if (fallback_) {
+            fallback_->submit([this, opcode, fd, buf, len, offset, op] {
+                auto r = opcode == IORING_OP_READ
+                    ? ::pread(fd, buf, len, static_cast<off_t>(offset))
+                    : ::pwrite(fd, buf, len, static_cast<off_t>(offset));
+                complete(op, r < 0 ? -errno : static_cast<int>(r));
+            });
+            return;
+        }
+
+        if (auto err = submit_sqe(opcode, fd, buf, len, offset, op)) {
+            complete(op, err);
+        }
+    }
+
+    void acquire_slot()
+    {
+        auto& scope = detail::this_io_completion();
+        if (scope.context == this && !scope.slot_taken) {
+            scope.slot_taken = true;
+            return;
+        }
+
+        auto n = inflight_.load(std::memory_order_relaxed);
+        for (;;) {
+            if (n < depth_) {
+                if (inflight_.compare_exchange_weak(n, n + 1, std::memory_order_acquire)) {
+                    return;
+                }
+                continue;
+            }
+
+            if (this_fiber::on_fiber()) {
+                this_fiber::yield();
+            } else {
+                inflight_.wait(n, std::memory_order_relaxed);
+            }
+            n = inflight_.load(std::memory_order_relaxed);
+        }
+    }
+
+    void release_slot()
+    {
+        inflight_.fetch_sub(1, std::memory_order_release);
+        inflight_.notify_one();
+    }
+
+    // Deliver a completion. The finished operation's slot passes to the first
+    // operation submitted by its callback, if any.
+    void complete(detail::io_op* op, int res)
+    {
+        auto& scope = detail::this_io_completion();
+        auto outer = scope;
+        scope = {this, false};
+
+        op->done(res);
+        delete op;
+
+        auto taken = scope.slot_taken;
+        scope = outer;
+        if (!taken) {
+            release_slot();
+        }
+    }
+
+    // Map the rings of a new io_uring instance. On failure, leaves whatever
+    // was set up for `close_ring()`.
+    bool setup_ring()
+    {
+        auto p = io_uring_params();
+        std::memset(&p, 0, sizeof(p));
+
+        ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, depth_, &p));
+        if (ring_fd_ < 0) {
+            return false;
+        }
+
+        sq_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        auto single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap) {
+            sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+        }
+
+        sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring_fd_, IORING_OFF_SQ_RING);
+        if (sq_ptr_ == MAP_FAILED) {
+            return false;
+        }
+
+        cq_ptr_ = single_mmap ? sq_ptr_
+                              : mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                     ring_fd_, IORING_OFF_CQ_RING);
+        if (cq_ptr_ == MAP_FAILED) {
+            return false;
+        }
+
+        sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ring_fd_, IORING_OFF_SQES);
+        if (sqes_ == MAP_FAILED) {
+            return false;
+        }
+
+        auto* sq = static_cast<char*>(sq_ptr_);
+        sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+
+        auto* cq = static_cast<char*>(cq_ptr_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+
+        return true;
+    }
+
+    // True if the kernel's io_uring implements `IORING_OP_READ` and
+    // `IORING_OP_WRITE`, which older kernels lack.
+    bool supports_read_write() const
+    {
+        constexpr unsigned max_ops = 256;
+        auto storage = std::vector<std::uint64_t>(
+            (sizeof(io_uring_probe) + max_ops * sizeof(io_uring_probe_op)) / sizeof(std::uint64_t) + 1);
+        auto* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+
+        if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PROBE, probe, max_ops) < 0) {
+            return false;
+        }
+
+        auto supported = [probe](int op) {
+            return op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED) != 0;
+        };
+        return supported(IORING_OP_READ) && supported(IORING_OP_WRITE);
+    }
+
+    void close_ring()
+    {
+        if (sqes_ != nullptr && sqes_ != MAP_FAILED) {
+            munmap(sqes_, sqes_size_);
+        }
+        if (cq_ptr_ != nullptr && cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_) {
+            munmap(cq_ptr_, cq_size_);
+        }
+        if (sq_ptr_ != nullptr && sq_ptr_ != MAP_FAILED) {
+            munmap(sq_ptr_, sq_size_);
+        }
+        if (ring_fd_ >= 0) {
+            close(ring_fd_);
+        }
+        sqes_ = cq_ptr_ = sq_ptr_ = nullptr;
+        ring_fd_ = -1;
+    }
+
+    // Queue one operation and tell the kernel. Returns 0, or a negated errno
+    // if the kernel refused it, in which case it was taken back off the
+    // queue and will not complete.
+    int submit_sqe(int opcode, int fd, void* buf, std::size_t len, std::uint64_t offset, detail::io_op* op)
+    {
+        std::lock_guard<std::mutex> lock(sq_mutex_);
+
+        auto tail = *sq_tail_;
+        auto index = tail & sq_mask_;
+        auto* sqe = &static_cast<io_uring_sqe*>(sqes_)[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = static_cast<std::uint8_t>(opcode);
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<std::uint64_t>(buf);
+        sqe->len = static_cast<std::uint32_t>(len);
+        sqe->off = offset;
+        sqe->user_data = reinterpret_cast<std::uint64_t>(op);
+
+        sq_array_[index] = index;
+        std::atomic_ref<unsigned>(*sq_tail_).store(tail + 1, std::memory_order_release);
+
+        while (syscall(__NR_io_uring_enter, ring_fd_, 1, 0, 0, nullptr, 0) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            auto err = errno;
+            if (std::atomic_ref<unsigned>(*sq_head_).load(std::memory_order_acquire) == tail + 1) {
+                // Consumed despite the error, so it will complete.
+                return 0;
+            }
+            std::atomic_ref<unsigned>(*sq_tail_).store(tail, std::memory_order_release);
+            return -err;
+        }
+        return 0;
+    }
+
+    void reap()
+    {
+        auto completed = std::vector<std::pair<std::uint64_t, int>>();
+
+        auto backoff = std::chrono::microseconds(1);
+
+        for (;;) {
+            auto r = syscall(__NR_io_uring_enter, ring_fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            auto err = r < 0 ? errno : 0;
+
+            auto head = std::atomic_ref<unsigned>(*cq_head_).load(std::memory_order_relaxed);
+            auto tail = std::atomic_ref<unsigned>(*cq_tail_).load(std::memory_order_acquire);
+            for (; head != tail; ++head) {
+                auto& cqe = cqes_[head & cq_mask_];
+                completed.emplace_back(cqe.user_data, cqe.res);
+            }
+            std::atomic_ref<unsigned>(*cq_head_).store(head, std::memory_order_release);
+
+            auto stop = false;
+            for (auto && [user_data, res] : completed) {
+                if (user_data == 0) {
+                    stop = true;
+                } else {
+                    complete(reinterpret_cast<detail::io_op*>(user_data), res);
+                }
+            }
+            auto idle = completed.empty();
+            completed.clear();
+
+            if (stop) {
+                return;
+            }
+
+            // A failed wait which delivered nothing, such as ENOMEM, is
+            // retried after a growing pause rather than in a tight loop.
+            if (idle && err != 0 && err != EINTR) {
+                if (stopping_.load(std::memory_order_relaxed)) {
+                    return;
+                }
+                std::this_thread::sleep_for(backoff);
+                backoff = std::min(2 * backoff, std::chrono::microseconds(1000));
+            } else {
+                backoff = std::chrono::microseconds(1);
+            }
+        }
+    }
+
+    const unsigned depth_;
+    std::atomic<unsigned> inflight_{0};
+
+    std::unique_ptr<thread_pool> fallback_;
+
+    int ring_fd_ = -1;
+    void* sq_ptr_ = nullptr;
+    void* cq_ptr_ = nullptr;
+    void* sqes_ = nullptr;
+    std::size_t sq_size_ = 0;
+    std::size_t cq_size_ = 0;
+    std::size_t sqes_size_ = 0;
+
+    std::mutex sq_mutex_;
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned* sq_array_ = nullptr;
+
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+
+    std::atomic<bool> stopping_{false};
+    std::thread reaper_;
+};
+
+// default_io_context
+//
+// Process-wide I/O context used by `map_files()` when none is given.
+inline io_context& default_io_context()
+{
+    static io_context io;
+    return io;
+}
+
+// map_files
+//
+// Read each file in `paths` and parse its contents, returning the outputs in
+// order. If any read or parse failed then the whole operation failed; a read
+// error is reported as an `error_type` constructed from a message string.
+//
+// Reads are issued up to `io.queue_depth()` files ahead of parsing, and each
+// parse is posted to `cpu` as soon as its file has been read, so I/O for
+// later files overlaps with parsing of earlier ones while at most a bounded
+// number of file buffers are held at once. No executor thread waits for a
+// read. The calling thread or fiber parses files as they arrive too, so the
+// call completes when made from an element running on `cpu`.
+//
+// `parse` never runs on the I/O context's own threads: if `cpu.post()` runs
+// its task inline, as the base `executor::post()` does and a full
+// `thread_pool` queue does, the file is left for the calling thread instead.
+//
+// auto parse = [](const std::string& path, const std::string& contents)
+//         -> attempt_result_t<record> {
+//     ...
+//     return r;
+// };
+// auto records = map_files<record>(paths, parse);
+template <typename output_type, typename error_type=std::string>
+aggregate_result_t<output_type, error_type> map_files(
+    io_context& io,
+    const std::vector<std::string>& paths,
+    std::type_identity_t<
+        std::function<attempt_result_t<output_type, error_type>(const std::string&, const std::string&)>> parse,
+    executor& cpu = default_executor())
+{
+    static_assert(std::is_constructible_v<error_type, std::string>,
+                  "map_files reports read errors as error_type(std::string)");
+
+    using parse_function =
+        std::function<attempt_result_t<output_type, error_type>(const std::string&, const std::string&)>;
+
+    // Shared with the read callbacks and the parse tasks posted to `cpu`,
+    // which may run after the call has returned. `paths` is only touched
+    // while a file remains to be parsed, so the call has not returned.
+    struct pending_files : std::enable_shared_from_this<pending_files>
+    {
+        pending_files(io_context& io, executor& cpu, const std::vector<std::string>& paths, parse_function parse)
+            : io(io), cpu(cpu), paths(paths), parse(std::move(parse)),
+              contents(paths.size()), results(paths.size()), remaining(paths.size())
+        {
+        }
+
+        // Read file `i`, then queue it and post a task to parse it, so that
+        // no executor thread waits for I/O.
+        void start(std::size_t i)
+        {
+            io.async_read_file(paths[i], [self = this->shared_from_this(), i](file_result r) {
+                self->contents[i].emplace(std::move(r));
+                {
+                    std::lock_guard<std::mutex> lock(self->mutex);
+                    self->ready.push_back(i);
+                }
+                self->cpu.post([self] {
+                    // Run inline from this callback: leave the file to a
+                    // thread which is not delivering I/O completions.
+                    if (detail::this_io_completion().context == nullptr) {
+                        self->parse_one();
+                    }
+                });
+                self->notify();
+            });
+        }
+
+        // Parse one file which has been read, if any.
+        bool parse_one()
+        {
+            auto i = std::size_t(0);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (ready.empty()) {
+                    return false;
+                }
+                i = ready.front();
+                ready.pop_front();
+            }
+
+            // Each file taken for parsing lets one more read start.
+            auto j = next_start.fetch_add(1, std::memory_order_relaxed);
+            if (j < paths.size()) {
+                start(j);
+            }
+
+            try {
+                auto& c = *contents[i];
+                if (!c) {
+                    results[i].emplace(tl::unexpected(error_type(paths[i] + ": " + c.error().message())));
+                } else {
+                    results[i].emplace(parse(paths[i], *c));
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+            contents[i].reset();
+
+            remaining.fetch_sub(1, std::memory_order_acq_rel);
+            notify();
+            return true;
+        }
+
+        // Parse files as they are read until all have been, so the call
+        // completes even if every executor thread is busy. Between files the
+        // caller waits on an event, which parks a fiber instead of its
+        // carrier.
+        void wait()
+        {
+            for (;;) {
+                if (parse_one()) {
+                    continue;
+                }
+
+                auto wake = std::make_shared<detail::event>();
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (remaining.load(std::memory_order_acquire) == 0) {
+                        return;
+                    }
+                    if (!ready.empty()) {
+                        continue;
+                    }
+                    waiter = wake;
+                }
+                wake->wait();
+            }
+        }
+
+        // Wake the caller after a file has been read or parsed.
+        void notify()
+        {
+            auto wake = std::shared_ptr<detail::event>();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                wake = std::move(waiter);
+            }
+            if (wake) {
+                wake->set();
+            }
+        }
+
+        io_context& io;
+        executor& cpu;
+        const std::vector<std::string>& paths;
+        const parse_function parse;
+
+        std::vector<std::optional<file_result>> contents;
+        std::vector<std::optional<attempt_result_t<output_type, error_type>>> results;
+        std::atomic<std::size_t> next_start{0};
+        std::atomic<std::size_t> remaining;
+
+        // Files which have been read and not yet parsed, and the event the
+        // caller waits on for the next one.
+        std::mutex mutex;
+        std::deque<std::size_t> ready;
+        std::shared_ptr<detail::event> waiter;
+
+        std::mutex error_mutex;
+        std::exception_ptr error;
+    };
+
+    auto n = paths.size();
+    if (n == 0) {
+        return std::vector<output_type>();
+    }
+
+    auto state = std::make_shared<pending_files>(io, cpu, paths, parse);
+
+    auto window = std::min<std::size_t>(n, io.queue_depth());
+    state->next_start.store(window, std::memory_order_relaxed);
+    for (std::size_t i = 0; i < window; ++i) {
+        state->start(i);
+    }
+
+    state->wait();
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+    auto& results = state->results;
+
+    auto output = std::vector<output_type>();
+    output.reserve(n);
+    for (auto && r : results) {
+        if (!*r) {
+            return tl::unexpected(r->error());
+        }
+        output.push_back(std::move(**r));
+    }
+
+    return output;
+}
+
+template <typename output_type, typename error_type=std::string>
+aggregate_result_t<output_type, error_type> map_files(
+    const std::vector<std::string>& paths,
+    std::type_identity_t<
+        std::function<attempt_result_t<output_type, error_type>(const std::string&, const std::string&)>> parse)
+{
+    return map_files<output_type, error_type>(default_io_context(), paths, parse);
+}
+
+} // namespace lt::async
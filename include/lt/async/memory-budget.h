@@ -0,0 +1,136 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+
+namespace lt::async
+{
+
+// memory_budget
+//
+// A byte budget shared by the elements which hold memory at one time. An
+// element reserves its estimated cost before it starts and releases it once
+// its output has been consumed, so the outputs alive at any moment fit under
+// the budget.
+//
+// A reservation larger than the whole budget is granted only when nothing else
+// is held, so that a single oversized element runs alone rather than never.
+//
+// One budget may be shared by several `async` objects to bound their combined
+// memory use.
+//
+// auto budget = memory_budget(8ull << 30);  // 8 GiB
+class memory_budget
+{
+   public:
+    explicit memory_budget(std::size_t bytes)
+        : capacity_(bytes)
+    {
+    }
+
+    memory_budget(const memory_budget&) = delete;
+    memory_budget& operator=(const memory_budget&) = delete;
+
+    std::size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    std::size_t in_use() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return in_use_;
+    }
+
+    // The largest number of bytes held at once.
+    std::size_t peak() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return peak_;
+    }
+
+    // Reserve `bytes` if they fit now.
+    bool try_acquire(std::size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!fits(bytes)) {
+            return false;
+        }
+        add(bytes);
+        return true;
+    }
+
+    // Reserve `bytes`, blocking the calling thread until they fit.
+    void acquire(std::size_t bytes)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&] { return fits(bytes); });
+        add(bytes);
+    }
+
+    // Count `bytes` as held even if that takes the budget over its capacity,
+    // e.g. when an element turns out to be larger than estimated.
+    void force_acquire(std::size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        add(bytes);
+    }
+
+    void release(std::size_t bytes)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            in_use_ -= std::min(bytes, in_use_);
+        }
+        cv_.notify_all();
+    }
+
+   private:
+    bool fits(std::size_t bytes) const
+    {
+        return in_use_ == 0 || in_use_ + bytes <= capacity_;
+    }
+
+    void add(std::size_t bytes)
+    {
+        in_use_ += bytes;
+        peak_ = std::max(peak_, in_use_);
+    }
+
+    const std::size_t capacity_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::size_t in_use_ = 0;
+    std::size_t peak_ = 0;
+};
+
+// memory_cost
+//
+// How to estimate the memory held by one element, for `map_budgeted()`.
+//
+// `estimate`, if set, gives the cost of an element from its input before it
+// starts. Otherwise an element is assumed to cost the largest output measured
+// so far, or `initial` before any output has been measured. If `initial` is
+// zero, `map_budgeted()` runs the first element alone to measure it; with
+// neither `estimate` nor `measure`, `initial` must be nonzero.
+//
+// `measure`, if set, gives the actual size of an output once it is produced;
+// the element's reservation is corrected to that size until it is consumed.
+//
+// auto cost = memory_cost<path_type, image_type>{
+//     .measure = [](const image_type& img) { return img.bytes(); },
+//     .initial = 256 << 20,
+// };
+template <typename input_type, typename output_type>
+struct memory_cost
+{
+    std::function<std::size_t(const input_type&)> estimate = {};
+    std::function<std::size_t(const output_type&)> measure = {};
+    std::size_t initial = 0;
+};
+
+} // namespace lt::async
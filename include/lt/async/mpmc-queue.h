@@ -0,0 +1,220 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace lt::async
+{
+
+// cache_line_size
+//
+// Size used to pad frequently written atomics onto their own cache line, so
+// that producers and consumers do not false-share.
+inline constexpr std::size_t cache_line_size = 64;
+
+// mpmc_queue
+//
+// Bounded lock-free multi-producer multi-consumer ring queue, after Dmitry
+// Vyukov's design. Each slot carries a sequence number which tells producers
+// and consumers whether the slot is free for the current lap of the ring, so
+// an enqueue or dequeue costs a single CAS on the shared position counter and
+// never takes a lock.
+//
+// The batch operations claim a run of consecutive ready slots with one CAS,
+// which amortizes the contended position update across many elements.
+//
+// The capacity is rounded up to a power of two.
+//
+// auto q = mpmc_queue<int>(1024);
+// q.try_push(1);
+//
+// int v;
+// if (q.try_pop(v)) {
+//     ... use(v);
+// }
+template <typename T>
+class mpmc_queue
+{
+   public:
+    explicit mpmc_queue(std::size_t capacity)
+        : mask_(round_up_pow2(capacity) - 1),
+          cells_(new cell[mask_ + 1])
+    {
+        for (std::size_t i = 0; i <= mask_; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    mpmc_queue(const mpmc_queue&) = delete;
+    mpmc_queue& operator=(const mpmc_queue&) = delete;
+
+    ~mpmc_queue()
+    {
+        T v;
+        while (try_pop(v)) {
+        }
+    }
+
+    std::size_t capacity() const
+    {
+        return mask_ + 1;
+    }
+
+    // Approximate number of queued elements. Exact only when the queue is
+    // quiescent.
+    std::size_t size_approx() const
+    {
+        auto tail = enqueue_pos_.load(std::memory_order_relaxed);
+        auto head = dequeue_pos_.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+    bool empty_approx() const
+    {
+        return size_approx() == 0;
+    }
+
+    bool try_push(T&& v)
+    {
+        return try_push_bulk(&v, 1) == 1;
+    }
+
+    bool try_push(const T& v)
+    {
+        T copy(v);
+        return try_push(std::move(copy));
+    }
+
+    bool try_pop(T& out)
+    {
+        return try_pop_bulk(&out, 1) == 1;
+    }
+
+    // Move up to `count` elements from `first` into the queue, in order.
+    // Returns the number enqueued, which is less than `count` only if the
+    // queue filled up.
+    template <typename InputIt>
+    std::size_t try_push_bulk(InputIt first, std::size_t count)
+    {
+        auto pushed = std::size_t(0);
+
+        while (pushed < count) {
+            auto pos = enqueue_pos_.load(std::memory_order_relaxed);
+            auto n = ready_run(pos, count - pushed, 0);
+
+            if (n == 0) {
+                if (not_ready(pos, 0)) {
+                    break;
+                }
+                continue;
+            }
+
+            if (!enqueue_pos_.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed)) {
+                continue;
+            }
+
+            for (std::size_t i = 0; i < n; ++i, ++first) {
+                auto& c = cells_[(pos + i) & mask_];
+                ::new (c.storage()) T(std::move(*first));
+                c.sequence.store(pos + i + 1, std::memory_order_release);
+            }
+            pushed += n;
+        }
+
+        return pushed;
+    }
+
+    // Move up to `max` elements out of the queue into `out`, in FIFO order.
+    // Returns the number dequeued.
+    template <typename OutputIt>
+    std::size_t try_pop_bulk(OutputIt out, std::size_t max)
+    {
+        auto popped = std::size_t(0);
+
+        while (popped < max) {
+            auto pos = dequeue_pos_.load(std::memory_order_relaxed);
+            auto n = ready_run(pos, max - popped, 1);
+
+            if (n == 0) {
+                if (not_ready(pos, 1)) {
+                    break;
+                }
+                continue;
+            }
+
+            if (!dequeue_pos_.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed)) {
+                continue;
+            }
+
+            for (std::size_t i = 0; i < n; ++i, ++out) {
+                auto& c = cells_[(pos + i) & mask_];
+                auto* p = std::launder(reinterpret_cast<T*>(c.storage()));
+                *out = std::move(*p);
+                p->~T();
+                c.sequence.store(pos + i + mask_ + 1, std::memory_order_release);
+            }
+            popped += n;
+        }
+
+        return popped;
+    }
+
+   private:
+    struct alignas(cache_line_size) cell
+    {
+        std::atomic<std::size_t> sequence;
+        alignas(T) unsigned char data[sizeof(T)];
+
+        void* storage()
+        {
+            return data;
+        }
+    };
+
+    static std::size_t round_up_pow2(std::size_t n)
+    {
+        if (n < 2) {
+            return 2;
+        }
+        auto p = std::size_t(1);
+        while (p < n) {
+            p <<= 1;
+        }
+        return p;
+    }
+
+    // Count the consecutive slots starting at `pos` whose sequence shows they
+    // are ready for a producer (offset 0) or a consumer (offset 1), up to
+    // `max`.
+    std::size_t ready_run(std::size_t pos, std::size_t max, std::size_t offset) const
+    {
+        auto n = std::size_t(0);
+        while (n < max && n <= mask_) {
+            auto seq = cells_[(pos + n) & mask_].sequence.load(std::memory_order_acquire);
+            if (seq != pos + n + offset) {
+                break;
+            }
+            ++n;
+        }
+        return n;
+    }
+
+    // True if the slot at `pos` is genuinely not ready (queue full for a
+    // producer, empty for a consumer) rather than `pos` being stale.
+    bool not_ready(std::size_t pos, std::size_t offset) const
+    {
+        auto seq = cells_[pos & mask_].sequence.load(std::memory_order_acquire);
+        return static_cast<std::ptrdiff_t>(seq - (pos + offset)) < 0;
+    }
+
+    const std::size_t mask_;
+    std::unique_ptr<cell[]> cells_;
+
+    alignas(cache_line_size) std::atomic<std::size_t> enqueue_pos_{0};
+    alignas(cache_line_size) std::atomic<std::size_t> dequeue_pos_{0};
+};
+
+} // namespace lt::async
@@ -0,0 +1,325 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace lt::async
+{
+
+// perf_sample
+//
+// Hardware counters for one element, counting only user-space execution of
+// the thread which ran it. `on_cpu` is the thread CPU time, so that
+// `elapsed - on_cpu` is the time the element was runnable or blocked but not
+// running. Counters are zero if they could not be opened.
+struct perf_sample
+{
+    std::size_t index = 0;
+    bool succeeded = false;
+    std::chrono::nanoseconds elapsed{0};
+    std::chrono::nanoseconds on_cpu{0};
+    std::uint64_t cycles = 0;
+    std::uint64_t instructions = 0;
+    std::uint64_t llc_misses = 0;
+    std::uint64_t branch_misses = 0;
+};
+
+// perf_summary
+//
+// Sum of the samples of a group of elements.
+struct perf_summary
+{
+    std::size_t elements = 0;
+    std::chrono::nanoseconds elapsed{0};
+    std::chrono::nanoseconds on_cpu{0};
+    std::uint64_t cycles = 0;
+    std::uint64_t instructions = 0;
+    std::uint64_t llc_misses = 0;
+    std::uint64_t branch_misses = 0;
+
+    void add(const perf_sample& s)
+    {
+        ++elements;
+        elapsed += s.elapsed;
+        on_cpu += s.on_cpu;
+        cycles += s.cycles;
+        instructions += s.instructions;
+        llc_misses += s.llc_misses;
+        branch_misses += s.branch_misses;
+    }
+
+    // Instructions per cycle.
+    double ipc() const
+    {
+        return cycles ? double(instructions) / double(cycles) : 0.0;
+    }
+
+    // Last level cache misses per thousand instructions.
+    double llc_mpki() const
+    {
+        return instructions ? 1000.0 * double(llc_misses) / double(instructions) : 0.0;
+    }
+
+    // Branch misses per thousand instructions.
+    double branch_mpki() const
+    {
+        return instructions ? 1000.0 * double(branch_misses) / double(instructions) : 0.0;
+    }
+
+    // Fraction of the elapsed time which was spent running on a CPU.
+    double on_cpu_fraction() const
+    {
+        return elapsed.count() ? double(on_cpu.count()) / double(elapsed.count()) : 0.0;
+    }
+};
+
+namespace detail
+{
+
+// perf_group
+//
+// Group of hardware counters for the calling thread, opened on first use and
+// read together with one system call. The counters only count while the
+// thread runs in user space. If the kernel refuses to open them, as it does
+// under a restrictive `perf_event_paranoid` setting or in many containers,
+// `read()` returns zeros.
+class perf_group
+{
+   public:
+    static constexpr std::size_t events = 4;
+    using values = std::array<std::uint64_t, events>;
+
+    perf_group()
+    {
+        static constexpr std::array<std::pair<std::uint32_t, std::uint64_t>, events> configs{{
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        }};
+
+        for (std::size_t k = 0; k < events; ++k) {
+            auto attr = perf_event_attr{};
+            attr.size = sizeof(attr);
+            attr.type = configs[k].first;
+            attr.config = configs[k].second;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            auto fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, k == 0 ? -1 : fds_[0], 0));
+            if (fd < 0) {
+                close_all();
+                return;
+            }
+            fds_[k] = fd;
+        }
+        ioctl(fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    perf_group(const perf_group&) = delete;
+    perf_group& operator=(const perf_group&) = delete;
+
+    ~perf_group()
+    {
+        close_all();
+    }
+
+    bool available() const
+    {
+        return fds_[0] >= 0;
+    }
+
+    // Current counts, scaled up if the kernel multiplexed the group with
+    // other events.
+    values read() const
+    {
+        auto v = values{};
+        if (!available()) {
+            return v;
+        }
+
+        std::uint64_t buf[3 + events];
+        if (::read(fds_[0], buf, sizeof(buf)) != static_cast<ssize_t>(sizeof(buf)) || buf[0] != events) {
+            return v;
+        }
+
+        auto enabled = buf[1];
+        auto running = buf[2];
+        for (std::size_t k = 0; k < events; ++k) {
+            v[k] = running && running < enabled
+                ? static_cast<std::uint64_t>(double(buf[3 + k]) * double(enabled) / double(running))
+                : buf[3 + k];
+        }
+        return v;
+    }
+
+    // Not inlined, for the same reason as `this_worker()`: an element on a
+    // fiber may finish on a different thread than the one it started on.
+    [[gnu::noinline]] static perf_group& this_thread()
+    {
+        thread_local perf_group g;
+        asm volatile("");
+        return g;
+    }
+
+   private:
+    void close_all()
+    {
+        for (auto & fd : fds_) {
+            if (fd >= 0) {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+    }
+
+    std::array<int, events> fds_{-1, -1, -1, -1};
+};
+
+inline std::chrono::nanoseconds thread_cpu_time()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+}
+
+} // namespace detail
+
+// perf_counters
+//
+// Instrumentation policy which reads hardware performance counters around
+// each element: cycles, instructions, last level cache misses and branch
+// misses, along with the thread CPU time. Use it to tell apart elements which
+// are slow because of their input, which show more cycles, cache misses or
+// branch misses, from elements slowed by the machine, which show the same
+// work spread over more elapsed time, or a lower share of it on a CPU.
+//
+// Samples accumulate until `reset()`; call it before each batch to summarise
+// one batch at a time. `by_latency()` groups the samples into buckets of
+// elapsed time percentiles, for comparing the slowest elements to the rest.
+//
+// Each element costs two reads of the counters, which are system calls, so
+// this suits elements which run for tens of microseconds or more. The
+// readings taken at the start of an element are kept on the element's own
+// stack, so nested calls and several instances on one thread do not disturb
+// each other. An element which suspends and resumes on another thread, as it
+// may on a `fiber_pool`, is recorded with its elapsed time only, since its
+// readings come from two threads' counters. If the counters cannot be
+// opened, for example in a container without access to perf events, only the
+// times are recorded and `available()` returns false.
+//
+// auto tasks = basic_async<input_type, output_type, std::string, executor,
+//                          in_order, run_to_completion, perf_counters>(pool);
+// tasks.instrumentation().reset();
+// auto output = tasks.map_concurrently(f, input);
+// for (auto && bucket : tasks.instrumentation().by_latency(10)) {
+//     print(bucket.elapsed / bucket.elements, bucket.ipc(), bucket.llc_mpki());
+// }
+class perf_counters
+{
+   public:
+    bool available() const
+    {
+        return detail::perf_group::this_thread().available();
+    }
+
+    // Readings taken at the start of one element, and the counters they were
+    // read from.
+    struct snapshot
+    {
+        const detail::perf_group* group = nullptr;
+        std::chrono::nanoseconds cpu{0};
+        detail::perf_group::values values{};
+    };
+
+    snapshot on_start(std::size_t)
+    {
+        auto& g = detail::perf_group::this_thread();
+        auto cpu = detail::thread_cpu_time();
+        return snapshot{&g, cpu, g.read()};
+    }
+
+    void on_finish(std::size_t index, bool succeeded, std::chrono::nanoseconds elapsed, const snapshot& s)
+    {
+        auto sample = perf_sample{
+            .index = index,
+            .succeeded = succeeded,
+            .elapsed = elapsed,
+        };
+
+        auto& g = detail::perf_group::this_thread();
+        if (&g == s.group) {
+            auto values = g.read();
+            sample.on_cpu = detail::thread_cpu_time() - s.cpu;
+            sample.cycles = values[0] - s.values[0];
+            sample.instructions = values[1] - s.values[1];
+            sample.llc_misses = values[2] - s.values[2];
+            sample.branch_misses = values[3] - s.values[3];
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        samples_.push_back(sample);
+    }
+
+    // Discard the samples recorded so far.
+    void reset()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        samples_.clear();
+    }
+
+    std::vector<perf_sample> samples() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return samples_;
+    }
+
+    perf_summary total() const
+    {
+        auto summary = perf_summary{};
+        for (auto && s : samples()) {
+            summary.add(s);
+        }
+        return summary;
+    }
+
+    // Summaries of the samples in `buckets` equal sized groups ordered by
+    // elapsed time, so that with 10 buckets the last is the slowest 10% of
+    // elements.
+    std::vector<perf_summary> by_latency(std::size_t buckets = 10) const
+    {
+        if (buckets == 0) {
+            return {};
+        }
+
+        auto sorted = samples();
+        std::sort(sorted.begin(), sorted.end(), [](const perf_sample& a, const perf_sample& b) {
+            return a.elapsed < b.elapsed;
+        });
+
+        auto result = std::vector<perf_summary>(buckets);
+        for (std::size_t i = 0; i < sorted.size(); ++i) {
+            result[i * buckets / sorted.size()].add(sorted[i]);
+        }
+        return result;
+    }
+
+   private:
+    mutable std::mutex mutex_;
+    std::vector<perf_sample> samples_;
+};
+
+} // namespace lt::async
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace lt::async
+{
+
+// Compile-time policies for `basic_async` and the classes built on it. Each
+// policy is a type chosen as a template argument, so a feature which is not
+// selected generates no code.
+
+// in_order
+//
+// Ordering policy: outputs are returned in the order of their inputs.
+struct in_order
+{
+};
+
+// completion_order
+//
+// Ordering policy: outputs are returned in the order in which their elements
+// completed. Each output is written to the next free position as soon as it is
+// produced, with no per-input buffer to reorder.
+struct completion_order
+{
+};
+
+// run_to_completion
+//
+// Error policy: every element runs, even after one has failed. If any element
+// failed, the error of the first failed element in input order is returned.
+struct run_to_completion
+{
+};
+
+// fail_fast
+//
+// Error policy: once an element fails, elements which have not yet started
+// are skipped, and the first error observed is returned.
+struct fail_fast
+{
+};
+
+// no_instrumentation
+//
+// Instrumentation policy which observes nothing. An instrumentation type
+// provides
+//
+//   void on_start(std::size_t index);
+//   void on_finish(std::size_t index, bool succeeded, std::chrono::nanoseconds elapsed);
+//
+// which are called concurrently from the threads running the elements, so
+// they must be thread-safe. An instrumentation type which needs to carry
+// something from the start of an element to its end, such as a counter
+// reading, returns it from `on_start()` instead:
+//
+//   state_type on_start(std::size_t index);
+//   void on_finish(std::size_t index, bool succeeded, std::chrono::nanoseconds elapsed,
+//                  state_type& state);
+//
+// The state lives on the element's own stack, so it is never shared with
+// another element, and it follows the element if a fiber resumes on another
+// thread. It may also provide
+//
+//   void on_batch_start();
+//   void on_batch_finish();
+//
+// which are called on the calling thread at the start and end of each call,
+// such as `map_concurrently()`, around all of its bookkeeping. As with
+// elements, `on_batch_start()` may return state instead, which is kept on the
+// calling thread's stack and passed to `on_batch_finish(state_type& state)`.
+//
+// struct latency_histogram
+// {
+//     void on_start(std::size_t) {}
+//     void on_finish(std::size_t, bool ok, std::chrono::nanoseconds elapsed) {
+//         record(ok, elapsed);
+//     }
+// };
+// auto tasks = basic_async<request, response, std::string, thread_pool,
+//                          in_order, fail_fast, latency_histogram>(pool);
+struct no_instrumentation
+{
+};
+
+template <typename ordering>
+inline constexpr bool is_ordering_policy_v =
+    std::is_same_v<ordering, in_order> || std::is_same_v<ordering, completion_order>;
+
+template <typename error_mode>
+inline constexpr bool is_error_policy_v =
+    std::is_same_v<error_mode, run_to_completion> || std::is_same_v<error_mode, fail_fast>;
+
+template <typename instrumentation>
+inline constexpr bool is_instrumented_v = !std::is_same_v<instrumentation, no_instrumentation>;
+
+template <typename instrumentation>
+inline constexpr bool has_element_state_v = requires(instrumentation& i) {
+    requires !std::is_void_v<decltype(i.on_start(std::size_t()))>;
+};
+
+template <typename instrumentation>
+inline constexpr bool observes_batches_v = requires(instrumentation& i) {
+    i.on_batch_start();
+    i.on_batch_finish();
+};
+
+template <typename instrumentation>
+inline constexpr bool has_batch_state_v = requires(instrumentation& i) {
+    requires !std::is_void_v<decltype(i.on_batch_start())>;
+};
+
+namespace detail
+{
+
+struct no_batch_state
+{
+};
+
+// Start a call on an instrumentation policy, returning its state for the
+// call, if it keeps any.
+template <typename instrumentation>
+auto start_batch(instrumentation& i)
+{
+    if constexpr (has_batch_state_v<instrumentation>) {
+        return i.on_batch_start();
+    } else {
+        if constexpr (observes_batches_v<instrumentation>) {
+            i.on_batch_start();
+        }
+        return no_batch_state();
+    }
+}
+
+// batch_observer
+//
+// Reports one call to an instrumentation policy which observes calls, from
+// construction to destruction. Otherwise it does nothing.
+template <typename instrumentation>
+class batch_observer
+{
+   public:
+    explicit batch_observer(instrumentation& i)
+        : i_(i),
+          state_(start_batch(i))
+    {
+    }
+
+    batch_observer(const batch_observer&) = delete;
+    batch_observer& operator=(const batch_observer&) = delete;
+
+    ~batch_observer()
+    {
+        if constexpr (has_batch_state_v<instrumentation>) {
+            i_.on_batch_finish(state_);
+        } else if constexpr (observes_batches_v<instrumentation>) {
+            i_.on_batch_finish();
+        }
+    }
+
+   private:
+    [[maybe_unused]] instrumentation& i_;
+    decltype(start_batch(std::declval<instrumentation&>())) state_;
+};
+
+} // namespace detail
+
+} // namespace lt::async
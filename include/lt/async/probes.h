@@ -0,0 +1,114 @@
+#pragma once
+
+// USDT probes, for attaching bpftrace or perf to a running process without
+// rebuilding it. The probes are compiled in when <sys/sdt.h> is available
+// (from systemtap-sdt-dev or systemtap-sdt-devel) and `LT_ASYNC_NO_PROBES`
+// is not defined. An unattached probe is a single nop.
+//
+// Each probe has a USDT semaphore, which bpftrace, perf and systemtap
+// increment while they are attached to it. Until one of them is, the library
+// skips the bookkeeping behind the probes as well, such as batch ids and the
+// wrapper around each element, so a build with probes costs a load and a
+// branch per batch. A batch which started before a tracer attached does not
+// fire its element probes. If <sys/sdt.h> was included before this header
+// without `_SDT_HAS_SEMAPHORES`, the probes have no semaphores and are always
+// treated as attached.
+//
+// All probes are in provider `lt_async`, and take the batch id, the element
+// index and the attempt number, starting from 0:
+//
+//   batch_start, batch_end       arg1 is the number of elements
+//   element_start, element_end
+//   attempt_result               arg3 is 1 if the attempt returned a value
+//   should_retry                 arg3 is 1 if the element will be retried
+//   backoff_start, backoff_end   around the wait before a retry
+//   preempted                    a preemptible retry observed its condition
+//
+// Batch ids are unique within the process. Retry probes fired outside a
+// batch, such as from `first_success_retry()`, have batch id 0.
+//
+// bpftrace -e 'usdt:./prog:lt_async:should_retry /arg3/ { @retries[arg1] = count(); }'
+//
+// The list of probes in a binary is shown by `readelf -n` or
+// `bpftrace -l 'usdt:./prog:*'`.
+
+#if __has_include(<sys/sdt.h>) && !defined(LT_ASYNC_NO_PROBES)
+#if !defined(_SYS_SDT_H) && !defined(_SDT_HAS_SEMAPHORES)
+#define _SDT_HAS_SEMAPHORES 1
+#endif
+#include <sys/sdt.h>
+#define LT_ASYNC_HAS_PROBES 1
+#define LT_ASYNC_PROBE(name, batch, index, attempt) DTRACE_PROBE3(lt_async, name, batch, index, attempt)
+#define LT_ASYNC_PROBE_RESULT(name, batch, index, attempt, value) \
+    DTRACE_PROBE4(lt_async, name, batch, index, attempt, value)
+#else
+#define LT_ASYNC_PROBE(name, batch, index, attempt) ((void)0)
+#define LT_ASYNC_PROBE_RESULT(name, batch, index, attempt, value) ((void)0)
+#endif
+
+#if defined(LT_ASYNC_HAS_PROBES) && defined(_SDT_HAS_SEMAPHORES)
+#define LT_ASYNC_HAS_PROBE_SEMAPHORES 1
+
+// The semaphores are referenced by name from the probes' notes, so they are
+// at global scope, where their names are not mangled.
+#define LT_ASYNC_PROBE_SEMAPHORE(name) \
+    inline unsigned short lt_async_##name##_semaphore __attribute__((unused, section(".probes"))) = 0
+
+LT_ASYNC_PROBE_SEMAPHORE(batch_start);
+LT_ASYNC_PROBE_SEMAPHORE(batch_end);
+LT_ASYNC_PROBE_SEMAPHORE(element_start);
+LT_ASYNC_PROBE_SEMAPHORE(element_end);
+LT_ASYNC_PROBE_SEMAPHORE(attempt_result);
+LT_ASYNC_PROBE_SEMAPHORE(should_retry);
+LT_ASYNC_PROBE_SEMAPHORE(backoff_start);
+LT_ASYNC_PROBE_SEMAPHORE(backoff_end);
+LT_ASYNC_PROBE_SEMAPHORE(preempted);
+
+#undef LT_ASYNC_PROBE_SEMAPHORE
+
+#define LT_ASYNC_PROBE_ATTACHED(name) (lt_async_##name##_semaphore != 0)
+#elif defined(LT_ASYNC_HAS_PROBES)
+#define LT_ASYNC_PROBE_ATTACHED(name) true
+#else
+#define LT_ASYNC_PROBE_ATTACHED(name) false
+#endif
+
+namespace lt::async
+{
+
+namespace detail
+{
+
+#if defined(LT_ASYNC_HAS_PROBES)
+inline constexpr bool probes_compiled = true;
+#else
+inline constexpr bool probes_compiled = false;
+#endif
+
+// Whether a tracer is attached to any of the batch and element probes.
+inline bool batch_probes_attached()
+{
+    return LT_ASYNC_PROBE_ATTACHED(batch_start) || LT_ASYNC_PROBE_ATTACHED(batch_end) ||
+           LT_ASYNC_PROBE_ATTACHED(element_start) || LT_ASYNC_PROBE_ATTACHED(element_end);
+}
+
+// Whether a tracer is attached to any of the probes around each attempt.
+inline bool attempt_probes_attached()
+{
+    return LT_ASYNC_PROBE_ATTACHED(attempt_result) || LT_ASYNC_PROBE_ATTACHED(backoff_end);
+}
+
+// Whether a tracer is attached to any of the probes of a retry decision.
+inline bool retry_probes_attached()
+{
+    return LT_ASYNC_PROBE_ATTACHED(should_retry) || LT_ASYNC_PROBE_ATTACHED(backoff_start);
+}
+
+inline bool preempted_probe_attached()
+{
+    return LT_ASYNC_PROBE_ATTACHED(preempted);
+}
+
+} // namespace detail
+
+} // namespace lt::async
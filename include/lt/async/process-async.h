@@ -0,0 +1,640 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tl/expected.hpp"
+
+#include "lt/async/async.h"
+#include "lt/async/codec.h"
+#include "lt/async/mpmc-queue.h"
+
+namespace lt::async
+{
+
+// process_options
+//
+// `workers` is the number of worker processes. Each worker has a request ring
+// and a response ring of `ring_bytes` each, rounded up to a power of two,
+// which bounds the size of one encoded input or output. At most `window`
+// elements are queued on a worker at once, so that elements of uneven cost
+// spread across the workers. An element whose worker crashes is run again on
+// a fresh worker up to `crash_retries` times before it is reported as failed.
+struct process_options
+{
+    std::size_t workers = thread_pool::default_concurrency();
+    std::size_t ring_bytes = std::size_t(1) << 20;
+    std::size_t window = 16;
+    int crash_retries = 0;
+};
+
+namespace detail
+{
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free && std::atomic<std::uint32_t>::is_always_lock_free,
+              "lt::async: shared-memory rings need lock-free atomics");
+
+// process_bell
+//
+// Futex-based wakeup shared between processes. A waiter registers, rechecks
+// its condition, and sleeps until the bell is rung; ringing only makes a
+// system call when someone is waiting.
+struct process_bell
+{
+    void ring()
+    {
+        seq.fetch_add(1, std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_seq_cst) > 0) {
+            syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&seq), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+        }
+    }
+
+    // Sleep until the bell is rung or `timeout` passes, unless `ready()`
+    // becomes true first. A null timeout waits indefinitely.
+    template <typename F>
+    void wait_unless(F&& ready, const timespec* timeout)
+    {
+        waiters.fetch_add(1, std::memory_order_seq_cst);
+        auto s = seq.load(std::memory_order_seq_cst);
+        if (!ready()) {
+            syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&seq), FUTEX_WAIT, s, timeout, nullptr, 0);
+        }
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    std::atomic<std::uint32_t> seq{0};
+    std::atomic<std::uint32_t> waiters{0};
+};
+
+// shm_ring
+//
+// Single-producer, single-consumer ring of messages in shared memory. Each
+// message is an index, a tag and a byte payload.
+class shm_ring
+{
+   public:
+    struct header
+    {
+        alignas(cache_line_size) std::atomic<std::uint64_t> head{0};
+        alignas(cache_line_size) std::atomic<std::uint64_t> tail{0};
+    };
+
+    static constexpr std::size_t message_header = 3 * sizeof(std::uint32_t);
+
+    shm_ring() = default;
+
+    shm_ring(header* h, unsigned char* data, std::size_t capacity)
+        : header_(h), data_(data), capacity_(capacity)
+    {
+    }
+
+    bool fits(std::size_t payload) const
+    {
+        return message_header + payload <= capacity_;
+    }
+
+    bool empty() const
+    {
+        return header_->head.load(std::memory_order_acquire) == header_->tail.load(std::memory_order_acquire);
+    }
+
+    bool can_write(std::size_t payload) const
+    {
+        auto tail = header_->tail.load(std::memory_order_relaxed);
+        auto head = header_->head.load(std::memory_order_acquire);
+        return capacity_ - (tail - head) >= message_header + payload;
+    }
+
+    bool try_write(std::uint32_t index, std::uint32_t tag, std::string_view payload)
+    {
+        if (!can_write(payload.size())) {
+            return false;
+        }
+
+        auto tail = header_->tail.load(std::memory_order_relaxed);
+        auto size = message_header + payload.size();
+
+        std::uint32_t h[3] = {index, tag, static_cast<std::uint32_t>(payload.size())};
+        copy_in(tail, h, message_header);
+        copy_in(tail + message_header, payload.data(), payload.size());
+        header_->tail.store(tail + size, std::memory_order_release);
+        return true;
+    }
+
+    bool try_read(std::uint32_t& index, std::uint32_t& tag, std::string& payload)
+    {
+        auto head = header_->head.load(std::memory_order_relaxed);
+        auto tail = header_->tail.load(std::memory_order_acquire);
+        if (head == tail) {
+            return false;
+        }
+
+        std::uint32_t h[3];
+        copy_out(head, h, message_header);
+        payload.resize(h[2]);
+        copy_out(head + message_header, payload.data(), h[2]);
+        header_->head.store(head + message_header + h[2], std::memory_order_release);
+
+        index = h[0];
+        tag = h[1];
+        return true;
+    }
+
+    // Only while neither end is in use.
+    void reset()
+    {
+        header_->head.store(0, std::memory_order_relaxed);
+        header_->tail.store(0, std::memory_order_relaxed);
+    }
+
+   private:
+    void copy_in(std::uint64_t pos, const void* src, std::size_t n)
+    {
+        auto offset = pos & (capacity_ - 1);
+        auto first = std::min(n, capacity_ - offset);
+        std::memcpy(data_ + offset, src, first);
+        std::memcpy(data_, static_cast<const unsigned char*>(src) + first, n - first);
+    }
+
+    void copy_out(std::uint64_t pos, void* dst, std::size_t n) const
+    {
+        auto offset = pos & (capacity_ - 1);
+        auto first = std::min(n, capacity_ - offset);
+        std::memcpy(dst, data_ + offset, first);
+        std::memcpy(static_cast<unsigned char*>(dst) + first, data_, n - first);
+    }
+
+    header* header_ = nullptr;
+    unsigned char* data_ = nullptr;
+    std::size_t capacity_ = 0;
+};
+
+} // namespace detail
+
+// process_async
+//
+// Runs `f` on each element of a vector of inputs in a pool of forked worker
+// processes, for functions which are not thread-safe or which may crash the
+// process. Inputs and outputs are encoded with the given codecs and passed
+// through per-worker rings in shared memory; an idle worker sleeps on a futex,
+// so dispatching an element costs an encode, a copy and at most one wakeup.
+//
+// A worker which dies while running an element, for example from a
+// segmentation fault, is replaced with a new one. The element is retried up
+// to `crash_retries` times and then fails with an error describing how the
+// worker died; the other elements queued on it are run elsewhere. An
+// exception thrown by `f` fails its element with the exception's message.
+//
+// `f` is fixed when the pool is constructed, because the workers are forked
+// then, and again from the calling thread when a worker is replaced. Create
+// the pool early, before the process starts threads which may hold locks
+// `f` needs. Calls to `map_concurrently()` on one pool run one at a time.
+//
+// Workers exit once the parent process has gone. An idle or blocked worker
+// checks for this every `orphan_poll` (100ms); a worker still inside `f` exits
+// when `f` returns. The check uses `getppid()` rather than a parent death
+// signal, which Linux ties to the thread that forked the worker, not the
+// process, and would kill a replacement forked by a short-lived thread.
+//
+// auto f = [](const std::string& path) -> attempt_result_t<int, std::string> {
+//     return legacy_library_parse(path);
+// };
+// auto tasks = process_async<std::string, int>(f, {.workers = 8, .crash_retries = 1});
+// auto output = tasks.map_concurrently(paths);
+template <typename input_type, typename output_type, typename error_type=std::string>
+class process_async
+{
+    static_assert(std::is_constructible_v<error_type, std::string> || std::is_default_constructible_v<error_type>,
+                  "lt::async: process_async needs an error_type constructible from a message");
+
+    enum tag : std::uint32_t
+    {
+        input_tag,
+        output_tag,
+        error_tag,
+        exception_tag,
+    };
+
+    struct control_block
+    {
+        alignas(cache_line_size) detail::process_bell parent_bell;
+    };
+
+    struct worker_block
+    {
+        detail::shm_ring::header request;
+        detail::shm_ring::header response;
+        alignas(cache_line_size) detail::process_bell bell;
+        std::atomic<std::uint32_t> shutdown{0};
+    };
+
+    struct worker
+    {
+        pid_t pid = -1;
+        worker_block* block = nullptr;
+        detail::shm_ring request;
+        detail::shm_ring response;
+        std::deque<std::size_t> in_flight;
+    };
+
+   public:
+    using function_type = std::function<attempt_result_t<output_type, error_type>(const input_type&)>;
+
+    explicit process_async(function_type f,
+                           process_options options = {},
+                           codec<input_type> input_codec = bytes_codec<input_type>(),
+                           codec<output_type> output_codec = bytes_codec<output_type>(),
+                           codec<error_type> error_codec = bytes_codec<error_type>())
+        : f_(std::move(f)),
+          options_(options),
+          input_codec_(std::move(input_codec)),
+          output_codec_(std::move(output_codec)),
+          error_codec_(std::move(error_codec)),
+          parent_(getpid())
+    {
+        options_.workers = std::max<std::size_t>(1, options_.workers);
+        options_.window = std::max<std::size_t>(1, options_.window);
+        options_.ring_bytes = std::bit_ceil(std::max<std::size_t>(options_.ring_bytes, 4096));
+
+        block_bytes_ = round_up(sizeof(worker_block)) + 2 * options_.ring_bytes;
+        mapping_bytes_ = round_up(sizeof(control_block)) + options_.workers * block_bytes_;
+        mapping_ = mmap(nullptr, mapping_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (mapping_ == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(), "lt::async: mmap");
+        }
+
+        auto base = static_cast<unsigned char*>(mapping_);
+        control_ = new (base) control_block();
+        workers_.resize(options_.workers);
+        for (std::size_t w = 0; w < options_.workers; ++w) {
+            auto p = base + round_up(sizeof(control_block)) + w * block_bytes_;
+            auto data = p + round_up(sizeof(worker_block));
+            auto& wk = workers_[w];
+            wk.block = new (p) worker_block();
+            wk.request = detail::shm_ring(&wk.block->request, data, options_.ring_bytes);
+            wk.response = detail::shm_ring(&wk.block->response, data + options_.ring_bytes, options_.ring_bytes);
+        }
+
+        try {
+            for (std::size_t w = 0; w < options_.workers; ++w) {
+                start_worker(w);
+            }
+        } catch (...) {
+            stop_workers();
+            munmap(mapping_, mapping_bytes_);
+            throw;
+        }
+    }
+
+    process_async(const process_async&) = delete;
+    process_async& operator=(const process_async&) = delete;
+
+    ~process_async()
+    {
+        stop_workers();
+        munmap(mapping_, mapping_bytes_);
+    }
+
+    std::size_t size() const
+    {
+        return workers_.size();
+    }
+
+    // Number of workers which have died and been replaced.
+    std::size_t restarts() const
+    {
+        return restarts_.load(std::memory_order_relaxed);
+    }
+
+    // Run `f` on each element of `input` in the worker processes. As for
+    // `async::map_concurrently()`, the outputs are returned in input order,
+    // or the error of the first failed element.
+    aggregate_result_t<output_type, error_type> map_concurrently(const std::vector<input_type>& input)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto n = input.size();
+        auto results = std::vector<std::optional<attempt_result_t<output_type, error_type>>>(n);
+        auto crashes = std::vector<int>(n, 0);
+        auto pending = std::deque<std::size_t>();
+        for (std::size_t i = 0; i < n; ++i) {
+            pending.push_back(i);
+        }
+
+        auto remaining = n;
+        auto buffer = std::string();
+        auto payload = std::string();
+
+        auto finish = [&](std::size_t i, attempt_result_t<output_type, error_type> r) {
+            results[i].emplace(std::move(r));
+            --remaining;
+        };
+
+        while (remaining > 0) {
+            auto progress = false;
+
+            for (std::size_t w = 0; w < workers_.size(); ++w) {
+                auto& wk = workers_[w];
+                auto sent = false;
+                while (!pending.empty() && wk.in_flight.size() < options_.window) {
+                    auto i = pending.front();
+                    buffer.clear();
+                    try {
+                        input_codec_.encode(input[i], buffer);
+                    } catch (const std::exception& e) {
+                        pending.pop_front();
+                        finish(i, tl::unexpected(make_error(e.what())));
+                        progress = true;
+                        continue;
+                    }
+                    if (!wk.request.fits(buffer.size())) {
+                        pending.pop_front();
+                        finish(i, tl::unexpected(make_error("lt::async: input too large for the process ring")));
+                        progress = true;
+                        continue;
+                    }
+                    if (!wk.request.try_write(static_cast<std::uint32_t>(i), input_tag, buffer)) {
+                        break;
+                    }
+                    pending.pop_front();
+                    wk.in_flight.push_back(i);
+                    sent = true;
+                }
+                if (sent) {
+                    wk.block->bell.ring();
+                    progress = true;
+                }
+
+                if (drain(wk, payload, finish)) {
+                    wk.block->bell.ring();
+                    progress = true;
+                }
+            }
+
+            if (remaining == 0 || progress) {
+                continue;
+            }
+
+            auto timeout = timespec{0, 10'000'000};
+            control_->parent_bell.wait_unless([&] { return any_response(); }, &timeout);
+
+            if (!any_response()) {
+                reap(pending, crashes, payload, finish);
+            }
+        }
+
+        auto output = std::vector<output_type>();
+        output.reserve(n);
+        for (auto && r : results) {
+            if (!*r) {
+                return tl::unexpected(std::move(r->error()));
+            }
+            output.push_back(std::move(**r));
+        }
+        return output;
+    }
+
+   private:
+    // How often an idle worker checks that its parent is still alive.
+    static constexpr timespec orphan_poll{0, 100'000'000};
+
+    static std::size_t round_up(std::size_t n)
+    {
+        return (n + cache_line_size - 1) / cache_line_size * cache_line_size;
+    }
+
+    static error_type make_error(const std::string& message)
+    {
+        if constexpr (std::is_constructible_v<error_type, std::string>) {
+            return error_type(message);
+        } else {
+            return error_type();
+        }
+    }
+
+    static std::string describe_exit(int status)
+    {
+        if (WIFSIGNALED(status)) {
+            auto name = strsignal(WTERMSIG(status));
+            return "lt::async: worker process killed by signal " + std::to_string(WTERMSIG(status)) +
+                   (name ? std::string(" (") + name + ")" : std::string());
+        }
+        return "lt::async: worker process exited with status " + std::to_string(WEXITSTATUS(status));
+    }
+
+    bool any_response() const
+    {
+        return std::any_of(workers_.begin(), workers_.end(), [](const worker& wk) { return !wk.response.empty(); });
+    }
+
+    // Collect the responses waiting from one worker. Returns true if there
+    // were any.
+    template <typename F>
+    bool drain(worker& wk, std::string& payload, F& finish)
+    {
+        auto any = false;
+        std::uint32_t index;
+        std::uint32_t t;
+        while (wk.response.try_read(index, t, payload)) {
+            any = true;
+            wk.in_flight.pop_front();
+            try {
+                if (t == output_tag) {
+                    finish(index, output_codec_.decode(payload));
+                } else if (t == error_tag) {
+                    finish(index, tl::unexpected(error_codec_.decode(payload)));
+                } else {
+                    finish(index, tl::unexpected(make_error(payload)));
+                }
+            } catch (const std::exception& e) {
+                finish(index, tl::unexpected(make_error(e.what())));
+            }
+        }
+        return any;
+    }
+
+    // Replace any worker which has died. The element it was running is
+    // retried or failed, and the rest of its queue is run again.
+    template <typename F>
+    void reap(std::deque<std::size_t>& pending, std::vector<int>& crashes, std::string& payload, F& finish)
+    {
+        for (std::size_t w = 0; w < workers_.size(); ++w) {
+            auto& wk = workers_[w];
+            auto status = 0;
+            if (waitpid(wk.pid, &status, WNOHANG) != wk.pid) {
+                continue;
+            }
+
+            drain(wk, payload, finish);
+            if (!wk.in_flight.empty()) {
+                auto crashed = wk.in_flight.front();
+                wk.in_flight.pop_front();
+                if (crashes[crashed]++ < options_.crash_retries) {
+                    wk.in_flight.push_front(crashed);
+                } else {
+                    finish(crashed, tl::unexpected(make_error(describe_exit(status))));
+                }
+                pending.insert(pending.begin(), wk.in_flight.begin(), wk.in_flight.end());
+                wk.in_flight.clear();
+            }
+
+            wk.request.reset();
+            wk.response.reset();
+            restarts_.fetch_add(1, std::memory_order_relaxed);
+            start_worker(w);
+        }
+    }
+
+    void start_worker(std::size_t w)
+    {
+        auto pid = fork();
+        if (pid < 0) {
+            throw std::system_error(errno, std::generic_category(), "lt::async: fork");
+        }
+        if (pid == 0) {
+            worker_main(workers_[w]);
+        }
+        workers_[w].pid = pid;
+    }
+
+    void stop_workers()
+    {
+        for (auto && wk : workers_) {
+            if (wk.pid > 0) {
+                wk.block->shutdown.store(1, std::memory_order_seq_cst);
+                wk.block->bell.ring();
+            }
+        }
+        for (auto && wk : workers_) {
+            if (wk.pid > 0) {
+                while (waitpid(wk.pid, nullptr, 0) < 0 && errno == EINTR) {
+                }
+                wk.pid = -1;
+            }
+        }
+    }
+
+    // Exit the worker process if the parent has gone, which leaves the
+    // worker re-parented to init or a subreaper.
+    void exit_if_orphaned() const
+    {
+        if (getppid() != parent_) {
+            _exit(0);
+        }
+    }
+
+    // Body of a worker process. Never returns.
+    [[noreturn]] void worker_main(worker& wk)
+    {
+        exit_if_orphaned();
+
+        constexpr int spin_limit = 64;
+        auto payload = std::string();
+        auto reply = std::string();
+        auto& block = *wk.block;
+
+        for (;;) {
+            std::uint32_t index;
+            std::uint32_t t;
+            if (wk.request.try_read(index, t, payload)) {
+                reply.clear();
+                auto reply_tag = output_tag;
+                try {
+                    auto r = f_(input_codec_.decode(payload));
+                    if (r) {
+                        output_codec_.encode(*r, reply);
+                    } else {
+                        reply_tag = error_tag;
+                        error_codec_.encode(r.error(), reply);
+                    }
+                } catch (const std::exception& e) {
+                    reply_tag = exception_tag;
+                    reply = e.what();
+                } catch (...) {
+                    reply_tag = exception_tag;
+                    reply = "lt::async: unknown exception in worker process";
+                }
+                if (!wk.response.fits(reply.size())) {
+                    reply_tag = exception_tag;
+                    reply = "lt::async: output too large for the process ring";
+                }
+
+                while (!wk.response.try_write(index, reply_tag, reply)) {
+                    auto timeout = orphan_poll;
+                    block.bell.wait_unless(
+                        [&] {
+                            return wk.response.can_write(reply.size()) ||
+                                   block.shutdown.load(std::memory_order_relaxed) != 0;
+                        },
+                        &timeout);
+                    if (block.shutdown.load(std::memory_order_relaxed) != 0) {
+                        _exit(0);
+                    }
+                    exit_if_orphaned();
+                }
+                control_->parent_bell.ring();
+                continue;
+            }
+
+            if (block.shutdown.load(std::memory_order_relaxed) != 0) {
+                _exit(0);
+            }
+
+            auto spins = 0;
+            while (spins < spin_limit && wk.request.empty()) {
+                std::this_thread::yield();
+                ++spins;
+            }
+            if (spins == spin_limit) {
+                auto timeout = orphan_poll;
+                block.bell.wait_unless(
+                    [&] { return !wk.request.empty() || block.shutdown.load(std::memory_order_relaxed) != 0; },
+                    &timeout);
+                exit_if_orphaned();
+            }
+        }
+    }
+
+    function_type f_;
+    process_options options_;
+    codec<input_type> input_codec_;
+    codec<output_type> output_codec_;
+    codec<error_type> error_codec_;
+    pid_t parent_;
+
+    void* mapping_ = nullptr;
+    std::size_t mapping_bytes_ = 0;
+    std::size_t block_bytes_ = 0;
+    control_block* control_ = nullptr;
+    std::vector<worker> workers_;
+
+    std::mutex mutex_;
+    std::atomic<std::size_t> restarts_{0};
+};
+
+} // namespace lt::async
@@ -0,0 +1,298 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+#include "lt/async/executor.h"
+#include "lt/async/fiber.h"
+
+namespace lt::async
+{
+
+// rate_limit_stats
+//
+// Configured versus achieved rate of a `token_bucket`. The achieved rate is
+// measured between the first and last permits granted.
+struct rate_limit_stats
+{
+    double configured_rate;
+    std::size_t burst;
+    std::uint64_t permits;
+    double achieved_rate;
+};
+
+// token_bucket
+//
+// Thread-safe token bucket allowing `rate` permits per second on average and
+// bursts of up to `burst` permits. It is implemented as a generic cell rate
+// algorithm: a single atomic holds the theoretical arrival time of the next
+// permit, so taking a permit is one CAS and never blocks.
+//
+// `reserve()` takes a permit and returns the time at which it may be used,
+// leaving the waiting to the caller.
+//
+// `rate` must be positive; zero, negative and NaN rates throw
+// `std::invalid_argument`.
+//
+// auto bucket = token_bucket(100.0, 10);  // 100 requests/s, bursts of 10
+// tasks.set_rate_limiter(bucket);
+class token_bucket
+{
+   public:
+    using clock = std::chrono::steady_clock;
+
+    token_bucket(double rate, std::size_t burst = 1)
+        : rate_(checked_rate(rate)),
+          burst_(std::max<std::size_t>(1, burst)),
+          interval_ns_(static_cast<std::int64_t>(1e9 / rate)),
+          tolerance_ns_(interval_ns_ * static_cast<std::int64_t>(burst_ - 1))
+    {
+    }
+
+    token_bucket(const token_bucket&) = delete;
+    token_bucket& operator=(const token_bucket&) = delete;
+
+    double rate() const
+    {
+        return rate_;
+    }
+
+    std::size_t burst() const
+    {
+        return burst_;
+    }
+
+    // Take a permit, returning the time from which it may be used.
+    clock::time_point reserve()
+    {
+        auto now = to_ns(clock::now());
+        auto tat = tat_ns_.load(std::memory_order_relaxed);
+        auto when = now;
+
+        for (;;) {
+            when = std::max(now, tat - tolerance_ns_);
+            auto next = std::max(tat, now) + interval_ns_;
+            if (tat_ns_.compare_exchange_weak(tat, next, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+
+        record(when);
+        return clock::time_point(clock::duration(std::chrono::nanoseconds(when)));
+    }
+
+    // Take a permit if one is available now.
+    bool try_acquire()
+    {
+        auto now = to_ns(clock::now());
+        auto tat = tat_ns_.load(std::memory_order_relaxed);
+
+        for (;;) {
+            if (tat - tolerance_ns_ > now) {
+                return false;
+            }
+            auto next = std::max(tat, now) + interval_ns_;
+            if (tat_ns_.compare_exchange_weak(tat, next, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+
+        record(now);
+        return true;
+    }
+
+    // Take a permit, waiting for it if necessary. A fiber waits by parking.
+    void acquire()
+    {
+        this_fiber::sleep_until(reserve());
+    }
+
+    rate_limit_stats stats() const
+    {
+        auto permits = permits_.load(std::memory_order_relaxed);
+        auto first = first_ns_.load(std::memory_order_relaxed);
+        auto last = last_ns_.load(std::memory_order_relaxed);
+
+        auto achieved = 0.0;
+        if (permits > 1 && last > first) {
+            achieved = static_cast<double>(permits - 1) * 1e9 / static_cast<double>(last - first);
+        }
+        return {rate_, burst_, permits, achieved};
+    }
+
+   private:
+    static double checked_rate(double rate)
+    {
+        if (!(rate > 0)) {
+            throw std::invalid_argument("lt::async: a token_bucket rate must be positive");
+        }
+        return rate;
+    }
+
+    static std::int64_t to_ns(clock::time_point t)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+    }
+
+    void record(std::int64_t when)
+    {
+        if (permits_.fetch_add(1, std::memory_order_relaxed) == 0) {
+            first_ns_.store(when, std::memory_order_relaxed);
+        }
+
+        auto last = last_ns_.load(std::memory_order_relaxed);
+        while (when > last && !last_ns_.compare_exchange_weak(last, when, std::memory_order_relaxed)) {
+        }
+    }
+
+    const double rate_;
+    const std::size_t burst_;
+    const std::int64_t interval_ns_;
+    const std::int64_t tolerance_ns_;
+
+    alignas(cache_line_size) std::atomic<std::int64_t> tat_ns_{0};
+
+    std::atomic<std::uint64_t> permits_{0};
+    std::atomic<std::int64_t> first_ns_{0};
+    std::atomic<std::int64_t> last_ns_{0};
+};
+
+namespace detail
+{
+
+// paced_batch
+//
+// Shared state of one call to `rate_limited_bulk()`. The dispatching thread
+// releases elements in index order as their permits come due, and runners
+// claim released elements. The state is reference counted because a runner
+// may be dequeued after the batch has completed, in which case it finds no
+// work and exits.
+struct paced_batch
+{
+    paced_batch(std::size_t n, std::size_t max_runners, const std::function<void(std::size_t)>& fn)
+        : n(n), max_runners(max_runners), fn(&fn)
+    {
+    }
+
+    // Claim a released element, if one is left.
+    bool claim(std::size_t& i)
+    {
+        i = next.load(std::memory_order_relaxed);
+        do {
+            if (i >= released.load(std::memory_order_seq_cst)) {
+                return false;
+            }
+        } while (!next.compare_exchange_weak(i, i + 1, std::memory_order_relaxed));
+        return true;
+    }
+
+    void run_one(std::size_t i)
+    {
+        try {
+            (*fn)(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+
+        if (done.fetch_add(1, std::memory_order_acq_rel) + 1 == n) {
+            finished.set();
+        }
+    }
+
+    // Run as a posted runner until no released element is left. A runner
+    // which finds an element released just as it was leaving stays on,
+    // unless the dispatcher has already posted another in its place.
+    void run()
+    {
+        for (;;) {
+            auto i = std::size_t(0);
+            while (claim(i)) {
+                run_one(i);
+            }
+
+            runners.fetch_sub(1, std::memory_order_seq_cst);
+            if (next.load(std::memory_order_relaxed) >= released.load(std::memory_order_seq_cst)) {
+                return;
+            }
+            if (runners.fetch_add(1, std::memory_order_seq_cst) >= max_runners) {
+                runners.fetch_sub(1, std::memory_order_seq_cst);
+                return;
+            }
+        }
+    }
+
+    // Called by the dispatcher once element `i` may start. Posts a runner
+    // unless enough are already running.
+    void release(executor& e, const std::shared_ptr<paced_batch>& self, std::size_t i)
+    {
+        released.store(i + 1, std::memory_order_seq_cst);
+        if (runners.load(std::memory_order_seq_cst) < max_runners) {
+            runners.fetch_add(1, std::memory_order_seq_cst);
+            e.post([self] { self->run(); });
+        }
+    }
+
+    // Wait for every element to complete, then rethrow any exception. A
+    // waiting fiber parks.
+    void wait()
+    {
+        finished.wait();
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    const std::size_t n;
+    const std::size_t max_runners;
+    const std::function<void(std::size_t)>* fn;
+
+    alignas(cache_line_size) std::atomic<std::size_t> next{0};
+    alignas(cache_line_size) std::atomic<std::size_t> released{0};
+    std::atomic<std::size_t> runners{0};
+    std::atomic<std::size_t> done{0};
+    event finished;
+
+    std::mutex error_mutex;
+    std::exception_ptr error;
+};
+
+// Run fn(0) ... fn(n - 1) on `e`, each only once it has a permit from
+// `bucket`. The calling thread reserves the permits in index order and
+// sleeps until each is due, or parks if it is a fiber, before releasing the
+// element to runners posted on `e`; so no worker ever waits for a permit.
+// Once every element is released, the calling thread claims any left
+// unclaimed, so a call nested inside an element makes progress even when no
+// runner is picked up.
+inline void rate_limited_bulk(executor& e, token_bucket& bucket, std::size_t n,
+                              const std::function<void(std::size_t)>& fn)
+{
+    if (n == 0) {
+        return;
+    }
+
+    auto state = std::make_shared<paced_batch>(n, std::max<std::size_t>(1, e.concurrency()), fn);
+    for (std::size_t i = 0; i < n; ++i) {
+        this_fiber::sleep_until(bucket.reserve());
+        state->release(e, state, i);
+    }
+
+    auto i = std::size_t(0);
+    while (state->claim(i)) {
+        state->run_one(i);
+    }
+    state->wait();
+}
+
+} // namespace detail
+
+} // namespace lt::async
@@ -0,0 +1,505 @@
+#pragma once
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "tl/expected.hpp"
+
+#include "lt/async/fiber.h"
+
+namespace lt::async
+{
+
+// ready_result
+//
+// Result of waiting for readiness on a file descriptor: the epoll events which
+// were reported, or `errc::timed_out` / `errc::operation_canceled`.
+using ready_result = tl::expected<std::uint32_t, std::error_code>;
+
+// reactor
+//
+// Readiness-based waiting for element functions, built on epoll. Waiters are
+// keyed by file descriptor and event mask; each descriptor is armed one-shot
+// with the union of its waiters' masks, and re-armed for the waiters which
+// remain after an event. Timers share a single timerfd armed for the earliest
+// deadline, and an eventfd wakes the reactor thread for shutdown.
+//
+// The blocking-style `wait_ready()` and `sleep_for()` park the calling fiber
+// when run on a `fiber_pool`, so socket-based actions can wait for readiness
+// without holding a thread; elsewhere they block the calling thread.
+//
+// Callbacks passed to `async_wait()` and `async_sleep_until()` run on the
+// reactor thread and should be short.
+//
+// A reactor is a `timer_source`: a `fiber_pool` given it by
+// `set_timer_source()` times the delays between `lt::retry` attempts, and other
+// sleeps and waits under `LT_ASYNC_DEFINE_FIBER_WAITS`, on its timerfd.
+//
+// If epoll fails, the reactor stops: every wait then completes with the error,
+// pending timers fire at once, and new timers throw `std::system_error`.
+//
+// auto r = reactor();
+// auto f = [&](const request& req) -> attempt_result_t<response> {
+//     auto fd = connect_nonblocking(req.address);
+//     ...
+//     auto ready = r.wait_ready(fd, EPOLLIN, 100ms);
+//     if (!ready) {
+//         return tl::unexpected(ready.error().message());
+//     }
+//     ... read(fd, ...);
+//     return resp;
+// };
+class reactor final : public timer_source
+{
+   public:
+    using clock = std::chrono::steady_clock;
+
+    reactor()
+    {
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (epoll_fd_ < 0 || wake_fd_ < 0 || timer_fd_ < 0) {
+            auto ec = std::error_code(errno, std::system_category());
+            close_fds();
+            throw std::system_error(ec, "lt::async::reactor");
+        }
+
+        for (auto fd : {wake_fd_, timer_fd_}) {
+            auto ev = epoll_event();
+            ev.events = EPOLLIN;
+            ev.data.fd = fd;
+            if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0) {
+                auto ec = std::error_code(errno, std::system_category());
+                close_fds();
+                throw std::system_error(ec, "lt::async::reactor");
+            }
+        }
+
+        thread_ = std::thread([this] { run(); });
+    }
+
+    reactor(const reactor&) = delete;
+    reactor& operator=(const reactor&) = delete;
+
+    ~reactor()
+    {
+        stop_.store(true, std::memory_order_release);
+        auto one = std::uint64_t(1);
+        [[maybe_unused]] auto n = ::write(wake_fd_, &one, sizeof(one));
+        thread_.join();
+        close_fds();
+    }
+
+    // Call `done` once `fd` reports any of `events`, or an error or hangup.
+    // Returns an id which can be passed to `cancel()`.
+    std::uint64_t async_wait(int fd, std::uint32_t events, std::function<void(ready_result)> done)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        auto id = ++last_id_;
+        if (failure_) {
+            auto ec = failure_;
+            lock.unlock();
+            done(tl::unexpected(ec));
+            return id;
+        }
+
+        auto& entry = fds_[fd];
+        entry.waiters.push_back({id, events, std::move(done)});
+
+        if (auto ec = arm(fd, entry)) {
+            auto w = std::move(entry.waiters.back());
+            entry.waiters.pop_back();
+            lock.unlock();
+            w.done(tl::unexpected(ec));
+        }
+        return id;
+    }
+
+    // Call `done` at `deadline`. Returns an id which can be passed to
+    // `cancel_timer()`.
+    std::uint64_t async_sleep_until(clock::time_point deadline, std::function<void()> done) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (failure_) {
+            throw std::system_error(failure_, "lt::async::reactor");
+        }
+
+        auto id = ++last_id_;
+        auto earliest = timers_.empty() || deadline < timers_.begin()->first.first;
+        if (earliest) {
+            if (auto ec = arm_timer(deadline)) {
+                throw std::system_error(ec, "lt::async::reactor");
+            }
+        }
+        timers_.emplace(std::make_pair(deadline, id), std::move(done));
+        timer_deadlines_.emplace(id, deadline);
+        return id;
+    }
+
+    // Cancel a timer without calling its callback. Returns false if it has
+    // already fired.
+    bool cancel_timer(std::uint64_t id) override
+    {
+        // Destroyed once the lock is released, as its captures may use it.
+        auto cancelled = std::function<void()>();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            auto it = timer_deadlines_.find(id);
+            if (it == timer_deadlines_.end()) {
+                return false;
+            }
+
+            auto t = timers_.find(std::make_pair(it->second, id));
+            cancelled = std::move(t->second);
+            timers_.erase(t);
+            timer_deadlines_.erase(it);
+        }
+        return true;
+    }
+
+    // Cancel a readiness wait, completing it with `errc::operation_canceled`.
+    // Returns false if it has already completed.
+    bool cancel(int fd, std::uint64_t id)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        auto it = fds_.find(fd);
+        if (it == fds_.end()) {
+            return false;
+        }
+
+        auto& waiters = it->second.waiters;
+        for (auto w = waiters.begin(); w != waiters.end(); ++w) {
+            if (w->id == id) {
+                auto cancelled = std::move(*w);
+                waiters.erase(w);
+                arm(fd, it->second);
+                lock.unlock();
+                cancelled.done(tl::unexpected(std::make_error_code(std::errc::operation_canceled)));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Cancel every wait on `fd` and stop watching it. Call this before closing
+    // a descriptor which still has waiters.
+    void forget(int fd)
+    {
+        auto cancelled = std::vector<waiter>();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = fds_.find(fd);
+            if (it == fds_.end()) {
+                return;
+            }
+            cancelled = std::move(it->second.waiters);
+            fds_.erase(it);
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+        }
+
+        for (auto && w : cancelled) {
+            w.done(tl::unexpected(std::make_error_code(std::errc::operation_canceled)));
+        }
+    }
+
+    // Wait until `fd` reports any of `events`, optionally giving up after
+    // `timeout` with `errc::timed_out`.
+    ready_result wait_ready(int fd, std::uint32_t events,
+                            std::optional<clock::duration> timeout = std::nullopt)
+    {
+        struct wait_state
+        {
+            detail::event ready;
+            std::atomic<bool> claimed{false};
+            std::optional<ready_result> result;
+        };
+        auto state = std::make_shared<wait_state>();
+
+        auto finish = [state](ready_result r) {
+            if (!state->claimed.exchange(true, std::memory_order_acq_rel)) {
+                state->result.emplace(r);
+                state->ready.set();
+            }
+        };
+
+        auto id = async_wait(fd, events, finish);
+        auto timer_id = std::optional<std::uint64_t>();
+        if (timeout && !state->ready.is_set()) {
+            timer_id = async_sleep_until(clock::now() + *timeout, [this, fd, id, finish] {
+                finish(tl::unexpected(std::make_error_code(std::errc::timed_out)));
+                cancel(fd, id);
+            });
+        }
+
+        state->ready.wait();
+        if (timer_id) {
+            cancel_timer(*timer_id);
+        }
+        return *state->result;
+    }
+
+    // Suspend the calling fiber, or block the calling thread, until `deadline`.
+    void sleep_until(clock::time_point deadline)
+    {
+        auto ready = std::make_shared<detail::event>();
+        async_sleep_until(deadline, [ready] { ready->set(); });
+        ready->wait();
+    }
+
+    template <typename Rep, typename Period>
+    void sleep_for(const std::chrono::duration<Rep, Period>& d)
+    {
+        sleep_until(clock::now() + std::chrono::duration_cast<clock::duration>(d));
+    }
+
+   private:
+    struct waiter
+    {
+        std::uint64_t id;
+        std::uint32_t events;
+        std::function<void(ready_result)> done;
+    };
+
+    struct fd_entry
+    {
+        std::vector<waiter> waiters;
+        bool registered = false;
+    };
+
+    // Arm `fd` one-shot for the union of its waiters' masks. Called with
+    // `mutex_` held.
+    std::error_code arm(int fd, fd_entry& entry)
+    {
+        auto mask = std::uint32_t(0);
+        for (auto && w : entry.waiters) {
+            mask |= w.events;
+        }
+        if (mask == 0) {
+            return {};
+        }
+
+        auto ev = epoll_event();
+        ev.events = mask | EPOLLONESHOT;
+        ev.data.fd = fd;
+
+        auto r = epoll_ctl(epoll_fd_, entry.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev);
+        if (r != 0 && entry.registered && errno == ENOENT) {
+            // The descriptor was closed and reused since it was registered.
+            r = epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
+        }
+        if (r != 0) {
+            return std::error_code(errno, std::system_category());
+        }
+
+        entry.registered = true;
+        return {};
+    }
+
+    // Called with `mutex_` held.
+    std::error_code arm_timer(clock::time_point deadline)
+    {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+        auto spec = itimerspec();
+        spec.it_value.tv_sec = ns / 1000000000;
+        spec.it_value.tv_nsec = ns % 1000000000;
+        if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+            spec.it_value.tv_nsec = 1;
+        }
+        if (timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr) != 0) {
+            return std::error_code(errno, std::system_category());
+        }
+        return {};
+    }
+
+    void dispatch(int fd, std::uint32_t revents)
+    {
+        auto ready = std::vector<waiter>();
+        auto unarmed = std::vector<waiter>();
+        auto failure = std::error_code();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = fds_.find(fd);
+            if (it == fds_.end()) {
+                return;
+            }
+
+            auto& waiters = it->second.waiters;
+            auto failed = (revents & (EPOLLERR | EPOLLHUP)) != 0;
+            for (auto w = waiters.begin(); w != waiters.end();) {
+                if (failed || (w->events & revents) != 0) {
+                    ready.push_back(std::move(*w));
+                    w = waiters.erase(w);
+                } else {
+                    ++w;
+                }
+            }
+            failure = arm(fd, it->second);
+            if (failure) {
+                // The waiters left would never be woken.
+                for (auto && w : waiters) {
+                    unarmed.push_back(std::move(w));
+                }
+                waiters.clear();
+            }
+        }
+
+        for (auto && w : ready) {
+            w.done(revents);
+        }
+        for (auto && w : unarmed) {
+            w.done(tl::unexpected(failure));
+        }
+    }
+
+    // Returns false if re-arming the timer failed, which stops the reactor.
+    bool fire_timers()
+    {
+        auto expirations = std::uint64_t(0);
+        [[maybe_unused]] auto n = ::read(timer_fd_, &expirations, sizeof(expirations));
+
+        auto expired = std::vector<std::function<void()>>();
+        auto ec = std::error_code();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto now = clock::now();
+            while (!timers_.empty() && timers_.begin()->first.first <= now) {
+                auto t = timers_.begin();
+                expired.push_back(std::move(t->second));
+                timer_deadlines_.erase(t->first.second);
+                timers_.erase(t);
+            }
+            if (!timers_.empty()) {
+                ec = arm_timer(timers_.begin()->first.first);
+            }
+        }
+
+        for (auto && done : expired) {
+            done();
+        }
+        if (ec) {
+            fail(ec);
+            return false;
+        }
+        return true;
+    }
+
+    // Stop after an epoll or timerfd error: complete every wait with `ec` and
+    // fire every timer, since nothing will wake them now.
+    void fail(std::error_code ec)
+    {
+        auto waiters = std::vector<waiter>();
+        auto expired = std::vector<std::function<void()>>();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            failure_ = ec;
+            for (auto && [fd, entry] : fds_) {
+                for (auto && w : entry.waiters) {
+                    waiters.push_back(std::move(w));
+                }
+            }
+            fds_.clear();
+            for (auto && [key, done] : timers_) {
+                expired.push_back(std::move(done));
+            }
+            timers_.clear();
+            timer_deadlines_.clear();
+        }
+
+        for (auto && w : waiters) {
+            w.done(tl::unexpected(ec));
+        }
+        for (auto && done : expired) {
+            done();
+        }
+    }
+
+    void run()
+    {
+        constexpr int max_events = 64;
+        epoll_event events[max_events];
+
+        while (!stop_.load(std::memory_order_acquire)) {
+            auto n = epoll_wait(epoll_fd_, events, max_events, -1);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                fail(std::error_code(errno, std::system_category()));
+                return;
+            }
+            for (int i = 0; i < n; ++i) {
+                auto fd = events[i].data.fd;
+                if (fd == wake_fd_) {
+                    auto value = std::uint64_t(0);
+                    [[maybe_unused]] auto r = ::read(wake_fd_, &value, sizeof(value));
+                } else if (fd == timer_fd_) {
+                    if (!fire_timers()) {
+                        return;
+                    }
+                } else {
+                    dispatch(fd, events[i].events);
+                }
+            }
+        }
+    }
+
+    void close_fds()
+    {
+        for (auto fd : {epoll_fd_, wake_fd_, timer_fd_}) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+    }
+
+    int epoll_fd_ = -1;
+    int wake_fd_ = -1;
+    int timer_fd_ = -1;
+
+    std::mutex mutex_;
+    std::uint64_t last_id_ = 0;
+    std::unordered_map<int, fd_entry> fds_;
+
+    // Timers by deadline and id, and the deadline of each timer by id, so
+    // that a timer can be cancelled.
+    std::map<std::pair<clock::time_point, std::uint64_t>, std::function<void()>> timers_;
+    std::unordered_map<std::uint64_t, clock::time_point> timer_deadlines_;
+
+    // Set once the reactor has stopped on an error.
+    std::error_code failure_;
+
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+};
+
+// default_reactor
+//
+// Process-wide reactor.
+inline reactor& default_reactor()
+{
+    static reactor r;
+    return r;
+}
+
+} // namespace lt::async
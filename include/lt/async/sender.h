@@ -0,0 +1,337 @@
+#pragma once
+
+// Sender/receiver (P2300) integration, available when the stdexec reference
+// implementation is on the include path.
+
+#if __has_include(<stdexec/execution.hpp>)
+
+#include <stdexec/execution.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "tl/expected.hpp"
+
+#include "lt/async/async.h"
+
+#define LT_ASYNC_HAS_SENDERS 1
+
+namespace lt::async
+{
+
+// scheduler_executor
+//
+// Adapts a P2300 scheduler to the `executor` interface, so that `basic_async`
+// and the classes built on it run their elements on a scheduler which the
+// application already owns, rather than on threads of their own.
+// `concurrency` is the number of elements the scheduler can run at once,
+// such as the size of the thread pool behind it.
+//
+// auto pool = exec::static_thread_pool(8);
+// auto ex = scheduler_executor(pool.get_scheduler(), 8);
+// auto tasks = basic_async<input_type, output_type, std::string, decltype(ex)>(ex);
+template <stdexec::scheduler scheduler_type>
+class scheduler_executor final : public executor
+{
+   public:
+    explicit scheduler_executor(scheduler_type scheduler,
+                                std::size_t concurrency = std::max<std::size_t>(1, std::thread::hardware_concurrency()))
+        : scheduler_(std::move(scheduler)),
+          concurrency_(std::max<std::size_t>(1, concurrency))
+    {
+    }
+
+    const scheduler_type& scheduler() const
+    {
+        return scheduler_;
+    }
+
+    std::size_t concurrency() const override
+    {
+        return concurrency_;
+    }
+
+    void post(task t) override
+    {
+        stdexec::start_detached(stdexec::schedule(scheduler_) | stdexec::then(std::move(t)));
+    }
+
+    // At most `concurrency() - 1` runners are scheduled, and they and the
+    // calling thread claim elements from a shared counter until none remain,
+    // so a batch costs a few scheduled operations however many elements it
+    // has, and a nested call makes progress when the scheduler is busy. A
+    // runner which starts after the batch has completed finds nothing to
+    // claim; the shared state outlives this call for it.
+    void bulk(std::size_t n, const std::function<void(std::size_t)>& fn) override
+    {
+        struct state
+        {
+            explicit state(std::size_t n, const std::function<void(std::size_t)>& fn)
+                : n(n),
+                  fn(fn),
+                  remaining(n)
+            {
+            }
+
+            // Claim and run elements until none remain.
+            void run()
+            {
+                for (auto i = next.fetch_add(1, std::memory_order_relaxed); i < n;
+                     i = next.fetch_add(1, std::memory_order_relaxed)) {
+                    try {
+                        fn(i);
+                    } catch (...) {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        if (!error) {
+                            error = std::current_exception();
+                        }
+                    }
+                    if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                        done.set();
+                    }
+                }
+            }
+
+            const std::size_t n;
+            const std::function<void(std::size_t)>& fn;
+            std::atomic<std::size_t> next{0};
+            std::atomic<std::size_t> remaining;
+            detail::event done;
+            std::mutex mutex;
+            std::exception_ptr error;
+        };
+
+        if (n == 0) {
+            return;
+        }
+
+        auto s = std::make_shared<state>(n, fn);
+        auto runners = std::min(n - 1, concurrency_ - 1);
+        for (std::size_t r = 0; r < runners; ++r) {
+            post([s] { s->run(); });
+        }
+        s->run();
+
+        s->done.wait();
+        if (s->error) {
+            std::rethrow_exception(s->error);
+        }
+    }
+
+   private:
+    scheduler_type scheduler_;
+    std::size_t concurrency_;
+};
+
+// expected_sender
+//
+// Sender of the result of `fn(stop)`, which returns a `tl::expected<T, E>`:
+// completes with `set_value(T)` or `set_error(E)`, with
+// `set_error(std::exception_ptr)` if `fn` throws, and with `set_stopped()` if
+// a stop was requested before or while it ran. A stop request on the
+// receiver's stop token is forwarded to the `std::stop_token` passed to `fn`.
+//
+// `fn` runs when the operation is started, on whichever execution resource
+// starts it; use `stdexec::starts_on()` to choose one. `start()` does not
+// return until `fn` has: for the senders below that is the whole batch,
+// which blocks the starting thread while its elements run on the executor of
+// `tasks`. Start them on a scheduler whose threads may block, not on an
+// event loop.
+template <typename fn_type>
+class expected_sender
+{
+    using result_type = std::invoke_result_t<fn_type&, std::stop_token>;
+    using value_type = typename result_type::value_type;
+    using error_type = typename result_type::error_type;
+
+    template <typename receiver_type>
+    class operation
+    {
+       public:
+        using operation_state_concept = stdexec::operation_state_t;
+
+        operation(fn_type fn, receiver_type receiver)
+            : fn_(std::move(fn)),
+              receiver_(std::move(receiver))
+        {
+        }
+
+        operation(const operation&) = delete;
+        operation& operator=(const operation&) = delete;
+
+        void start() & noexcept
+        {
+            auto token = stdexec::get_stop_token(stdexec::get_env(receiver_));
+            if (token.stop_requested()) {
+                stdexec::set_stopped(std::move(receiver_));
+                return;
+            }
+
+            auto source = std::stop_source();
+            auto forward_stop = [&source]() noexcept { source.request_stop(); };
+            using callback_type = stdexec::stop_callback_for_t<decltype(token), decltype(forward_stop)>;
+
+            auto result = std::optional<result_type>();
+            auto error = std::exception_ptr();
+            {
+                auto callback = callback_type(token, forward_stop);
+                try {
+                    result.emplace(fn_(source.get_token()));
+                } catch (...) {
+                    error = std::current_exception();
+                }
+            }
+
+            if (error) {
+                stdexec::set_error(std::move(receiver_), std::move(error));
+            } else if (token.stop_requested()) {
+                stdexec::set_stopped(std::move(receiver_));
+            } else if (*result) {
+                stdexec::set_value(std::move(receiver_), std::move(**result));
+            } else {
+                stdexec::set_error(std::move(receiver_), std::move(result->error()));
+            }
+        }
+
+       private:
+        fn_type fn_;
+        receiver_type receiver_;
+    };
+
+   public:
+    using sender_concept = stdexec::sender_t;
+    using completion_signatures = stdexec::completion_signatures<
+        stdexec::set_value_t(value_type),
+        stdexec::set_error_t(error_type),
+        stdexec::set_error_t(std::exception_ptr),
+        stdexec::set_stopped_t()>;
+
+    explicit expected_sender(fn_type fn)
+        : fn_(std::move(fn))
+    {
+    }
+
+    template <stdexec::receiver receiver_type>
+    operation<receiver_type> connect(receiver_type receiver) &&
+    {
+        return operation<receiver_type>(std::move(fn_), std::move(receiver));
+    }
+
+    template <stdexec::receiver receiver_type>
+        requires std::copy_constructible<fn_type>
+    operation<receiver_type> connect(receiver_type receiver) const&
+    {
+        return operation<receiver_type>(fn_, std::move(receiver));
+    }
+
+   private:
+    fn_type fn_;
+};
+
+namespace detail
+{
+
+// Wrap an element function so that elements which have not yet run when a
+// stop is requested return at once. Their placeholder error is never seen:
+// the sender completes with `set_stopped()`.
+template <typename F, typename input_type>
+auto stoppable_element(F f, std::stop_token stop)
+{
+    using result_type = std::invoke_result_t<F&, const input_type&>;
+    using error_type = typename result_type::error_type;
+    static_assert(std::is_default_constructible_v<error_type>,
+                  "lt::async: senders need a default-constructible error_type");
+
+    return [f = std::move(f), stop](const input_type& i) mutable -> result_type {
+        if (stop.stop_requested()) {
+            return tl::unexpected(error_type());
+        }
+        return f(i);
+    };
+}
+
+// Wrap a should_retry predicate so that elements stop retrying once a stop
+// is requested.
+template <typename S>
+auto stoppable_should_retry(S should_retry, std::stop_token stop)
+{
+    return [should_retry = std::move(should_retry), stop](auto status, const auto& o) mutable -> bool {
+        return !stop.stop_requested() && should_retry(status, o);
+    };
+}
+
+} // namespace detail
+
+// map_concurrently_sender
+//
+// `tasks.map_concurrently(f, input)` as a sender: completes with the vector of
+// outputs on the value channel, or the error of the first failed element on
+// the error channel. Elements run on the executor of `tasks`, which may be a
+// `scheduler_executor`; a stop request skips the elements which have not yet
+// started and completes with `set_stopped()`. `tasks` must outlive the
+// operation.
+//
+// auto work = stdexec::starts_on(sch, map_concurrently_sender(tasks, f, input))
+//           | stdexec::then([](std::vector<output_type> outputs) { ... });
+// stdexec::sync_wait(std::move(work));
+template <typename async_type, typename F, typename input_type>
+auto map_concurrently_sender(async_type& tasks, F f, std::vector<input_type> input)
+{
+    return expected_sender([&tasks, f = std::move(f), input = std::move(input)](std::stop_token stop) {
+        return tasks.map_concurrently(detail::stoppable_element<F, input_type>(f, stop), input);
+    });
+}
+
+// map_concurrently_retry_sender
+//
+// `tasks.map_concurrently_retry(should_retry, f, input)` as a sender. Once a
+// stop is requested, elements stop retrying after their current attempt.
+template <typename async_type, typename S, typename F, typename input_type>
+auto map_concurrently_retry_sender(async_type& tasks, S should_retry, F f, std::vector<input_type> input)
+{
+    return expected_sender(
+        [&tasks, should_retry = std::move(should_retry), f = std::move(f), input = std::move(input)](
+            std::stop_token stop) {
+            return tasks.map_concurrently_retry(detail::stoppable_should_retry(should_retry, stop),
+                                                detail::stoppable_element<F, input_type>(f, stop),
+                                                input);
+        });
+}
+
+// map_concurrently_preemptible_retry_sender
+//
+// `tasks.map_concurrently_preemptible_retry(cv, cv_mutex, cond, should_retry,
+// f, input)` as a sender. `cv`, `cv_mutex` and `cond` are shared with the
+// caller, as for the blocking call.
+template <typename async_type, typename C, typename S, typename F, typename input_type>
+auto map_concurrently_preemptible_retry_sender(async_type& tasks,
+                                               std::condition_variable& cv,
+                                               std::mutex& cv_mutex,
+                                               C cond,
+                                               S should_retry,
+                                               F f,
+                                               std::vector<input_type> input)
+{
+    return expected_sender([&tasks, &cv, &cv_mutex, cond = std::move(cond), should_retry = std::move(should_retry),
+                            f = std::move(f), input = std::move(input)](std::stop_token stop) {
+        return tasks.map_concurrently_preemptible_retry(cv, cv_mutex, cond,
+                                                        detail::stoppable_should_retry(should_retry, stop),
+                                                        detail::stoppable_element<F, input_type>(f, stop),
+                                                        input);
+    });
+}
+
+} // namespace lt::async
+
+#endif
@@ -0,0 +1,425 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lt/async/executor.h"
+#include "lt/async/fiber.h"
+
+namespace lt::async
+{
+
+class simulation;
+
+namespace detail
+{
+
+// The simulation whose carrier is the calling thread, if any.
+inline simulation*& this_simulation()
+{
+    thread_local simulation* s = nullptr;
+    return s;
+}
+
+inline timespec to_timespec(std::chrono::nanoseconds d)
+{
+    auto s = std::chrono::duration_cast<std::chrono::seconds>(d);
+    return timespec{static_cast<time_t>(s.count()), static_cast<long>((d - s).count())};
+}
+
+} // namespace detail
+
+// simulation
+//
+// Executor which runs elements on fibers of a single carrier thread against a
+// virtual clock, for testing and benchmarking code whose time is mostly spent
+// waiting, such as retries with realistic backoff policies. When every fiber
+// is waiting, the clock jumps to the earliest deadline instead of sleeping,
+// so a scenario which would take seconds runs in the time its element
+// functions take to compute.
+//
+// Fibers run one at a time, ready fibers in the order they became ready and
+// timers in deadline order, so a run is deterministic given deterministic
+// element functions. That holds for the work of a single `bulk()`, which
+// covers `map_concurrently()` and the retry classes; separate `post()` calls
+// from outside the simulation race with it in real time.
+//
+// `this_fiber::sleep_for()` takes virtual time on any simulation. For the
+// waits inside other code, notably the delays between retries in
+// `lt::retry`, define `LT_ASYNC_DEFINE_SIMULATED_TIME` in one source file.
+// It replaces the C library's sleeping, condition variable and monotonic
+// clock functions so that, on a simulation's fibers, `std::this_thread`
+// sleeps and `std::condition_variable` waits take virtual time and
+// `std::chrono::steady_clock` reads the virtual clock. Elsewhere they behave
+// as before.
+//
+// Element functions must not block their thread in other ways, such as on
+// I/O or on a `std::mutex` held across a wait, which would stall the whole
+// simulation.
+//
+// WARNING: `LT_ASYNC_DEFINE_SIMULATED_TIME` replaces `clock_gettime()` and the
+// sleep and condition variable functions for the whole process. It must
+// never be linked into a production build. It only compiles in targets which
+// define `LT_ASYNC_ENABLE_SIMULATED_TIME`, which only test targets should do.
+//
+// LT_ASYNC_DEFINE_SIMULATED_TIME;  // in one test .cpp file
+//
+// auto sim = lt::async::simulation();
+// auto tasks = async_retry<input_type, output_type>(
+//     constantDelay(100ms) + limitRetries(10), sim);
+// auto output = tasks.map_concurrently_retry(should_retry, f, input);
+// auto simulated = sim.elapsed();  // e.g. 1s of virtual time
+class simulation final : public executor, public detail::fiber_host
+{
+   public:
+    explicit simulation(std::size_t stack_size = 64 * 1024, std::size_t max_batch_fibers = 10000)
+        : stack_size_(stack_size),
+          max_batch_fibers_(std::max<std::size_t>(1, max_batch_fibers)),
+          start_(std::chrono::steady_clock::now()),
+          now_(start_.time_since_epoch().count())
+    {
+        carrier_ = std::thread([this] { carrier_loop(); });
+    }
+
+    simulation(const simulation&) = delete;
+    simulation& operator=(const simulation&) = delete;
+
+    ~simulation() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        carrier_.join();
+
+        auto& waits = detail::fiber_cond_waits::instance();
+        std::lock_guard<std::mutex> lock(waits.mutex);
+        for (auto && [cond, queue] : waits.waiters) {
+            auto n = queue.size();
+            std::erase_if(queue, [this](const auto& w) { return w.host == this; });
+            waits.count.fetch_sub(n - queue.size(), std::memory_order_relaxed);
+        }
+    }
+
+    // The virtual time, which starts at the real time when the simulation
+    // was created and only moves forward when every fiber is waiting.
+    std::chrono::steady_clock::time_point now() const override
+    {
+        return std::chrono::steady_clock::time_point(
+            std::chrono::steady_clock::duration(now_.load(std::memory_order_acquire)));
+    }
+
+    // Virtual time elapsed since the simulation was created.
+    std::chrono::nanoseconds elapsed() const
+    {
+        return now() - start_;
+    }
+
+    std::size_t concurrency() const override
+    {
+        return max_batch_fibers_;
+    }
+
+    void post(task t) override
+    {
+        auto* f = acquire_fiber();
+        f->job = std::move(t);
+        make_ready(f);
+    }
+
+    void bulk(std::size_t n, const std::function<void(std::size_t)>& fn) override
+    {
+        if (n == 0) {
+            return;
+        }
+
+        // Queue every runner at once, so that the carrier cannot move the
+        // clock on between them.
+        auto batch = std::make_shared<detail::fiber_batch>(n, fn);
+        auto runners = std::vector<detail::fiber*>(std::min(n, max_batch_fibers_));
+        for (auto & f : runners) {
+            f = acquire_fiber();
+            f->job = [batch] { batch->run(); };
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ready_.insert(ready_.end(), runners.begin(), runners.end());
+        }
+        cv_.notify_one();
+
+        batch->wait();
+    }
+
+    void make_ready(detail::fiber* f) override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ready_.push_back(f);
+        }
+        cv_.notify_one();
+    }
+
+    // Suspend the calling fiber until virtual time `deadline`.
+    void sleep_until(std::chrono::steady_clock::time_point deadline)
+    {
+        detail::suspend(detail::switch_action::sleep, deadline);
+    }
+
+    // As for any fiber host, but `deadline` is in virtual time.
+    int wait_on(pthread_cond_t* cond, pthread_mutex_t* mutex, std::chrono::steady_clock::time_point deadline) override
+    {
+        auto* self = detail::this_carrier().current;
+        auto id = std::uint64_t(0);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            id = ++next_wait_;
+            waits_[self] = id;
+        }
+
+        auto& waits = detail::fiber_cond_waits::instance();
+        waits.add(cond, this, self, id);
+
+        cond_wait_ = id;
+        pthread_mutex_unlock(mutex);
+        detail::suspend(detail::switch_action::sleep, deadline);
+        waits.remove(cond, self, id);
+        pthread_mutex_lock(mutex);
+
+        return now() < deadline ? 0 : ETIMEDOUT;
+    }
+
+    bool notify_waiter(detail::fiber* f, std::uint64_t id) override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = waits_.find(f);
+            if (it == waits_.end() || it->second != id) {
+                return false;
+            }
+            waits_.erase(it);
+            ready_.push_back(f);
+        }
+        cv_.notify_one();
+        return true;
+    }
+
+   private:
+    struct timer
+    {
+        std::chrono::steady_clock::time_point deadline;
+        std::uint64_t id;
+        detail::fiber* f;
+
+        bool operator>(const timer& other) const
+        {
+            return deadline != other.deadline ? deadline > other.deadline : id > other.id;
+        }
+    };
+
+    detail::fiber* acquire_fiber()
+    {
+        std::lock_guard<std::mutex> lock(free_mutex_);
+        if (!free_.empty()) {
+            auto* f = free_.back();
+            free_.pop_back();
+            return f;
+        }
+
+        fibers_.push_back(std::make_unique<detail::fiber>(this, stack_size_));
+        return fibers_.back().get();
+    }
+
+    void release_fiber(detail::fiber* f)
+    {
+        std::lock_guard<std::mutex> lock(free_mutex_);
+        free_.push_back(f);
+    }
+
+    // Switch into `f` and, once it switches back, do what it asked.
+    void run_fiber(detail::fiber* f)
+    {
+        auto& c = detail::this_carrier();
+        c.current = f;
+        c.action = detail::switch_action::none;
+        cond_wait_ = 0;
+
+        swapcontext(&c.context, &f->context);
+        c.current = nullptr;
+
+        switch (c.action) {
+            case detail::switch_action::yield:
+                make_ready(f);
+                break;
+            case detail::switch_action::sleep: {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto id = cond_wait_;
+                if (id == 0) {
+                    id = ++next_wait_;
+                    waits_[f] = id;
+                } else if (auto it = waits_.find(f); it == waits_.end() || it->second != id) {
+                    // Notified between starting to wait and switching out.
+                    break;
+                }
+                if (c.wake_at != std::chrono::steady_clock::time_point::max()) {
+                    timers_.push({c.wake_at, id, f});
+                }
+                break;
+            }
+            case detail::switch_action::park: {
+                auto expected = int(detail::fiber::running);
+                if (!f->state.compare_exchange_strong(expected, detail::fiber::parked, std::memory_order_acq_rel)) {
+                    // Woken between deciding to park and switching out.
+                    f->state.store(detail::fiber::running, std::memory_order_relaxed);
+                    make_ready(f);
+                }
+                break;
+            }
+            case detail::switch_action::finish:
+                release_fiber(f);
+                break;
+            case detail::switch_action::none:
+                break;
+        }
+    }
+
+    // Move the clock to the earliest deadline and make ready every fiber
+    // whose wait ends then. Timers of waits which were ended by a notify
+    // are dropped without moving the clock.
+    void advance()
+    {
+        if (!waiting(timers_.top())) {
+            timers_.pop();
+            return;
+        }
+
+        auto deadline = timers_.top().deadline;
+        now_.store(std::max(now_.load(std::memory_order_relaxed), deadline.time_since_epoch().count()),
+                   std::memory_order_release);
+
+        while (!timers_.empty() && timers_.top().deadline <= deadline) {
+            auto t = timers_.top();
+            timers_.pop();
+            if (waiting(t)) {
+                waits_.erase(t.f);
+                ready_.push_back(t.f);
+            }
+        }
+    }
+
+    bool waiting(const timer& t) const
+    {
+        auto it = waits_.find(t.f);
+        return it != waits_.end() && it->second == t.id;
+    }
+
+    void carrier_loop()
+    {
+        detail::this_simulation() = this;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            if (!ready_.empty()) {
+                auto* f = ready_.front();
+                ready_.pop_front();
+                lock.unlock();
+                run_fiber(f);
+                lock.lock();
+                continue;
+            }
+
+            if (!timers_.empty()) {
+                advance();
+                continue;
+            }
+
+            if (stop_) {
+                return;
+            }
+            cv_.wait(lock);
+        }
+    }
+
+    const std::size_t stack_size_;
+    const std::size_t max_batch_fibers_;
+    const std::chrono::steady_clock::time_point start_;
+
+    std::mutex free_mutex_;
+    std::vector<std::unique_ptr<detail::fiber>> fibers_;
+    std::vector<detail::fiber*> free_;
+
+    // Guards the queues and waits below, and parks the idle carrier.
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<detail::fiber*> ready_;
+    std::priority_queue<timer, std::vector<timer>, std::greater<timer>> timers_;
+    std::unordered_map<detail::fiber*, std::uint64_t> waits_;
+    std::uint64_t next_wait_ = 0;
+    bool stop_ = false;
+
+    std::atomic<std::chrono::steady_clock::rep> now_;
+
+    // Id of the condition variable wait the running fiber is switching out
+    // for, or 0. Only used on the carrier thread.
+    std::uint64_t cond_wait_ = 0;
+
+    std::thread carrier_;
+};
+
+} // namespace lt::async
+
+// LT_ASYNC_DEFINE_SIMULATED_TIME
+//
+// *** TEST BUILDS ONLY. NEVER LINK THIS INTO A PRODUCTION BINARY. ***
+//
+// Defines `LT_ASYNC_DEFINE_FIBER_WAITS`, under which sleeps and condition
+// variable waits on a simulation's fibers take its virtual time, and a
+// replacement for `clock_gettime()` which on a simulation's carrier reads
+// the virtual clock for `CLOCK_MONOTONIC`, and otherwise calls the C
+// library's own. The replacements interpose on every caller in the
+// process, including other libraries. Use it at namespace scope in exactly
+// one source file of a test program, followed by a semicolon. Linux and
+// glibc only; link with -ldl on glibc older than 2.34.
+//
+// The target must define `LT_ASYNC_ENABLE_SIMULATED_TIME`, for example with
+// `target_compile_definitions(my-test PRIVATE LT_ASYNC_ENABLE_SIMULATED_TIME)`;
+// without it the macro fails to compile.
+#if !defined(LT_ASYNC_ENABLE_SIMULATED_TIME)
+#define LT_ASYNC_DEFINE_SIMULATED_TIME                                                               \
+    static_assert(false, "lt::async: LT_ASYNC_DEFINE_SIMULATED_TIME replaces clock_gettime() "      \
+                         "for the whole process and is for test targets only; define "              \
+                         "LT_ASYNC_ENABLE_SIMULATED_TIME on the test target to use it")
+#else
+#define LT_ASYNC_DEFINE_SIMULATED_TIME                                                               \
+    LT_ASYNC_DEFINE_FIBER_WAITS;                                                                    \
+    extern "C" int clock_gettime(clockid_t clock, struct timespec* ts) noexcept                     \
+    {                                                                                               \
+        static auto next = ::lt::async::detail::next_symbol<int (*)(clockid_t, struct timespec*)>(  \
+            "clock_gettime");                                                                       \
+        if (clock == CLOCK_MONOTONIC && ::lt::async::detail::this_simulation()) {                   \
+            *ts = ::lt::async::detail::to_timespec(                                                 \
+                ::lt::async::detail::this_simulation()->now().time_since_epoch());                  \
+            return 0;                                                                               \
+        }                                                                                           \
+        return next(clock, ts);                                                                     \
+    }                                                                                               \
+    static_assert(true)
+#endif
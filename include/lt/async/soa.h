@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace lt::async
+{
+
+// soa_members
+//
+// Trait listing the data members of an aggregate, as pointers to members, so
+// that it can be returned as a struct of arrays. Specialise it for an output
+// type:
+//
+// struct sample { double t; float x; float y; };
+//
+// template <>
+// struct lt::async::soa_members<sample>
+// {
+//     static constexpr auto value = std::make_tuple(&sample::t, &sample::x, &sample::y);
+// };
+//
+// Tuple-like types (`std::tuple`, `std::pair`, `std::array`, or any type with
+// `std::tuple_size` and `get<I>`) need no specialisation.
+template <typename T>
+struct soa_members
+{
+};
+
+namespace detail
+{
+
+template <typename T>
+concept has_soa_members = requires { soa_members<T>::value; };
+
+template <typename T>
+concept tuple_like = requires { std::tuple_size<T>::value; };
+
+template <typename T>
+constexpr std::size_t soa_size()
+{
+    if constexpr (has_soa_members<T>) {
+        return std::tuple_size_v<std::remove_cvref_t<decltype(soa_members<T>::value)>>;
+    } else {
+        return std::tuple_size_v<T>;
+    }
+}
+
+template <std::size_t I, typename T>
+decltype(auto) soa_get(T& v)
+{
+    if constexpr (has_soa_members<T>) {
+        return (v.*std::get<I>(soa_members<T>::value));
+    } else {
+        using std::get;
+        return get<I>(v);
+    }
+}
+
+template <std::size_t I, typename T>
+using soa_field_t = std::remove_cvref_t<decltype(soa_get<I>(std::declval<T&>()))>;
+
+template <typename T, typename = std::make_index_sequence<soa_size<T>()>>
+struct soa_columns;
+
+template <typename T, std::size_t... I>
+struct soa_columns<T, std::index_sequence<I...>>
+{
+    // Workers write different rows of a column concurrently, which the
+    // packed std::vector<bool> does not allow.
+    static_assert((!std::is_same_v<soa_field_t<I, T>, bool> && ...),
+                  "lt::async: struct-of-arrays output does not support bool fields");
+
+    using type = std::tuple<std::vector<soa_field_t<I, T>>...>;
+
+    static type make(std::size_t n)
+    {
+        return type(std::vector<soa_field_t<I, T>>(n)...);
+    }
+
+    static void store(type& columns, std::size_t row, T&& v)
+    {
+        ((std::get<I>(columns)[row] = std::move(soa_get<I>(v))), ...);
+    }
+};
+
+} // namespace detail
+
+// soa_decomposable
+//
+// Types which can be returned as a struct of arrays.
+template <typename T>
+concept soa_decomposable = detail::has_soa_members<T> || detail::tuple_like<T>;
+
+// soa_columns_t
+//
+// Struct-of-arrays form of a vector of `T`: a tuple holding one vector per
+// field of `T`, in field order.
+template <typename T>
+using soa_columns_t = typename detail::soa_columns<T>::type;
+
+} // namespace lt::async
@@ -0,0 +1,453 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "lt/async/probes.h"
+
+namespace lt::async
+{
+
+namespace detail
+{
+
+// trace_event
+//
+// One span ('X') or instant ('i') in a trace, with times in nanoseconds
+// since the tracer was created. `name` must be a string literal.
+struct trace_event
+{
+    const char* name;
+    char phase;
+    std::uint32_t attempt;
+    std::uint64_t batch;
+    std::uint64_t index;
+    std::int64_t start_ns;
+    std::int64_t end_ns;
+};
+
+// trace_buffer
+//
+// Ring of the most recent events recorded by one thread. Only the owning
+// thread writes, so recording is a store and a release increment; once the
+// ring is full the oldest events are overwritten.
+class trace_buffer
+{
+   public:
+    trace_buffer(std::size_t capacity, std::uint32_t tid)
+        : events_(std::make_unique<trace_event[]>(capacity)),
+          mask_(capacity - 1),
+          tid_(tid)
+    {
+    }
+
+    void push(const trace_event& e)
+    {
+        auto h = head_.load(std::memory_order_relaxed);
+        events_[h & mask_] = e;
+        head_.store(h + 1, std::memory_order_release);
+    }
+
+    template <typename F>
+    void for_each(F&& f) const
+    {
+        auto h = head_.load(std::memory_order_acquire);
+        auto size = mask_ + 1;
+        for (auto i = h > size ? h - size : 0; i < h; ++i) {
+            f(events_[i & mask_]);
+        }
+    }
+
+    void clear()
+    {
+        head_.store(0, std::memory_order_relaxed);
+    }
+
+    std::uint32_t tid() const
+    {
+        return tid_;
+    }
+
+   private:
+    std::unique_ptr<trace_event[]> events_;
+    std::uint64_t mask_;
+    std::uint32_t tid_;
+    std::atomic<std::uint64_t> head_{0};
+};
+
+inline std::atomic<bool> tracing{false};
+
+// trace_context
+//
+// Batch and element which the current thread is running, so that spans and
+// probes further down, such as retry attempts, can be attributed to them. A
+// fiber carries its element's context with it when it suspends, and restores
+// it on whichever thread it resumes on.
+struct trace_context
+{
+    std::uint64_t batch = 0;
+    std::uint64_t index = 0;
+};
+
+// Not inlined, for the same reason as `this_worker()`: an element running on
+// a fiber may resume on a different thread than the one it suspended on, so
+// the address of the thread-local context must be looked up afresh.
+[[gnu::noinline]] inline trace_context& current_trace()
+{
+    thread_local trace_context c;
+    asm volatile("");
+    return c;
+}
+
+} // namespace detail
+
+// tracer
+//
+// Opt-in timeline of batch execution, for finding where the time in a slow
+// call went. While enabled, each batch run through `basic_async` records a
+// span for the batch, and for each element the time it was queued and the
+// time it ran; the retry classes add a span for each attempt, the backoff
+// between attempts, and an instant when a preemptible retry is woken. Events
+// go to per-thread ring buffers without locking, and `write_chrome_trace()`
+// writes them as Chrome trace JSON, which ui.perfetto.dev and
+// chrome://tracing load directly.
+//
+// While disabled, each batch and each attempt costs one predictable branch.
+// Define `LT_ASYNC_NO_TRACE` to compile tracing out entirely.
+//
+// lt::async::tracer::instance().enable();
+// auto output = tasks.map_concurrently_retry(should_retry, f, input);
+// lt::async::tracer::instance().disable();
+// auto out = std::ofstream("trace.json");
+// lt::async::tracer::instance().write_chrome_trace(out);
+class tracer
+{
+   public:
+    static tracer& instance()
+    {
+        static tracer t;
+        return t;
+    }
+
+    static bool enabled()
+    {
+#if defined(LT_ASYNC_NO_TRACE)
+        return false;
+#else
+        return detail::tracing.load(std::memory_order_relaxed);
+#endif
+    }
+
+    // Start recording. Threads which have not yet recorded get a ring of
+    // `events_per_thread` events, rounded up to a power of two.
+    void enable(std::size_t events_per_thread = std::size_t(1) << 16)
+    {
+        capacity_.store(std::bit_ceil(std::max<std::size_t>(events_per_thread, 2)), std::memory_order_relaxed);
+        detail::tracing.store(true, std::memory_order_relaxed);
+    }
+
+    void disable()
+    {
+        detail::tracing.store(false, std::memory_order_relaxed);
+    }
+
+    // Discard all recorded events. Only while no traced work is running.
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto && b : buffers_) {
+            b->clear();
+        }
+    }
+
+    std::int64_t now_ns() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch_)
+            .count();
+    }
+
+    std::uint64_t next_batch()
+    {
+        return batches_.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    void record(const detail::trace_event& e)
+    {
+        auto& buffer = this_thread_buffer();
+        if (!buffer) {
+            buffer = register_thread();
+        }
+        buffer->push(e);
+    }
+
+    // Write the recorded events as Chrome trace JSON. Events still being
+    // recorded while this runs may be torn, so disable tracing first.
+    void write_chrome_trace(std::ostream& out) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto flags = out.flags();
+        auto precision = out.precision();
+        out << std::fixed << std::setprecision(3);
+
+        auto pid = getpid();
+        auto first = true;
+        out << "{\"traceEvents\":[";
+        for (auto && b : buffers_) {
+            b->for_each([&](const detail::trace_event& e) {
+                out << (first ? "\n" : ",\n");
+                first = false;
+                out << "{\"name\":\"" << e.name << "\",\"cat\":\"lt.async\",\"ph\":\"" << e.phase
+                    << "\",\"ts\":" << e.start_ns / 1e3;
+                if (e.phase == 'X') {
+                    out << ",\"dur\":" << (e.end_ns - e.start_ns) / 1e3;
+                } else {
+                    out << ",\"s\":\"t\"";
+                }
+                out << ",\"pid\":" << pid << ",\"tid\":" << b->tid() << ",\"args\":{\"batch\":" << e.batch
+                    << ",\"index\":" << e.index << ",\"attempt\":" << e.attempt << "}}";
+            });
+        }
+        out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+   private:
+    tracer() = default;
+
+    // Not inlined, like `detail::current_trace()`, so that a fiber which
+    // records on one thread and then on another writes to each thread's own
+    // buffer.
+    [[gnu::noinline]] static detail::trace_buffer*& this_thread_buffer()
+    {
+        thread_local detail::trace_buffer* buffer = nullptr;
+        asm volatile("");
+        return buffer;
+    }
+
+    detail::trace_buffer* register_thread()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto tid = static_cast<std::uint32_t>(buffers_.size() + 1);
+        buffers_.push_back(std::make_unique<detail::trace_buffer>(capacity_.load(std::memory_order_relaxed), tid));
+        return buffers_.back().get();
+    }
+
+    std::chrono::steady_clock::time_point epoch_ = std::chrono::steady_clock::now();
+    std::atomic<std::size_t> capacity_{std::size_t(1) << 16};
+    std::atomic<std::uint64_t> batches_{0};
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<detail::trace_buffer>> buffers_;
+};
+
+namespace detail
+{
+
+inline void trace_span(const char* name, std::uint32_t attempt, std::int64_t start_ns, std::int64_t end_ns)
+{
+    auto& c = current_trace();
+    tracer::instance().record(trace_event{name, 'X', attempt, c.batch, c.index, start_ns, end_ns});
+}
+
+inline void trace_instant(const char* name, std::uint32_t attempt)
+{
+    auto& c = current_trace();
+    auto now = tracer::instance().now_ns();
+    tracer::instance().record(trace_event{name, 'i', attempt, c.batch, c.index, now, now});
+}
+
+// batch_trace
+//
+// Records one batch and its elements if tracing is enabled or a tracer is
+// attached to the batch probes, and otherwise does nothing. It is copied into
+// the shared state of batches whose elements may outlive the call which
+// started them, such as races, so that late elements still record themselves.
+class batch_trace
+{
+   public:
+    explicit batch_trace(std::size_t n)
+        : tracing_(tracer::enabled()),
+          active_(tracing_ || batch_probes_attached()),
+          n_(n)
+    {
+        if (active_) [[unlikely]] {
+            auto& t = tracer::instance();
+            batch_ = t.next_batch();
+            start_ = tracing_ ? t.now_ns() : 0;
+            LT_ASYNC_PROBE(batch_start, batch_, n_, 0);
+        }
+    }
+
+    bool active() const
+    {
+        return active_;
+    }
+
+    // Run `fn()` as element `i` of the batch, setting the trace context of
+    // the thread running it.
+    template <typename F>
+    void element(std::size_t i, F&& fn) const
+    {
+        if (!active_) [[likely]] {
+            fn();
+            return;
+        }
+
+        auto& t = tracer::instance();
+        auto outer = std::exchange(current_trace(), trace_context{batch_, i});
+        LT_ASYNC_PROBE(element_start, batch_, i, 0);
+
+        auto begin = tracing_ ? t.now_ns() : 0;
+        if (tracing_) {
+            t.record(trace_event{"queued", 'X', 0, batch_, i, start_, begin});
+        }
+
+        struct finish
+        {
+            ~finish()
+            {
+                LT_ASYNC_PROBE(element_end, batch, i, 0);
+                if (tracing) {
+                    t.record(trace_event{"element", 'X', 0, batch, i, begin, t.now_ns()});
+                }
+                // Looked up again, as `fn` may have moved a fiber to another
+                // thread.
+                current_trace() = outer;
+            }
+            tracer& t;
+            bool tracing;
+            std::uint64_t batch;
+            std::size_t i;
+            std::int64_t begin;
+            trace_context outer;
+        } f{t, tracing_, batch_, i, begin, outer};
+
+        fn();
+    }
+
+    // Record the end of the batch.
+    void finish() const
+    {
+        if (!active_) [[likely]] {
+            return;
+        }
+
+        LT_ASYNC_PROBE(batch_end, batch_, n_, 0);
+        if (tracing_) {
+            auto& t = tracer::instance();
+            t.record(trace_event{"batch", 'X', 0, batch_, n_, start_, t.now_ns()});
+        }
+    }
+
+   private:
+    bool tracing_;
+    bool active_;
+    std::size_t n_;
+    std::uint64_t batch_ = 0;
+    std::int64_t start_ = 0;
+};
+
+// Run `run(fn)`, which runs fn(0) ... fn(n - 1) on an executor. If tracing is
+// enabled or the batch probes are attached, fn is wrapped to record the batch and
+// each element, and to set the trace context of the thread running each
+// element.
+template <typename Run>
+void traced_batch(std::size_t n, const std::function<void(std::size_t)>& fn, Run&& run)
+{
+    auto trace = batch_trace(n);
+    if (!trace.active()) [[likely]] {
+        run(fn);
+        return;
+    }
+
+    run([&](std::size_t i) {
+        trace.element(i, [&] { fn(i); });
+    });
+    trace.finish();
+}
+
+// attempt_trace
+//
+// Records the attempts of one retried element, and the time between them,
+// which covers the retry policy's delay and any wait for a rate limiter
+// permit.
+class attempt_trace
+{
+   public:
+    template <typename G>
+    std::invoke_result_t<G&> operator()(G& g)
+    {
+        auto tracing = tracer::enabled();
+        if (!tracing && !attempt_probes_attached()) [[likely]] {
+            return g();
+        }
+
+        auto& t = tracer::instance();
+        [[maybe_unused]] auto c = current_trace();
+        auto start = tracing ? t.now_ns() : 0;
+        if (attempt_ > 0) {
+            LT_ASYNC_PROBE(backoff_end, c.batch, c.index, attempt_);
+            if (tracing) {
+                trace_span("backoff", attempt_, last_end_, start);
+            }
+        }
+
+        auto r = g();
+        LT_ASYNC_PROBE_RESULT(attempt_result, c.batch, c.index, attempt_, int(r.has_value()));
+        if (tracing) {
+            last_end_ = t.now_ns();
+            trace_span(r ? "attempt" : "attempt failed", attempt_, start, last_end_);
+        }
+        ++attempt_;
+        return r;
+    }
+
+   private:
+    std::uint32_t attempt_ = 0;
+    std::int64_t last_end_ = 0;
+};
+
+// Report the decision of a retry policy's `should_retry` for the attempt
+// just made by the current element.
+inline void trace_retry_decision([[maybe_unused]] int attempt, [[maybe_unused]] bool retry)
+{
+    if (retry_probes_attached()) [[unlikely]] {
+        [[maybe_unused]] auto& c = current_trace();
+        LT_ASYNC_PROBE_RESULT(should_retry, c.batch, c.index, attempt, int(retry));
+        if (retry) {
+            LT_ASYNC_PROBE(backoff_start, c.batch, c.index, attempt + 1);
+        }
+    }
+}
+
+// Report that a preemptible retry observed its condition.
+inline void trace_preempted()
+{
+    if (preempted_probe_attached()) [[unlikely]] {
+        [[maybe_unused]] auto& c = current_trace();
+        LT_ASYNC_PROBE(preempted, c.batch, c.index, 0);
+    }
+    if (tracer::enabled()) [[unlikely]] {
+        trace_instant("preempted", 0);
+    }
+}
+
+} // namespace detail
+
+} // namespace lt::async
@@ -0,0 +1,119 @@
+// Smoke tests for `allocation_accounting`: exact per-element counts on a
+// thread pool and on fibers which resume on other carriers, and nested calls
+// folded into the outer one.
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "lt/async/alloc-stats.h"
+#include "lt/async/async.h"
+#include "lt/async/executor.h"
+#include "lt/async/fiber.h"
+
+#include "check.h"
+
+LT_ASYNC_DEFINE_ALLOCATION_HOOKS;
+
+namespace
+{
+
+using lt::async::attempt_result_t;
+using namespace std::chrono_literals;
+
+using accounted = lt::async::basic_async<int, int, std::string, lt::async::executor, lt::async::in_order,
+                                         lt::async::run_to_completion, lt::async::allocation_accounting>;
+
+// One heap allocation which the optimizer cannot elide.
+int allocate_one(int v)
+{
+    auto p = std::make_unique<int>(v);
+    asm volatile("" : : "r"(p.get()) : "memory");
+    return *p;
+}
+
+void check_three_per_element(accounted& tasks, std::size_t elements)
+{
+    auto s = tasks.instrumentation().last_batch();
+    LT_ASYNC_CHECK(s.elements == elements);
+    LT_ASYNC_CHECK(s.user.allocations == 3 * elements);
+    LT_ASYNC_CHECK(s.library.allocations > 0);
+    for (auto&& e : tasks.instrumentation().elements()) {
+        LT_ASYNC_CHECK(e.user.allocations == 3);
+    }
+}
+
+void test_thread_pool()
+{
+    auto pool = lt::async::thread_pool(4);
+    auto tasks = accounted(pool);
+    auto input = std::vector<int>(1000, 1);
+
+    auto output = tasks.map_concurrently(
+        [](const int& i) -> attempt_result_t<int> { return allocate_one(i) + allocate_one(i) + allocate_one(i); },
+        input);
+    LT_ASYNC_CHECK(output);
+    check_three_per_element(tasks, input.size());
+}
+
+// Each element sleeps between its allocations, so it may resume on another
+// carrier while another element runs on the one it left.
+void test_migrating_fibers()
+{
+    auto fibers = lt::async::fiber_pool(4);
+    auto tasks = accounted(fibers);
+    auto input = std::vector<int>(200, 1);
+
+    auto output = tasks.map_concurrently(
+        [](const int& i) -> attempt_result_t<int> {
+            auto a = allocate_one(i);
+            lt::async::this_fiber::sleep_for(50us);
+            auto b = allocate_one(i);
+            lt::async::this_fiber::sleep_for(50us);
+            return a + b + allocate_one(i);
+        },
+        input);
+    LT_ASYNC_CHECK(output);
+    check_three_per_element(tasks, input.size());
+}
+
+// A call from inside an element of a call on the same instance is recorded
+// as part of the outer call; a call on another instance is recorded there.
+// The calling thread helps to run the outer batch, so the calls on `inner`
+// are serialized to keep to one call at a time on that instance.
+void test_nested_calls()
+{
+    auto pool = lt::async::thread_pool(1);
+    auto outer = accounted(pool);
+    auto inner = accounted(pool);
+    auto inner_mutex = std::mutex();
+
+    auto output = outer.map_concurrently(
+        [&](const int& i) -> attempt_result_t<int> {
+            auto lock = std::lock_guard<std::mutex>(inner_mutex);
+            auto other = inner.map_concurrently(
+                [](const int& j) -> attempt_result_t<int> { return allocate_one(j); }, std::vector<int>{1, 2});
+            auto same = outer.map_concurrently(
+                [](const int& j) -> attempt_result_t<int> { return j; }, std::vector<int>{1});
+            return i + (*other)[0] + (*same)[0];
+        },
+        std::vector<int>{1, 2, 3});
+    LT_ASYNC_CHECK(output);
+
+    LT_ASYNC_CHECK(outer.instrumentation().batches().size() == 1);
+    LT_ASYNC_CHECK(inner.instrumentation().batches().size() == 3);
+    LT_ASYNC_CHECK(inner.instrumentation().total().user.allocations == 6);
+}
+
+} // namespace
+
+int main()
+{
+    LT_ASYNC_CHECK(lt::async::allocation_accounting::hooks_installed());
+    test_thread_pool();
+    test_migrating_fibers();
+    test_nested_calls();
+}
@@ -0,0 +1,83 @@
+// Smoke tests for the `std::array` overload of `map_concurrently()`: no heap
+// allocation on a warmed-up `thread_pool`, and the error of the first failed
+// input under either ordering.
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <thread>
+
+#include "lt/async/alloc-stats.h"
+#include "lt/async/async.h"
+#include "lt/async/executor.h"
+
+#include "check.h"
+
+LT_ASYNC_DEFINE_ALLOCATION_HOOKS;
+
+namespace
+{
+
+using lt::async::attempt_result_t;
+using namespace std::chrono_literals;
+
+void test_no_allocations(lt::async::thread_pool& pool)
+{
+    auto tasks = lt::async::basic_async<int, int, std::string, lt::async::thread_pool, lt::async::in_order,
+                                        lt::async::run_to_completion, lt::async::allocation_accounting>(pool);
+    auto input = std::array<int, 8>{1, 2, 3, 4, 5, 6, 7, 8};
+    auto f = [](const int& i) -> attempt_result_t<int> { return i * 2; };
+
+    // The first call allocates the batch state which later calls reuse.
+    for (int i = 0; i < 4; ++i) {
+        tasks.map_concurrently(f, input);
+    }
+    tasks.instrumentation().reset();
+
+    for (int i = 0; i < 100; ++i) {
+        auto output = tasks.map_concurrently(f, input);
+        LT_ASYNC_CHECK(output);
+        LT_ASYNC_CHECK((*output)[7] == 16);
+
+        auto s = tasks.instrumentation().last_batch();
+        LT_ASYNC_CHECK(s.elements == input.size());
+        LT_ASYNC_CHECK(s.library.allocations == 0);
+    }
+}
+
+// Input 1 fails late and input 5 fails at once, so under completion_order
+// input 5 takes the earlier slot.
+template <typename ordering>
+void test_first_failed_input(lt::async::thread_pool& pool)
+{
+    auto tasks = lt::async::basic_async<int, int, std::string, lt::async::thread_pool, ordering>(pool);
+    auto input = std::array<int, 6>{0, 1, 2, 3, 4, 5};
+
+    auto output = tasks.map_concurrently(
+        [](const int& i) -> attempt_result_t<int> {
+            if (i == 1) {
+                std::this_thread::sleep_for(20ms);
+                return tl::unexpected(std::string("1"));
+            }
+            if (i == 5) {
+                return tl::unexpected(std::string("5"));
+            }
+            return i;
+        },
+        input);
+
+    LT_ASYNC_CHECK(!output);
+    LT_ASYNC_CHECK(output.error() == "1");
+}
+
+} // namespace
+
+int main()
+{
+    LT_ASYNC_CHECK(lt::async::allocation_accounting::hooks_installed());
+    auto pool = lt::async::thread_pool(4);
+    test_no_allocations(pool);
+    test_first_failed_input<lt::async::in_order>(pool);
+    test_first_failed_input<lt::async::completion_order>(pool);
+}
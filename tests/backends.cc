@@ -0,0 +1,135 @@
+// Smoke tests for each backend compiled into this build, created through
+// `make_executor()`. Backends which are not compiled in must be rejected. Also
+// checks the iterator the parallel STL backend walks the indices with.
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "lt/async/async.h"
+#include "lt/async/backends.h"
+
+#include "check.h"
+
+namespace
+{
+
+using lt::async::attempt_result_t;
+
+std::vector<int> iota(int n)
+{
+    auto v = std::vector<int>(n);
+    for (int i = 0; i < n; ++i) {
+        v[i] = i;
+    }
+    return v;
+}
+
+void test_unavailable(lt::async::backend b)
+{
+    auto threw = false;
+    try {
+        lt::async::make_executor(b);
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    LT_ASYNC_CHECK(threw);
+}
+
+void test_available(lt::async::backend b)
+{
+    auto ex = lt::async::make_executor(b, 2);
+    auto tasks = lt::async::async<int, int>(*ex);
+    auto input = iota(10000);
+
+    auto output = tasks.map_concurrently([](const int& i) -> attempt_result_t<int> { return i + 1; }, input);
+    LT_ASYNC_CHECK(output);
+    LT_ASYNC_CHECK((*output)[9999] == 10000);
+
+    auto failed = tasks.map_concurrently(
+        [](const int& i) -> attempt_result_t<int> {
+            if (i == 500) {
+                return tl::unexpected(std::string("failed"));
+            }
+            return i;
+        },
+        input);
+    LT_ASYNC_CHECK(!failed);
+    LT_ASYNC_CHECK(failed.error() == "failed");
+
+    // Every element runs before the first exception is rethrown.
+    auto count = std::atomic<int>(0);
+    auto threw = false;
+    try {
+        ex->bulk(100, [&](std::size_t i) {
+            count.fetch_add(1, std::memory_order_relaxed);
+            if (i == 3) {
+                throw std::runtime_error("element 3");
+            }
+        });
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    LT_ASYNC_CHECK(threw);
+    LT_ASYNC_CHECK(count.load() == 100);
+
+    // post() returns before the task has run.
+    auto release = std::atomic<bool>(false);
+    auto done = std::atomic<bool>(false);
+    ex->post([&] {
+        while (!release.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+        done.store(true, std::memory_order_release);
+    });
+    release.store(true, std::memory_order_release);
+    while (!done.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+}
+
+using index_traits = std::iterator_traits<lt::async::detail::index_iterator>;
+static_assert(std::is_same_v<index_traits::iterator_category, std::random_access_iterator_tag>);
+static_assert(std::is_same_v<index_traits::reference, const std::size_t&>);
+
+void test_index_iterator()
+{
+    auto first = lt::async::detail::index_iterator(0);
+    auto last = lt::async::detail::index_iterator(100);
+
+    LT_ASYNC_CHECK(std::distance(first, last) == 100);
+    LT_ASYNC_CHECK(*std::lower_bound(first, last, std::size_t(42)) == 42);
+    LT_ASYNC_CHECK(first[7] == 7);
+    LT_ASYNC_CHECK(*(last - 1) == 99);
+
+    auto it = first + 10;
+    const std::size_t& ten = *it;
+    LT_ASYNC_CHECK(&ten == &*it && ten == 10);
+
+    auto sum = std::size_t(0);
+    std::for_each(first, last, [&](const std::size_t& i) { sum += i; });
+    LT_ASYNC_CHECK(sum == 4950);
+}
+
+} // namespace
+
+int main()
+{
+    test_index_iterator();
+
+    for (auto b : {lt::async::backend::native, lt::async::backend::openmp, lt::async::backend::tbb,
+                   lt::async::backend::parallel_stl}) {
+        if (lt::async::backend_available(b)) {
+            test_available(b);
+        } else {
+            test_unavailable(b);
+        }
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace lt::async::test
+{
+
+// fail
+//
+// Report a failed check and end the test with a non-zero exit status.
+[[noreturn]] inline void fail(const char* condition, const char* file, int line)
+{
+    std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, condition);
+    std::abort();
+}
+
+} // namespace lt::async::test
+
+// LT_ASYNC_CHECK
+//
+// Like `assert()`, but also checked in release builds.
+#define LT_ASYNC_CHECK(condition) \
+    ((condition) ? static_cast<void>(0) : ::lt::async::test::fail(#condition, __FILE__, __LINE__))
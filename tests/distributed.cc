@@ -0,0 +1,122 @@
+// Smoke tests for `distributed_async` with two `worker_server` nodes on
+// loopback: the input is spread over both and gathered in order, and when one
+// node is stopped partway through a call its shards are finished by the other.
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "lt/async/async.h"
+#include "lt/async/distributed-async.h"
+#include "lt/async/executor.h"
+
+#include "check.h"
+
+namespace
+{
+
+using lt::async::attempt_result_t;
+using namespace std::chrono_literals;
+
+std::vector<int> iota(int n)
+{
+    auto v = std::vector<int>(n);
+    for (int i = 0; i < n; ++i) {
+        v[i] = i;
+    }
+    return v;
+}
+
+// A worker node serving on an ephemeral loopback port from a thread of its
+// own, which counts the elements it has run.
+struct node
+{
+    node()
+        : pool(2),
+          server(
+              [this](const int& i) -> attempt_result_t<int> {
+                  ran.fetch_add(1, std::memory_order_relaxed);
+                  std::this_thread::sleep_for(100us);
+                  return i * 2;
+              },
+              lt::async::bytes_codec<int>(), lt::async::bytes_codec<int>(), lt::async::bytes_codec<std::string>(),
+              pool),
+          port(server.listen(0, "127.0.0.1")),
+          thread([this] { server.serve(); })
+    {
+    }
+
+    ~node()
+    {
+        server.stop();
+        thread.join();
+    }
+
+    std::atomic<int> ran{0};
+    lt::async::thread_pool pool;
+    lt::async::worker_server<int, int> server;
+    std::uint16_t port;
+    std::thread thread;
+};
+
+void check_doubled(const lt::async::aggregate_result_t<int, std::string>& output, std::size_t n)
+{
+    LT_ASYNC_CHECK(output);
+    LT_ASYNC_CHECK(output->size() == n);
+    for (std::size_t i = 0; i < n; ++i) {
+        LT_ASYNC_CHECK((*output)[i] == static_cast<int>(2 * i));
+    }
+}
+
+void test_spreads_over_nodes()
+{
+    auto a = node();
+    auto b = node();
+    auto tasks = lt::async::distributed_async<int, int>({{"127.0.0.1", a.port}, {"127.0.0.1", b.port}},
+                                                        lt::async::distributed_options{.shard_size = 16});
+
+    auto output = tasks.map_concurrently(iota(2000));
+    check_doubled(output, 2000);
+    LT_ASYNC_CHECK(a.ran.load() > 0);
+    LT_ASYNC_CHECK(b.ran.load() > 0);
+    LT_ASYNC_CHECK(tasks.live_nodes() == 2);
+}
+
+// Node `b` is stopped once it has run some elements; the shards it held are
+// sent to `a`, and the call still returns every output.
+void test_node_stopped_midway()
+{
+    auto a = node();
+    auto b = node();
+    auto tasks = lt::async::distributed_async<int, int>({{"127.0.0.1", a.port}, {"127.0.0.1", b.port}},
+                                                        lt::async::distributed_options{.shard_size = 16});
+
+    auto stopper = std::thread([&] {
+        while (b.ran.load() < 100) {
+            std::this_thread::sleep_for(100us);
+        }
+        b.server.stop();
+    });
+
+    auto output = tasks.map_concurrently(iota(4000));
+    stopper.join();
+
+    check_doubled(output, 4000);
+    LT_ASYNC_CHECK(b.ran.load() < 4000);
+    LT_ASYNC_CHECK(tasks.live_nodes() == 1);
+
+    // The stopped node is tried again on the next call, and the call
+    // succeeds on the one left.
+    check_doubled(tasks.map_concurrently(iota(100)), 100);
+}
+
+} // namespace
+
+int main()
+{
+    test_spreads_over_nodes();
+    test_node_stopped_midway();
+}
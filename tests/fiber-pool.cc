@@ -0,0 +1,226 @@
+// Smoke tests for `fiber_pool` and `map_concurrently()` running on it, and
+// for `LT_ASYNC_DEFINE_FIBER_WAITS`, under which the sleeps and condition
+// variable waits inside `lt::retry` and the micro-batcher suspend only the
+// waiting fiber.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "lt/async/async-retry.h"
+#include "lt/async/async.h"
+#include "lt/async/fiber.h"
+
+#include "check.h"
+
+LT_ASYNC_DEFINE_FIBER_WAITS;
+
+namespace
+{
+
+using lt::async::attempt_result_t;
+using namespace std::chrono_literals;
+
+std::vector<int> iota(int n)
+{
+    auto v = std::vector<int>(n);
+    for (int i = 0; i < n; ++i) {
+        v[i] = i;
+    }
+    return v;
+}
+
+void test_bulk_runs_every_index(lt::async::fiber_pool& fibers)
+{
+    auto seen = std::vector<std::atomic<int>>(10000);
+    fibers.bulk(seen.size(), [&](std::size_t i) { seen[i].fetch_add(1, std::memory_order_relaxed); });
+    for (auto& s : seen) {
+        LT_ASYNC_CHECK(s.load() == 1);
+    }
+}
+
+void test_post_runs_asynchronously(lt::async::fiber_pool& fibers)
+{
+    auto done = std::atomic<bool>(false);
+    fibers.post([&] { done.store(true, std::memory_order_release); });
+    while (!done.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+}
+
+// Sleeping elements give up their carrier, so a batch of them takes about as
+// long as one sleep rather than one sleep per element per carrier.
+void test_sleeping_elements_overlap(lt::async::fiber_pool& fibers)
+{
+    auto tasks = lt::async::basic_async<int, int, std::string, lt::async::fiber_pool>(fibers);
+    auto input = iota(2000);
+
+    auto start = std::chrono::steady_clock::now();
+    auto output = tasks.map_concurrently(
+        [](const int& i) -> attempt_result_t<int> {
+            lt::async::this_fiber::sleep_for(20ms);
+            lt::async::this_fiber::yield();
+            return i + 1;
+        },
+        input);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    LT_ASYNC_CHECK(output);
+    LT_ASYNC_CHECK((*output)[1999] == 2000);
+    LT_ASYNC_CHECK(elapsed < 2s);
+}
+
+void test_first_error_in_input_order(lt::async::fiber_pool& fibers)
+{
+    auto tasks = lt::async::basic_async<int, std::string, std::string, lt::async::fiber_pool>(fibers);
+    auto output = tasks.map_concurrently(
+        [](const int& i) -> attempt_result_t<std::string> {
+            if (i % 100 == 99) {
+                return tl::unexpected("failed " + std::to_string(i));
+            }
+            return std::to_string(i);
+        },
+        iota(1000));
+    LT_ASYNC_CHECK(!output);
+    LT_ASYNC_CHECK(output.error() == "failed 99");
+}
+
+// A nested batch suspends the waiting fiber instead of its carrier, so this
+// finishes on a single carrier thread.
+void test_nested_batches_on_one_carrier()
+{
+    auto fibers = lt::async::fiber_pool(1);
+    auto tasks = lt::async::basic_async<int, int, std::string, lt::async::fiber_pool>(fibers);
+
+    auto output = tasks.map_concurrently(
+        [&](const int& i) -> attempt_result_t<int> {
+            auto inner = tasks.map_concurrently(
+                [&](const int& j) -> attempt_result_t<int> {
+                    lt::async::this_fiber::sleep_for(1ms);
+                    return i * 100 + j;
+                },
+                iota(8));
+            if (!inner) {
+                return tl::unexpected(inner.error());
+            }
+            return (*inner)[7];
+        },
+        iota(16));
+    LT_ASYNC_CHECK(output);
+    LT_ASYNC_CHECK((*output)[15] == 1507);
+}
+
+// Each element fails once and is retried after `lt::retry` sleeps the thread
+// for 50ms. On two carriers that would take over 40 minutes if the sleeps
+// blocked them.
+void test_retry_delays_suspend_fibers(lt::async::fiber_pool& fibers)
+{
+    auto tasks = lt::async::async_retry<int, int>(lt::retry::constantDelay(std::chrono::milliseconds(50)), fibers);
+    auto attempts = std::vector<std::atomic<int>>(100000);
+
+    auto start = std::chrono::steady_clock::now();
+    auto output = tasks.map_concurrently_retry(
+        [](lt::retry::RetryStatus, const int& o) { return o < 0; },
+        [&](const int& i) -> attempt_result_t<int> {
+            return attempts[i].fetch_add(1, std::memory_order_relaxed) == 0 ? -1 : i;
+        },
+        iota(static_cast<int>(attempts.size())));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    LT_ASYNC_CHECK(output);
+    LT_ASYNC_CHECK((*output)[99999] == 99999);
+    LT_ASYNC_CHECK(elapsed < 20s);
+}
+
+// Every element waits in a preemptible retry's condition variable wait until
+// another thread preempts them all, on a single carrier.
+void test_preemptible_waits_suspend_fibers()
+{
+    auto fibers = lt::async::fiber_pool(1);
+    auto tasks = lt::async::async_preemptible_retry<int, int>(
+        lt::retry::constantDelay(std::chrono::milliseconds(10000)),
+        lt::retry::constantDelay(std::chrono::milliseconds(10000)), fibers);
+    auto cv = std::condition_variable();
+    auto cv_mutex = std::mutex();
+    auto preempted = false;
+    auto waiting = std::atomic<int>(0);
+
+    auto notifier = std::thread([&] {
+        while (waiting.load() < 100) {
+            std::this_thread::sleep_for(1ms);
+        }
+        {
+            std::lock_guard<std::mutex> lock(cv_mutex);
+            preempted = true;
+        }
+        cv.notify_all();
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    auto output = tasks.map_concurrently_preemptible_retry(
+        cv, cv_mutex, [&] { return preempted; },
+        [](lt::retry::PreemptibleRetryStatus, const int& o) { return o < 0; },
+        [&](const int& i) -> attempt_result_t<int> {
+            auto lock = std::lock_guard<std::mutex>(cv_mutex);
+            if (!preempted) {
+                waiting.fetch_add(1);
+                return -1;
+            }
+            return i;
+        },
+        iota(100));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    notifier.join();
+
+    LT_ASYNC_CHECK(output);
+    LT_ASYNC_CHECK((*output)[99] == 99);
+    LT_ASYNC_CHECK(elapsed < 5s);
+}
+
+// Every element fails its first attempt. The retry delays and the waits for
+// retry batches to fill park the fibers, so on a single carrier the retries
+// share a few full batches instead of being sent one at a time.
+void test_batched_retries_share_batches()
+{
+    auto fibers = lt::async::fiber_pool(1);
+    auto tasks = lt::async::async_retry<int, int>(lt::retry::constantDelay(std::chrono::milliseconds(10)), fibers);
+    auto calls = std::atomic<int>(0);
+    auto attempts = std::vector<std::atomic<int>>(1000);
+
+    auto output = tasks.map_batched_retry(
+        [](lt::retry::RetryStatus, const int& o) { return o < 0; },
+        [&](std::span<const int> keys) {
+            calls.fetch_add(1, std::memory_order_relaxed);
+            auto results = std::vector<attempt_result_t<int>>();
+            for (auto k : keys) {
+                results.push_back(attempts[k].fetch_add(1, std::memory_order_relaxed) == 0 ? -1 : k);
+            }
+            return results;
+        },
+        iota(static_cast<int>(attempts.size())), {.max_batch_size = 250, .max_linger = 50ms});
+
+    LT_ASYNC_CHECK(output);
+    LT_ASYNC_CHECK((*output)[999] == 999);
+    LT_ASYNC_CHECK(calls.load() <= 12);
+}
+
+} // namespace
+
+int main()
+{
+    auto fibers = lt::async::fiber_pool(2);
+    test_bulk_runs_every_index(fibers);
+    test_post_runs_asynchronously(fibers);
+    test_sleeping_elements_overlap(fibers);
+    test_first_error_in_input_order(fibers);
+    test_nested_batches_on_one_carrier();
+    test_retry_delays_suspend_fibers(fibers);
+    test_preemptible_waits_suspend_fibers();
+    test_batched_retries_share_batches();
+}
@@ -0,0 +1,171 @@
+// Smoke tests for `io_context` and `map_files()` on tmpfs and on disk: files
+// are read whole and parsed in input order, a missing file fails the call, a
+// write is read back, and parsing stays off the I/O threads when the CPU
+// executor runs posted tasks inline.
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "lt/async/async.h"
+#include "lt/async/executor.h"
+#include "lt/async/fiber.h"
+#include "lt/async/io-context.h"
+
+#include "check.h"
+
+namespace
+{
+
+using lt::async::attempt_result_t;
+
+// A directory of `count` files under `root`, removed again on destruction.
+// File `i` holds `i * 1000 + 1` copies of the character 'a' + i % 26.
+struct scratch_files
+{
+    scratch_files(const std::string& root, int count)
+    {
+        auto pattern = root + "/lt-async-io-XXXXXX";
+        LT_ASYNC_CHECK(mkdtemp(pattern.data()) != nullptr);
+        dir = pattern;
+
+        for (int i = 0; i < count; ++i) {
+            paths.push_back(dir + "/" + std::to_string(i));
+            std::ofstream(paths.back()) << std::string(size(i), static_cast<char>('a' + i % 26));
+        }
+    }
+
+    scratch_files(const scratch_files&) = delete;
+    scratch_files& operator=(const scratch_files&) = delete;
+
+    ~scratch_files()
+    {
+        for (auto && p : paths) {
+            std::remove(p.c_str());
+        }
+        ::rmdir(dir.c_str());
+    }
+
+    static std::size_t size(int i)
+    {
+        return static_cast<std::size_t>(i) * 1000 + 1;
+    }
+
+    std::string dir;
+    std::vector<std::string> paths;
+};
+
+// Runs every posted task inline, on the thread which posts it.
+class inline_executor final : public lt::async::executor
+{
+   public:
+    void bulk(std::size_t n, const std::function<void(std::size_t)>& fn) override
+    {
+        for (std::size_t i = 0; i < n; ++i) {
+            fn(i);
+        }
+    }
+};
+
+std::atomic<int> parsed_on_io_thread{0};
+
+attempt_result_t<std::size_t> parse(const std::string&, const std::string& contents)
+{
+    if (lt::async::detail::this_io_completion().context != nullptr) {
+        parsed_on_io_thread.fetch_add(1);
+    }
+    for (auto c : contents) {
+        if (c != contents[0]) {
+            return tl::unexpected(std::string("mixed contents"));
+        }
+    }
+    return contents.size();
+}
+
+void check_sizes(const lt::async::aggregate_result_t<std::size_t, std::string>& output, std::size_t n)
+{
+    LT_ASYNC_CHECK(output);
+    LT_ASYNC_CHECK(output->size() == n);
+    for (std::size_t i = 0; i < n; ++i) {
+        LT_ASYNC_CHECK((*output)[i] == scratch_files::size(static_cast<int>(i)));
+    }
+}
+
+void test_map_files(lt::async::io_context& io, const std::string& root)
+{
+    auto files = scratch_files(root, 200);
+
+    check_sizes(lt::async::map_files<std::size_t>(io, files.paths, parse), files.paths.size());
+
+    auto missing = files.paths;
+    missing[50] = files.dir + "/missing";
+    auto failed = lt::async::map_files<std::size_t>(io, missing, parse);
+    LT_ASYNC_CHECK(!failed);
+    LT_ASYNC_CHECK(failed.error().find("missing") != std::string::npos);
+
+    auto cpu = inline_executor();
+    parsed_on_io_thread.store(0);
+    check_sizes(lt::async::map_files<std::size_t>(io, files.paths, parse, cpu), files.paths.size());
+    LT_ASYNC_CHECK(parsed_on_io_thread.load() == 0);
+
+    // From elements on a fiber pool, each mapping its own files.
+    auto fibers = lt::async::fiber_pool(2);
+    auto tasks = lt::async::basic_async<int, std::size_t, std::string, lt::async::fiber_pool>(fibers);
+    auto output = tasks.map_concurrently(
+        [&](const int&) -> attempt_result_t<std::size_t> {
+            auto sizes = lt::async::map_files<std::size_t>(io, files.paths, parse, fibers);
+            if (!sizes) {
+                return tl::unexpected(sizes.error());
+            }
+            return sizes->size();
+        },
+        std::vector<int>(8));
+    LT_ASYNC_CHECK(output);
+    LT_ASYNC_CHECK((*output)[7] == files.paths.size());
+}
+
+void test_write_read_back(lt::async::io_context& io, const std::string& root)
+{
+    auto files = scratch_files(root, 1);
+    auto fd = ::open(files.paths[0].c_str(), O_RDWR | O_TRUNC | O_CLOEXEC);
+    LT_ASYNC_CHECK(fd >= 0);
+
+    auto data = std::string(100000, 'z');
+    auto written = io.write(fd, data.data(), data.size(), 0);
+    LT_ASYNC_CHECK(written && *written == data.size());
+
+    auto back = std::string(data.size(), '\0');
+    auto read = io.read(fd, back.data(), back.size(), 0);
+    LT_ASYNC_CHECK(read && *read == data.size());
+    LT_ASYNC_CHECK(back == data);
+    ::close(fd);
+}
+
+} // namespace
+
+int main()
+{
+    auto io = lt::async::io_context(16);
+
+    // tmpfs where there is one, and a disk-backed directory.
+    auto roots = std::vector<std::string>();
+    struct stat st;
+    if (::stat("/dev/shm", &st) == 0 && S_ISDIR(st.st_mode)) {
+        roots.push_back("/dev/shm");
+    }
+    roots.push_back(".");
+
+    for (auto && root : roots) {
+        test_map_files(io, root);
+        test_write_read_back(io, root);
+    }
+}
@@ -0,0 +1,75 @@
+// Smoke tests for `map_budgeted()`: with only `measure` set the outputs held at
+// once stay under the budget, and a cost which says nothing of an element's
+// size is rejected.
+
+#include <chrono>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "lt/async/async.h"
+#include "lt/async/executor.h"
+#include "lt/async/memory-budget.h"
+
+#include "check.h"
+
+namespace
+{
+
+using lt::async::attempt_result_t;
+using namespace std::chrono_literals;
+
+using blob = std::vector<char>;
+
+// Every output is 100 bytes, so a 250 byte budget holds two at a time once
+// the first has been measured.
+void test_measure_only(lt::async::thread_pool& pool)
+{
+    auto tasks = lt::async::async<int, blob>(pool);
+    auto budget = lt::async::memory_budget(250);
+    auto cost = lt::async::memory_cost<int, blob>{
+        .measure = [](const blob& b) { return b.size(); },
+    };
+
+    auto consumed = std::size_t(0);
+    auto done = tasks.map_budgeted(
+        [](const int&) -> attempt_result_t<blob> {
+            std::this_thread::sleep_for(2ms);
+            return blob(100);
+        },
+        std::vector<int>(20), budget, cost, [&](std::size_t i, blob&& b) {
+            LT_ASYNC_CHECK(i == consumed++);
+            LT_ASYNC_CHECK(b.size() == 100);
+        });
+
+    LT_ASYNC_CHECK(done);
+    LT_ASYNC_CHECK(consumed == 20);
+    LT_ASYNC_CHECK(budget.peak() <= budget.capacity());
+    LT_ASYNC_CHECK(budget.in_use() == 0);
+}
+
+void test_rejects_unknown_cost(lt::async::thread_pool& pool)
+{
+    auto tasks = lt::async::async<int, blob>(pool);
+    auto budget = lt::async::memory_budget(250);
+    auto threw = false;
+    try {
+        [[maybe_unused]] auto done = tasks.map_budgeted(
+            [](const int&) -> attempt_result_t<blob> { return blob(100); }, std::vector<int>(4), budget,
+            lt::async::memory_cost<int, blob>{}, [](std::size_t, blob&&) {});
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    LT_ASYNC_CHECK(threw);
+}
+
+} // namespace
+
+int main()
+{
+    auto pool = lt::async::thread_pool(4);
+    test_measure_only(pool);
+    test_rejects_unknown_cost(pool);
+}
@@ -0,0 +1,198 @@
+// Smoke tests for every combination of ordering, error and instrumentation
+// policy, for both trivially copyable elements, which take the fast path, and
+// elements which do not.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "lt/async/async.h"
+#include "lt/async/executor.h"
+#include "lt/async/policy.h"
+
+#include "check.h"
+
+namespace
+{
+
+using lt::async::attempt_result_t;
+
+constexpr int element_count = 1000;
+
+// counting_instrumentation
+//
+// Stateless instrumentation which also observes calls.
+struct counting_instrumentation
+{
+    void on_start(std::size_t)
+    {
+        starts.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void on_finish(std::size_t, bool ok, std::chrono::nanoseconds)
+    {
+        finishes.fetch_add(1, std::memory_order_relaxed);
+        if (!ok) {
+            failures.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void on_batch_start()
+    {
+        batches.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void on_batch_finish()
+    {
+        batches_finished.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::atomic<int> starts{0};
+    std::atomic<int> finishes{0};
+    std::atomic<int> failures{0};
+    std::atomic<int> batches{0};
+    std::atomic<int> batches_finished{0};
+    std::atomic<int> mismatches{0};
+};
+
+// stateful_instrumentation
+//
+// Instrumentation which carries state from the start of each element and of
+// each call to its end.
+struct stateful_instrumentation : counting_instrumentation
+{
+    struct element_state
+    {
+        std::size_t index;
+    };
+
+    struct batch_state
+    {
+        int number;
+    };
+
+    element_state on_start(std::size_t i)
+    {
+        counting_instrumentation::on_start(i);
+        return element_state{i};
+    }
+
+    void on_finish(std::size_t i, bool ok, std::chrono::nanoseconds elapsed, element_state& state)
+    {
+        counting_instrumentation::on_finish(i, ok, elapsed);
+        if (state.index != i) {
+            mismatches.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    batch_state on_batch_start()
+    {
+        return batch_state{batches.fetch_add(1, std::memory_order_relaxed)};
+    }
+
+    void on_batch_finish(batch_state& state)
+    {
+        if (state.number != batches_finished.fetch_add(1, std::memory_order_relaxed)) {
+            mismatches.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+};
+
+int make_output(int i, int)
+{
+    return i * 2;
+}
+
+std::string make_output(int i, const std::string&)
+{
+    return std::to_string(i * 2);
+}
+
+template <typename ordering, typename error_mode, typename instrumentation, typename output_type>
+void test_combination(lt::async::thread_pool& pool)
+{
+    auto tasks = lt::async::basic_async<int, output_type, std::string, lt::async::thread_pool, ordering,
+                                        error_mode, instrumentation>(pool);
+
+    auto input = std::vector<int>(element_count);
+    auto expected = std::vector<output_type>(element_count);
+    for (int i = 0; i < element_count; ++i) {
+        input[i] = i;
+        expected[i] = make_output(i, output_type());
+    }
+
+    auto output = tasks.map_concurrently(
+        [](const int& i) -> attempt_result_t<output_type> { return make_output(i, output_type()); }, input);
+    LT_ASYNC_CHECK(output);
+    if constexpr (std::is_same_v<ordering, lt::async::in_order>) {
+        LT_ASYNC_CHECK(*output == expected);
+    } else {
+        auto sorted = *output;
+        std::sort(sorted.begin(), sorted.end());
+        std::sort(expected.begin(), expected.end());
+        LT_ASYNC_CHECK(sorted == expected);
+    }
+
+    auto failed = tasks.map_concurrently(
+        [](const int& i) -> attempt_result_t<output_type> {
+            if (i == 10 || i == 500) {
+                return tl::unexpected("failed " + std::to_string(i));
+            }
+            return make_output(i, output_type());
+        },
+        input);
+    LT_ASYNC_CHECK(!failed);
+    if constexpr (std::is_same_v<error_mode, lt::async::run_to_completion>) {
+        LT_ASYNC_CHECK(failed.error() == "failed 10");
+    } else {
+        LT_ASYNC_CHECK(failed.error() == "failed 10" || failed.error() == "failed 500");
+    }
+
+    if constexpr (lt::async::is_instrumented_v<instrumentation>) {
+        auto& i = tasks.instrumentation();
+        LT_ASYNC_CHECK(i.starts.load() == i.finishes.load());
+        LT_ASYNC_CHECK(i.batches.load() == 2);
+        LT_ASYNC_CHECK(i.batches_finished.load() == 2);
+        LT_ASYNC_CHECK(i.mismatches.load() == 0);
+        if constexpr (std::is_same_v<error_mode, lt::async::run_to_completion>) {
+            LT_ASYNC_CHECK(i.starts.load() == 2 * element_count);
+            LT_ASYNC_CHECK(i.failures.load() == 2);
+        } else {
+            LT_ASYNC_CHECK(i.failures.load() >= 1);
+        }
+    }
+}
+
+template <typename ordering, typename error_mode, typename instrumentation>
+void test_element_types(lt::async::thread_pool& pool)
+{
+    test_combination<ordering, error_mode, instrumentation, int>(pool);
+    test_combination<ordering, error_mode, instrumentation, std::string>(pool);
+}
+
+template <typename ordering, typename error_mode>
+void test_instrumentation(lt::async::thread_pool& pool)
+{
+    test_element_types<ordering, error_mode, lt::async::no_instrumentation>(pool);
+    test_element_types<ordering, error_mode, counting_instrumentation>(pool);
+    test_element_types<ordering, error_mode, stateful_instrumentation>(pool);
+}
+
+template <typename ordering>
+void test_error_modes(lt::async::thread_pool& pool)
+{
+    test_instrumentation<ordering, lt::async::run_to_completion>(pool);
+    test_instrumentation<ordering, lt::async::fail_fast>(pool);
+}
+
+} // namespace
+
+int main()
+{
+    auto pool = lt::async::thread_pool(4);
+    test_error_modes<lt::async::in_order>(pool);
+    test_error_modes<lt::async::completion_order>(pool);
+}
@@ -0,0 +1,46 @@
+// Smoke test for the USDT probe semaphores: a batch with no tracer attached
+// takes no batch id, and once a probe's semaphore is raised, as a tracer does
+// when it attaches, the batch is recorded.
+
+#include <cstdint>
+#include <vector>
+
+#include "lt/async/async.h"
+#include "lt/async/executor.h"
+#include "lt/async/probes.h"
+#include "lt/async/trace.h"
+
+#include "check.h"
+
+namespace
+{
+
+using lt::async::attempt_result_t;
+
+// Batch ids taken by one call, not counting the two taken here.
+std::uint64_t batch_ids_taken(lt::async::async<int, int>& tasks)
+{
+    auto& t = lt::async::tracer::instance();
+    auto before = t.next_batch();
+    auto output = tasks.map_concurrently([](const int& i) -> attempt_result_t<int> { return i; },
+                                         std::vector<int>{1, 2, 3});
+    LT_ASYNC_CHECK(output);
+    return t.next_batch() - before - 1;
+}
+
+} // namespace
+
+int main()
+{
+    auto pool = lt::async::thread_pool(2);
+    auto tasks = lt::async::async<int, int>(pool);
+
+    LT_ASYNC_CHECK(!lt::async::tracer::enabled());
+    LT_ASYNC_CHECK(!lt::async::detail::batch_probes_attached());
+    LT_ASYNC_CHECK(batch_ids_taken(tasks) == 0);
+
+    lt_async_element_end_semaphore = 1;
+    LT_ASYNC_CHECK(lt::async::detail::batch_probes_attached());
+    LT_ASYNC_CHECK(batch_ids_taken(tasks) == 1);
+    lt_async_element_end_semaphore = 0;
+}
@@ -0,0 +1,132 @@
+// Smoke tests for `process_async`: outputs come back in input order, a worker
+// killed by a segmentation fault is replaced and its element retried or
+// failed with how the worker died, and `bytes_codec` rejects a value of the
+// wrong size.
+
+#include <sys/mman.h>
+
+#include <atomic>
+#include <csignal>
+#include <cstddef>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "lt/async/codec.h"
+#include "lt/async/process-async.h"
+
+#include "check.h"
+
+namespace
+{
+
+using lt::async::attempt_result_t;
+
+std::vector<int> iota(int n)
+{
+    auto v = std::vector<int>(n);
+    for (int i = 0; i < n; ++i) {
+        v[i] = i;
+    }
+    return v;
+}
+
+// Die as a crashing library would. Restores the default action first, since
+// a sanitizer runtime would otherwise catch the signal and exit normally.
+void crash()
+{
+    std::signal(SIGSEGV, SIG_DFL);
+    std::raise(SIGSEGV);
+}
+
+void test_in_order()
+{
+    auto tasks = lt::async::process_async<int, int>(
+        [](const int& i) -> attempt_result_t<int> { return i * 2; }, {.workers = 3});
+
+    auto output = tasks.map_concurrently(iota(1000));
+    LT_ASYNC_CHECK(output);
+    LT_ASYNC_CHECK((*output)[999] == 1998);
+    LT_ASYNC_CHECK(tasks.restarts() == 0);
+}
+
+// Input 7 always crashes its worker, so after its one retry it fails with the
+// signal which killed the worker. The pool is still usable afterwards.
+void test_crash_fails_element()
+{
+    auto tasks = lt::async::process_async<int, int>(
+        [](const int& i) -> attempt_result_t<int> {
+            if (i == 7) {
+                crash();
+            }
+            return i;
+        },
+        {.workers = 2, .crash_retries = 1});
+
+    auto output = tasks.map_concurrently(iota(20));
+    LT_ASYNC_CHECK(!output);
+    LT_ASYNC_CHECK(output.error().find("killed by signal 11") != std::string::npos);
+    LT_ASYNC_CHECK(tasks.restarts() == 2);
+
+    auto again = tasks.map_concurrently(std::vector<int>{1, 2, 3});
+    LT_ASYNC_CHECK(again);
+    LT_ASYNC_CHECK((*again)[2] == 3);
+}
+
+// Input 7 crashes only the first worker which runs it, counted in memory
+// shared with the workers, so its retry on the replacement succeeds.
+void test_crash_is_retried()
+{
+    auto* crashes = static_cast<std::atomic<int>*>(
+        mmap(nullptr, sizeof(std::atomic<int>), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    LT_ASYNC_CHECK(crashes != MAP_FAILED);
+    new (crashes) std::atomic<int>(0);
+
+    {
+        auto tasks = lt::async::process_async<int, int>(
+            [crashes](const int& i) -> attempt_result_t<int> {
+                if (i == 7 && crashes->fetch_add(1) == 0) {
+                    crash();
+                }
+                return i + 1;
+            },
+            {.workers = 2, .crash_retries = 1});
+
+        auto output = tasks.map_concurrently(iota(20));
+        LT_ASYNC_CHECK(output);
+        LT_ASYNC_CHECK((*output)[7] == 8);
+        LT_ASYNC_CHECK(tasks.restarts() == 1);
+    }
+    munmap(crashes, sizeof(std::atomic<int>));
+}
+
+void test_bytes_codec_checks_size()
+{
+    auto c = lt::async::bytes_codec<int>();
+    auto bytes = std::string();
+    c.encode(42, bytes);
+    LT_ASYNC_CHECK(c.decode(bytes) == 42);
+
+    auto longer = bytes + "x";
+    for (auto wrong : {std::string_view(bytes).substr(0, 3), std::string_view(longer)}) {
+        auto threw = false;
+        try {
+            c.decode(wrong);
+        } catch (const std::length_error&) {
+            threw = true;
+        }
+        LT_ASYNC_CHECK(threw);
+    }
+}
+
+} // namespace
+
+int main()
+{
+    test_in_order();
+    test_crash_fails_element();
+    test_crash_is_retried();
+    test_bytes_codec_checks_size();
+}
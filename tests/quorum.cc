@@ -0,0 +1,205 @@
+// Smoke tests for `map_quorum()` and the races built on it: the call returns
+// as soon as it is decided, the elements still running finish afterwards and
+// are waited for by the destructor, and nested calls on a busy pool make
+// progress.
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "lt/async/async-retry.h"
+#include "lt/async/async.h"
+#include "lt/async/executor.h"
+
+#include "check.h"
+
+namespace
+{
+
+using lt::async::attempt_result_t;
+using namespace std::chrono_literals;
+
+struct counting
+{
+    void on_start(std::size_t)
+    {
+        started.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void on_finish(std::size_t, bool, std::chrono::nanoseconds)
+    {
+        finished.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::atomic<int> started{0};
+    std::atomic<int> finished{0};
+};
+
+using counted = lt::async::basic_async<int, int, std::string, lt::async::executor, lt::async::in_order,
+                                       lt::async::run_to_completion, counting>;
+
+// Two slow replicas and then a fast one: the call returns with the fast
+// one's output long before the slow ones finish, and the destructor waits for
+// any which had started. The calling thread is not a worker, so it must not
+// take a slow replica itself.
+void test_returns_once_decided(lt::async::thread_pool& pool, lt::async::remainder_policy remainder)
+{
+    auto started = std::atomic<int>(0);
+    auto finished = std::atomic<int>(0);
+    auto stopped = std::atomic<int>(0);
+    auto elapsed = std::chrono::steady_clock::duration();
+    {
+        auto tasks = counted(pool);
+        auto start = std::chrono::steady_clock::now();
+        auto acks = tasks.map_quorum(
+            1,
+            [&](const int& i, std::stop_token stop) -> attempt_result_t<int> {
+                started.fetch_add(1, std::memory_order_relaxed);
+                if (i != 2) {
+                    auto until = std::chrono::steady_clock::now() + 300ms;
+                    while (std::chrono::steady_clock::now() < until && !stop.stop_requested()) {
+                        std::this_thread::sleep_for(1ms);
+                    }
+                    if (stop.stop_requested()) {
+                        stopped.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+                finished.fetch_add(1, std::memory_order_relaxed);
+                return i;
+            },
+            std::vector<int>{0, 1, 2}, remainder);
+        elapsed = std::chrono::steady_clock::now() - start;
+
+        LT_ASYNC_CHECK(acks);
+        LT_ASYNC_CHECK(acks->size() == 1);
+        LT_ASYNC_CHECK((*acks)[0].first == 2);
+    }
+
+    if (remainder == lt::async::remainder_policy::detach) {
+        LT_ASYNC_CHECK(elapsed < 200ms);
+        LT_ASYNC_CHECK(stopped.load() == 0);
+    }
+    LT_ASYNC_CHECK(finished.load() == started.load());
+}
+
+void test_failure(lt::async::thread_pool& pool)
+{
+    auto tasks = counted(pool);
+    auto acks = tasks.map_quorum(
+        2,
+        [](const int& i, std::stop_token) -> attempt_result_t<int> {
+            if (i != 1) {
+                return tl::unexpected(std::to_string(i));
+            }
+            return i;
+        },
+        std::vector<int>{0, 1, 2});
+
+    LT_ASYNC_CHECK(!acks);
+    LT_ASYNC_CHECK(acks.error().size() == 2);
+    LT_ASYNC_CHECK(acks.error()[0].first == 0);
+    LT_ASYNC_CHECK(acks.error()[1].second == "2");
+}
+
+// Every worker is busy in an outer element which waits for a quorum, so only
+// the calling threads can run the inner elements.
+void test_nested()
+{
+    auto pool = lt::async::thread_pool(1);
+    auto outer = lt::async::async<int, int>(pool);
+    auto inner = lt::async::async<int, int>(pool);
+
+    auto output = outer.map_concurrently(
+        [&](const int& i) -> attempt_result_t<int> {
+            auto acks = inner.map_quorum(
+                2, [](const int& j, std::stop_token) -> attempt_result_t<int> { return j; },
+                std::vector<int>{i, i + 1, i + 2});
+            return acks ? attempt_result_t<int>(static_cast<int>(acks->size())) : tl::unexpected(std::string("no"));
+        },
+        std::vector<int>{0, 1, 2, 3});
+
+    LT_ASYNC_CHECK(output);
+    LT_ASYNC_CHECK((*output)[3] == 2);
+}
+
+// Elements still running when the call returns are reported to the
+// instrumentation when they finish.
+void test_instrumentation(lt::async::thread_pool& pool)
+{
+    auto tasks = counted(pool);
+    auto acks = tasks.map_quorum(
+        1,
+        [](const int& i, std::stop_token stop) -> attempt_result_t<int> {
+            while (i != 0 && !stop.stop_requested()) {
+                std::this_thread::sleep_for(1ms);
+            }
+            return i;
+        },
+        std::vector<int>{0, 1, 2});
+    LT_ASYNC_CHECK(acks);
+
+    while (tasks.instrumentation().finished.load() != tasks.instrumentation().started.load()) {
+        std::this_thread::sleep_for(1ms);
+    }
+    LT_ASYNC_CHECK(tasks.instrumentation().started.load() >= 1);
+}
+
+// The fast element wins while the slow ones are still in their first
+// attempt.
+void test_first_success(lt::async::thread_pool& pool)
+{
+    auto tasks = lt::async::async<int, int>(pool);
+    auto start = std::chrono::steady_clock::now();
+    auto output = tasks.first_success(
+        [](const int& i, std::stop_token) -> attempt_result_t<int> {
+            if (i != 2) {
+                std::this_thread::sleep_for(300ms);
+            }
+            return i;
+        },
+        std::vector<int>{0, 1, 2});
+
+    LT_ASYNC_CHECK(output);
+    LT_ASYNC_CHECK(*output == 2);
+    LT_ASYNC_CHECK(std::chrono::steady_clock::now() - start < 200ms);
+}
+
+// The slow elements are never ready and keep retrying until the fast one
+// has succeeded.
+void test_first_success_retry(lt::async::thread_pool& pool)
+{
+    auto tasks = lt::async::async_retry<int, int>(lt::retry::constantDelay(std::chrono::milliseconds(1)), pool);
+    auto start = std::chrono::steady_clock::now();
+    auto output = tasks.first_success_retry(
+        [](lt::retry::RetryStatus, const int& o) { return o < 0; },
+        [](const int& i, std::stop_token) -> attempt_result_t<int> {
+            if (i != 0) {
+                std::this_thread::sleep_for(100ms);
+                return -1;
+            }
+            return i;
+        },
+        std::vector<int>{0, 1, 2});
+
+    LT_ASYNC_CHECK(output);
+    LT_ASYNC_CHECK(*output == 0);
+    LT_ASYNC_CHECK(std::chrono::steady_clock::now() - start < 80ms);
+}
+
+} // namespace
+
+int main()
+{
+    auto pool = lt::async::thread_pool(4);
+    test_returns_once_decided(pool, lt::async::remainder_policy::detach);
+    test_returns_once_decided(pool, lt::async::remainder_policy::cancel);
+    test_failure(pool);
+    test_nested();
+    test_instrumentation(pool);
+    test_first_success(pool);
+    test_first_success_retry(pool);
+}
@@ -0,0 +1,110 @@
+// Smoke tests for `token_bucket` and rate-limited batches: invalid rates are
+// rejected, elements start no faster than the configured rate, and a
+// rate-limited call nested inside an element on a busy pool completes.
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "lt/async/async.h"
+#include "lt/async/executor.h"
+#include "lt/async/rate-limit.h"
+
+#include "check.h"
+
+namespace
+{
+
+using lt::async::attempt_result_t;
+using namespace std::chrono_literals;
+
+std::vector<int> iota(int n)
+{
+    auto v = std::vector<int>(n);
+    for (int i = 0; i < n; ++i) {
+        v[i] = i;
+    }
+    return v;
+}
+
+void test_rejects_invalid_rates()
+{
+    for (auto rate : {0.0, -1.0, std::numeric_limits<double>::quiet_NaN()}) {
+        auto threw = false;
+        try {
+            [[maybe_unused]] auto bucket = lt::async::token_bucket(rate);
+        } catch (const std::invalid_argument&) {
+            threw = true;
+        }
+        LT_ASYNC_CHECK(threw);
+    }
+}
+
+void test_paces_elements(lt::async::thread_pool& pool)
+{
+    auto bucket = lt::async::token_bucket(200.0);
+    auto tasks = lt::async::async<int, int>(pool);
+    tasks.set_rate_limiter(bucket);
+
+    auto start = std::chrono::steady_clock::now();
+    auto output = tasks.map_concurrently([](const int& i) -> attempt_result_t<int> { return i * 2; }, iota(20));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    LT_ASYNC_CHECK(output);
+    LT_ASYNC_CHECK((*output)[19] == 38);
+    LT_ASYNC_CHECK(elapsed >= 90ms);
+    LT_ASYNC_CHECK(bucket.stats().permits == 20);
+    LT_ASYNC_CHECK(bucket.stats().achieved_rate <= 200.0 * 1.05);
+}
+
+// The only worker is busy in the outer element, so the inner elements are run
+// by the calling thread once their permits have been handed out.
+void test_nested()
+{
+    auto pool = lt::async::thread_pool(1);
+    auto bucket = lt::async::token_bucket(1000.0, 4);
+    auto outer = lt::async::async<int, int>(pool);
+    auto inner = lt::async::async<int, int>(pool);
+    inner.set_rate_limiter(bucket);
+
+    auto output = outer.map_concurrently(
+        [&](const int& i) -> attempt_result_t<int> {
+            auto r = inner.map_concurrently([](const int& j) -> attempt_result_t<int> { return j; }, iota(i + 5));
+            return r ? attempt_result_t<int>(static_cast<int>(r->size())) : tl::unexpected(r.error());
+        },
+        iota(3));
+
+    LT_ASYNC_CHECK(output);
+    LT_ASYNC_CHECK((*output)[2] == 7);
+}
+
+void test_rethrows(lt::async::thread_pool& pool)
+{
+    auto bucket = lt::async::token_bucket(10000.0, 8);
+    auto threw = false;
+    try {
+        lt::async::detail::rate_limited_bulk(pool, bucket, 16, [](std::size_t i) {
+            if (i == 5) {
+                throw std::runtime_error("element 5");
+            }
+        });
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    LT_ASYNC_CHECK(threw);
+}
+
+} // namespace
+
+int main()
+{
+    auto pool = lt::async::thread_pool(4);
+    test_rejects_invalid_rates();
+    test_paces_elements(pool);
+    test_nested();
+    test_rethrows(pool);
+}
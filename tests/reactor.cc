@@ -0,0 +1,245 @@
+// Smoke tests for `reactor` over socketpairs: readiness callbacks, the
+// `wait_ready()` timeout, timer cancellation, many fibers waiting on their
+// sockets from one carrier, and `lt::retry` delays timed on the reactor's
+// timerfd.
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "lt/async/async-retry.h"
+#include "lt/async/async.h"
+#include "lt/async/fiber.h"
+#include "lt/async/reactor.h"
+
+#include "check.h"
+
+LT_ASYNC_DEFINE_FIBER_WAITS;
+
+namespace
+{
+
+using lt::async::attempt_result_t;
+using namespace std::chrono_literals;
+
+struct socket_pair
+{
+    socket_pair()
+    {
+        LT_ASYNC_CHECK(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) == 0);
+    }
+
+    socket_pair(const socket_pair&) = delete;
+    socket_pair& operator=(const socket_pair&) = delete;
+
+    ~socket_pair()
+    {
+        ::close(fds[0]);
+        ::close(fds[1]);
+    }
+
+    void send(char c)
+    {
+        LT_ASYNC_CHECK(::write(fds[1], &c, 1) == 1);
+    }
+
+    int fds[2] = {-1, -1};
+};
+
+std::vector<int> iota(int n)
+{
+    auto v = std::vector<int>(n);
+    for (int i = 0; i < n; ++i) {
+        v[i] = i;
+    }
+    return v;
+}
+
+// Forwards to a reactor, counting the timers set through it.
+class counting_timers final : public lt::async::timer_source
+{
+   public:
+    explicit counting_timers(lt::async::reactor& r)
+        : reactor_(r)
+    {
+    }
+
+    std::uint64_t async_sleep_until(std::chrono::steady_clock::time_point deadline,
+                                    std::function<void()> done) override
+    {
+        count.fetch_add(1, std::memory_order_relaxed);
+        return reactor_.async_sleep_until(deadline, std::move(done));
+    }
+
+    bool cancel_timer(std::uint64_t id) override
+    {
+        return reactor_.cancel_timer(id);
+    }
+
+    std::atomic<int> count{0};
+
+   private:
+    lt::async::reactor& reactor_;
+};
+
+void test_async_wait(lt::async::reactor& r)
+{
+    auto s = socket_pair();
+    auto done = std::make_shared<lt::async::detail::event>();
+    auto events = std::atomic<std::uint32_t>(0);
+
+    r.async_wait(s.fds[0], EPOLLIN, [&, done](lt::async::ready_result ready) {
+        LT_ASYNC_CHECK(ready);
+        events.store(*ready, std::memory_order_relaxed);
+        done->set();
+    });
+    s.send('x');
+    done->wait();
+
+    LT_ASYNC_CHECK((events.load() & EPOLLIN) != 0);
+    r.forget(s.fds[0]);
+}
+
+void test_wait_ready_timeout(lt::async::reactor& r)
+{
+    auto s = socket_pair();
+
+    auto start = std::chrono::steady_clock::now();
+    auto ready = r.wait_ready(s.fds[0], EPOLLIN, 20ms);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    LT_ASYNC_CHECK(!ready);
+    LT_ASYNC_CHECK(ready.error() == std::errc::timed_out);
+    LT_ASYNC_CHECK(elapsed >= 20ms);
+
+    s.send('x');
+    ready = r.wait_ready(s.fds[0], EPOLLIN, 1s);
+    LT_ASYNC_CHECK(ready);
+    r.forget(s.fds[0]);
+}
+
+void test_cancel_timer(lt::async::reactor& r)
+{
+    auto fired = std::atomic<int>(0);
+    auto cancelled = r.async_sleep_until(std::chrono::steady_clock::now() + 20ms, [&] { fired.fetch_add(1); });
+    auto kept = r.async_sleep_until(std::chrono::steady_clock::now() + 10ms, [&] { fired.fetch_add(10); });
+
+    LT_ASYNC_CHECK(r.cancel_timer(cancelled));
+    LT_ASYNC_CHECK(!r.cancel_timer(cancelled));
+    r.sleep_for(50ms);
+
+    LT_ASYNC_CHECK(fired.load() == 10);
+    LT_ASYNC_CHECK(!r.cancel_timer(kept));
+}
+
+// Each element waits for its own socket, which is written only once every
+// element has started waiting, so this finishes only if the waits park their
+// fibers instead of the single carrier.
+void test_fibers_wait_on_sockets(lt::async::reactor& r)
+{
+    auto fibers = lt::async::fiber_pool(1);
+    auto tasks = lt::async::basic_async<int, int, std::string, lt::async::fiber_pool>(fibers);
+    auto sockets = std::vector<std::unique_ptr<socket_pair>>();
+    for (int i = 0; i < 200; ++i) {
+        sockets.push_back(std::make_unique<socket_pair>());
+    }
+    auto waiting = std::atomic<int>(0);
+
+    auto writer = std::thread([&] {
+        while (waiting.load() < static_cast<int>(sockets.size())) {
+            std::this_thread::sleep_for(1ms);
+        }
+        for (auto && s : sockets) {
+            s->send('x');
+        }
+    });
+
+    auto output = tasks.map_concurrently(
+        [&](const int& i) -> attempt_result_t<int> {
+            waiting.fetch_add(1);
+            auto ready = r.wait_ready(sockets[i]->fds[0], EPOLLIN, 10s);
+            if (!ready) {
+                return tl::unexpected(ready.error().message());
+            }
+            auto c = char();
+            return ::read(sockets[i]->fds[0], &c, 1) == 1 ? i : -1;
+        },
+        iota(static_cast<int>(sockets.size())));
+    writer.join();
+
+    LT_ASYNC_CHECK(output);
+    LT_ASYNC_CHECK((*output)[199] == 199);
+    for (auto && s : sockets) {
+        r.forget(s->fds[0]);
+    }
+}
+
+// The delays between attempts, and the timeout of a preemptible retry's
+// condition variable wait, are set on the reactor, and still suspend only the
+// waiting fibers.
+void test_retry_delays_on_reactor(lt::async::reactor& r)
+{
+    auto timers = counting_timers(r);
+    auto fibers = lt::async::fiber_pool(1);
+    fibers.set_timer_source(&timers);
+
+    auto tasks = lt::async::async_retry<int, int>(lt::retry::constantDelay(std::chrono::milliseconds(20)), fibers);
+    auto attempts = std::vector<std::atomic<int>>(1000);
+
+    auto start = std::chrono::steady_clock::now();
+    auto output = tasks.map_concurrently_retry(
+        [](lt::retry::RetryStatus, const int& o) { return o < 0; },
+        [&](const int& i) -> attempt_result_t<int> {
+            return attempts[i].fetch_add(1, std::memory_order_relaxed) < 2 ? -1 : i;
+        },
+        iota(static_cast<int>(attempts.size())));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    LT_ASYNC_CHECK(output);
+    LT_ASYNC_CHECK((*output)[999] == 999);
+    LT_ASYNC_CHECK(timers.count.load() == 2000);
+    LT_ASYNC_CHECK(elapsed < 5s);
+
+    auto preemptible = lt::async::async_preemptible_retry<int, int>(
+        lt::retry::constantDelay(std::chrono::milliseconds(5)), lt::retry::constantDelay(std::chrono::milliseconds(5)),
+        fibers);
+    auto cv = std::condition_variable();
+    auto cv_mutex = std::mutex();
+    auto tries = std::vector<std::atomic<int>>(100);
+
+    timers.count.store(0);
+    auto preempted = preemptible.map_concurrently_preemptible_retry(
+        cv, cv_mutex, [] { return false; }, [](lt::retry::PreemptibleRetryStatus, const int& o) { return o < 0; },
+        [&](const int& i) -> attempt_result_t<int> {
+            return tries[i].fetch_add(1, std::memory_order_relaxed) == 0 ? -1 : i;
+        },
+        iota(static_cast<int>(tries.size())));
+
+    LT_ASYNC_CHECK(preempted);
+    LT_ASYNC_CHECK((*preempted)[99] == 99);
+    LT_ASYNC_CHECK(timers.count.load() == 100);
+}
+
+} // namespace
+
+int main()
+{
+    auto r = lt::async::reactor();
+    test_async_wait(r);
+    test_wait_ready_timeout(r);
+    test_cancel_timer(r);
+    test_fibers_wait_on_sockets(r);
+    test_retry_delays_on_reactor(r);
+}
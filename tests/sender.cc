@@ -0,0 +1,81 @@
+// A small sender pipeline built from `lt/async/sender.h` and run with
+// stdexec: a batch on a `scheduler_executor`, followed by `then()`, with a
+// failing batch routed through `upon_error()`, and a batch whose elements
+// make nested calls on the same executor.
+
+#include <exec/static_thread_pool.hpp>
+#include <stdexec/execution.hpp>
+
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "lt/async/async.h"
+#include "lt/async/sender.h"
+
+#include "check.h"
+
+namespace
+{
+
+using lt::async::attempt_result_t;
+
+std::vector<int> iota(int n)
+{
+    auto v = std::vector<int>(n);
+    for (int i = 0; i < n; ++i) {
+        v[i] = i;
+    }
+    return v;
+}
+
+long sum(const std::vector<int>& outputs)
+{
+    auto total = 0L;
+    for (auto o : outputs) {
+        total += o;
+    }
+    return total;
+}
+
+template <typename async_type, typename F>
+long run_pipeline(exec::static_thread_pool& pool, async_type& tasks, F f)
+{
+    auto work = stdexec::starts_on(pool.get_scheduler(), lt::async::map_concurrently_sender(tasks, f, iota(1000)))
+        | stdexec::then([](std::vector<int> outputs) { return sum(outputs); })
+        | stdexec::upon_error([](auto) { return -1L; });
+
+    auto result = stdexec::sync_wait(std::move(work));
+    LT_ASYNC_CHECK(result.has_value());
+    return std::get<0>(*result);
+}
+
+} // namespace
+
+int main()
+{
+    auto pool = exec::static_thread_pool(4);
+    auto ex = lt::async::scheduler_executor(pool.get_scheduler(), 4);
+    auto tasks = lt::async::basic_async<int, int, std::string, decltype(ex)>(ex);
+
+    auto doubled = run_pipeline(pool, tasks, [](const int& i) -> attempt_result_t<int> { return 2 * i; });
+    LT_ASYNC_CHECK(doubled == 999 * 1000);
+
+    auto failed = run_pipeline(pool, tasks, [](const int& i) -> attempt_result_t<int> {
+        if (i == 500) {
+            return tl::unexpected(std::string("failed"));
+        }
+        return i;
+    });
+    LT_ASYNC_CHECK(failed == -1);
+
+    // Every runner may be busy in an outer element, so the nested calls
+    // complete on the threads which make them.
+    auto nested = run_pipeline(pool, tasks, [&](const int& i) -> attempt_result_t<int> {
+        auto inner = tasks.map_concurrently([](const int& j) -> attempt_result_t<int> { return j; },
+                                            std::vector<int>{i, i});
+        return inner ? attempt_result_t<int>((*inner)[1]) : tl::unexpected(inner.error());
+    });
+    LT_ASYNC_CHECK(nested == 999 * 1000 / 2);
+}
@@ -0,0 +1,145 @@
+// Smoke tests for `simulation`: elements run on fibers in virtual time, so
+// sleeps, condition variable waits and the delays of `lt::retry` cost no
+// wall-clock time and runs are repeatable. The target defines
+// `LT_ASYNC_ENABLE_SIMULATED_TIME`, which only test targets may do.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "lt/async/async-retry.h"
+#include "lt/async/async.h"
+#include "lt/async/simulation.h"
+
+#include "check.h"
+
+LT_ASYNC_DEFINE_SIMULATED_TIME;
+
+namespace
+{
+
+using lt::async::attempt_result_t;
+using namespace std::chrono_literals;
+
+std::vector<int> iota(int n)
+{
+    auto v = std::vector<int>(n);
+    for (int i = 0; i < n; ++i) {
+        v[i] = i;
+    }
+    return v;
+}
+
+// Each element sleeps for `i + 1` seconds, through both the fiber and the
+// standard library interfaces. The batch ends when the longest one does.
+void test_sleeps_take_virtual_time()
+{
+    auto sim = lt::async::simulation();
+    auto tasks = lt::async::basic_async<int, long, std::string, lt::async::simulation>(sim);
+
+    auto start = std::chrono::steady_clock::now();
+    auto output = tasks.map_concurrently(
+        [](const int& i) -> attempt_result_t<long> {
+            auto s = std::chrono::steady_clock::now();
+            lt::async::this_fiber::sleep_for(std::chrono::seconds(i));
+            std::this_thread::sleep_for(1s);
+            return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - s).count();
+        },
+        iota(3));
+    auto real = std::chrono::steady_clock::now() - start;
+
+    LT_ASYNC_CHECK(output);
+    LT_ASYNC_CHECK((*output)[0] == 1);
+    LT_ASYNC_CHECK((*output)[2] == 3);
+    LT_ASYNC_CHECK(sim.elapsed() == 3s);
+    LT_ASYNC_CHECK(real < 1s);
+}
+
+// One element notifies the others after 250ms of virtual time; the waits time
+// out after 10s if the notification is lost.
+void test_condition_variable_waits()
+{
+    auto sim = lt::async::simulation();
+    auto tasks = lt::async::basic_async<int, int, std::string, lt::async::simulation>(sim);
+    auto cv = std::condition_variable();
+    auto m = std::mutex();
+    auto go = false;
+
+    auto output = tasks.map_concurrently(
+        [&](const int& i) -> attempt_result_t<int> {
+            if (i == 0) {
+                std::this_thread::sleep_for(250ms);
+                {
+                    auto lock = std::lock_guard<std::mutex>(m);
+                    go = true;
+                }
+                cv.notify_all();
+                return 0;
+            }
+            auto lock = std::unique_lock<std::mutex>(m);
+            if (!cv.wait_for(lock, 10s, [&] { return go; })) {
+                return tl::unexpected(std::string("timed out"));
+            }
+            return i;
+        },
+        iota(8));
+
+    LT_ASYNC_CHECK(output);
+    LT_ASYNC_CHECK(sim.elapsed() < 1s);
+}
+
+// Each element fails twice and is retried after 100ms each time, so the
+// batch takes 200ms of virtual time.
+void test_retry_delays_take_virtual_time()
+{
+    auto sim = lt::async::simulation();
+    auto tasks = lt::async::async_retry<int, int>(lt::retry::constantDelay(std::chrono::milliseconds(100)), sim);
+    auto attempts = std::vector<std::atomic<int>>(1000);
+
+    auto start = std::chrono::steady_clock::now();
+    auto output = tasks.map_concurrently_retry(
+        [](lt::retry::RetryStatus, const int& o) { return o < 0; },
+        [&](const int& i) -> attempt_result_t<int> {
+            return attempts[i].fetch_add(1, std::memory_order_relaxed) < 2 ? -1 : i;
+        },
+        iota(static_cast<int>(attempts.size())));
+    auto real = std::chrono::steady_clock::now() - start;
+
+    LT_ASYNC_CHECK(output);
+    LT_ASYNC_CHECK((*output)[999] == 999);
+    LT_ASYNC_CHECK(sim.elapsed() >= 200ms);
+    LT_ASYNC_CHECK(sim.elapsed() < 300ms);
+    LT_ASYNC_CHECK(real < 1s);
+}
+
+void test_runs_are_repeatable()
+{
+    auto run = [] {
+        auto sim = lt::async::simulation();
+        auto tasks = lt::async::basic_async<int, long, std::string, lt::async::simulation>(sim);
+        auto output = tasks.map_concurrently(
+            [&](const int& i) -> attempt_result_t<long> {
+                lt::async::this_fiber::sleep_for(std::chrono::milliseconds(i % 7));
+                return std::chrono::duration_cast<std::chrono::milliseconds>(sim.elapsed()).count();
+            },
+            iota(1000));
+        LT_ASYNC_CHECK(output);
+        return *output;
+    };
+
+    LT_ASYNC_CHECK(run() == run());
+}
+
+} // namespace
+
+int main()
+{
+    test_sleeps_take_virtual_time();
+    test_condition_variable_waits();
+    test_retry_delays_take_virtual_time();
+    test_runs_are_repeatable();
+}
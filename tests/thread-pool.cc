@@ -0,0 +1,136 @@
+// Smoke tests for `thread_pool` and `map_concurrently()` running on it.
+
+#include <atomic>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "lt/async/async.h"
+#include "lt/async/executor.h"
+
+#include "check.h"
+
+namespace
+{
+
+using lt::async::attempt_result_t;
+
+std::vector<int> iota(int n)
+{
+    auto v = std::vector<int>(n);
+    for (int i = 0; i < n; ++i) {
+        v[i] = i;
+    }
+    return v;
+}
+
+void test_bulk_runs_every_index(lt::async::thread_pool& pool)
+{
+    auto seen = std::vector<std::atomic<int>>(10000);
+    pool.bulk(seen.size(), [&](std::size_t i) { seen[i].fetch_add(1, std::memory_order_relaxed); });
+    for (auto& s : seen) {
+        LT_ASYNC_CHECK(s.load() == 1);
+    }
+}
+
+void test_bulk_rethrows_after_all_elements(lt::async::thread_pool& pool)
+{
+    auto count = std::atomic<int>(0);
+    auto threw = false;
+    try {
+        pool.bulk(100, [&](std::size_t i) {
+            count.fetch_add(1, std::memory_order_relaxed);
+            if (i == 3) {
+                throw std::runtime_error("element 3");
+            }
+        });
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    LT_ASYNC_CHECK(threw);
+    LT_ASYNC_CHECK(count.load() == 100);
+}
+
+void test_post_runs_asynchronously(lt::async::thread_pool& pool)
+{
+    auto done = std::atomic<bool>(false);
+    pool.post([&] { done.store(true, std::memory_order_release); });
+    while (!done.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+}
+
+void test_map_concurrently(lt::async::thread_pool& pool)
+{
+    auto tasks = lt::async::basic_async<int, std::string, std::string, lt::async::thread_pool>(pool);
+    auto input = iota(1000);
+
+    auto output = tasks.map_concurrently(
+        [](const int& i) -> attempt_result_t<std::string> { return std::to_string(i); }, input);
+    LT_ASYNC_CHECK(output);
+    LT_ASYNC_CHECK(output->size() == input.size());
+    LT_ASYNC_CHECK((*output)[999] == "999");
+
+    auto failed = tasks.map_concurrently(
+        [](const int& i) -> attempt_result_t<std::string> {
+            if (i == 10 || i == 500) {
+                return tl::unexpected("failed " + std::to_string(i));
+            }
+            return std::to_string(i);
+        },
+        input);
+    LT_ASYNC_CHECK(!failed);
+    LT_ASYNC_CHECK(failed.error() == "failed 10");
+}
+
+// Every element of the outer batch waits on an inner batch. With a single
+// worker this only finishes if callers help to run their own batches.
+void test_nested_batches_on_one_worker()
+{
+    auto pool = lt::async::thread_pool(1);
+    auto tasks = lt::async::basic_async<int, int, std::string, lt::async::thread_pool>(pool);
+    auto input = iota(16);
+
+    auto output = tasks.map_concurrently(
+        [&](const int& i) -> attempt_result_t<int> {
+            auto inner = tasks.map_concurrently(
+                [&](const int& j) -> attempt_result_t<int> { return i * 100 + j; }, iota(8));
+            if (!inner) {
+                return tl::unexpected(inner.error());
+            }
+            return (*inner)[7];
+        },
+        input);
+    LT_ASYNC_CHECK(output);
+    LT_ASYNC_CHECK((*output)[15] == 1507);
+}
+
+void test_resize()
+{
+    auto pool = lt::async::thread_pool(2);
+    pool.resize(6);
+    LT_ASYNC_CHECK(pool.size() == 6);
+    test_bulk_runs_every_index(pool);
+    pool.resize(1);
+    LT_ASYNC_CHECK(pool.size() == 1);
+    test_bulk_runs_every_index(pool);
+}
+
+} // namespace
+
+int main()
+{
+    auto pool = lt::async::thread_pool(4);
+    test_bulk_runs_every_index(pool);
+    test_bulk_rethrows_after_all_elements(pool);
+    test_post_runs_asynchronously(pool);
+    test_map_concurrently(pool);
+    test_nested_batches_on_one_worker();
+    test_resize();
+
+    auto lazy = lt::async::thread_pool(2, 64, lt::async::worker_start::lazy);
+    test_bulk_runs_every_index(lazy);
+    test_post_runs_asynchronously(lazy);
+}